@@ -1,12 +1,14 @@
 // This code is in the public domain -- castano@gmail.com
 
 #include "FileSystem.h"
+#include "Utils.h" // min
 
 #if NV_OS_WIN32
 #define _CRT_NONSTDC_NO_WARNINGS // _chdir is defined deprecated, but that's a bug, chdir is deprecated, _chdir is *not*.
 //#include <shlwapi.h> // PathFileExists
 #include <windows.h> // GetFileAttributes
 #include <direct.h> // _mkdir, _chdir
+#include <io.h> // _get_osfhandle
 #elif NV_OS_XBOX
 #include <Xtl.h>
 #elif NV_OS_ORBIS
@@ -14,7 +16,8 @@
 #else
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <unistd.h>
+#include <unistd.h> // pwrite
+#include <errno.h>
 #endif
 #include <stdio.h> // remove, unlink
 
@@ -99,5 +102,66 @@ bool FileSystem::copyFile(const char * src, const char * dst) {
     return true;
 }
 
+bool FileSystem::writeAt(FILE * fp, uint64 offset, const void * data, size_t size)
+{
+    const uint8 * ptr = (const uint8 *)data;
+
+#if NV_OS_WIN32
+    HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (file == INVALID_HANDLE_VALUE || GetFileType(file) != FILE_TYPE_DISK) return false;
+
+    // Overlapped writes move the file pointer of synchronous handles, restore the position of the stream afterwards.
+    _lock_file(fp);
+    defer{ _unlock_file(fp); };
+
+    if (fflush(fp) != 0) return false;
+    const __int64 position = _ftelli64(fp);
+
+    bool result = true;
+    while (size > 0) {
+        const DWORD count = DWORD(min(size, size_t(1) << 30));
+
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+
+        DWORD written = 0;
+        if (!WriteFile(file, ptr, count, &written, &overlapped) || written == 0) {
+            result = false;
+            break;
+        }
+
+        ptr += written;
+        offset += written;
+        size -= written;
+    }
+
+    _fseeki64(fp, position, SEEK_SET);
+    return result;
+#elif NV_OS_UNIX
+    // Data buffered by the stream has to reach the file first, or it could overwrite this write later.
+    if (fflush(fp) != 0) return false;
+
+    const int fd = fileno(fp);
+    while (size > 0) {
+        const ssize_t written = pwrite(fd, ptr, size, off_t(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+
+        ptr += written;
+        offset += uint64(written);
+        size -= size_t(written);
+    }
+
+    return true;
+#else
+    NV_UNUSED(fp);
+    NV_UNUSED(offset);
+    NV_UNUSED(ptr);
+    NV_UNUSED(size);
+    return false;
+#endif
+}
+
 
 
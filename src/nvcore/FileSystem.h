@@ -6,6 +6,8 @@
 
 #include "nvcore.h"
 
+#include <stdio.h> // FILE
+
 namespace nv
 {
 
@@ -16,6 +18,10 @@ namespace nv
         NVCORE_API bool changeDirectory(const char * path);
         NVCORE_API bool removeFile(const char * path);
         NVCORE_API bool copyFile(const char * src, const char * dst);
+
+        // Write at the given offset of the file, without moving the position of the stream. Safe to call from several
+        // threads at once. Returns false if the file does not support positioned writes.
+        NVCORE_API bool writeAt(FILE * fp, uint64 offset, const void * data, size_t size);
     } // FileSystem namespace
 
 } // nv namespace
@@ -6,6 +6,17 @@
 
 #include <stdlib.h>
 
+#if NV_OS_WIN32
+#include <windows.h> // CreateFileMapping, MapViewOfFile
+#elif NV_OS_UNIX
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <fcntl.h> // open
+#include <unistd.h> // ftruncate, unlink
+#include <pthread.h> // pthread_mutex_t
+#include <stdio.h> // snprintf
+#endif
+
 #define USE_EFENCE 0
 
 #if USE_EFENCE
@@ -147,3 +158,319 @@ void nv::aligned_free(void * ptr)
 #endif
 }
 
+void * nv::mapped_malloc(size_t size, const char * directory/*= NULL*/)
+{
+    if (size == 0) return NULL;
+
+#if NV_OS_WIN32
+    char tempPath[MAX_PATH];
+    if (directory == NULL) {
+        if (GetTempPathA(MAX_PATH, tempPath) == 0) return NULL;
+        directory = tempPath;
+    }
+
+    char fileName[MAX_PATH];
+    if (GetTempFileNameA(directory, "nv", 0, fileName) == 0) return NULL;
+
+    // The file is deleted when the last handle to it is closed, the mapping keeps it alive.
+    HANDLE file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, DWORD(uint64(size) >> 32), DWORD(size), NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+
+    void * ptr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    CloseHandle(mapping);
+
+    return ptr;
+#elif NV_OS_UNIX
+    if (directory == NULL) {
+        directory = getenv("TMPDIR");
+        if (directory == NULL) directory = "/tmp";
+    }
+
+    char fileName[1024];
+    snprintf(fileName, sizeof(fileName), "%s/nvXXXXXX", directory);
+
+    int fd = mkstemp(fileName);
+    if (fd < 0) return NULL;
+
+    // Unlink the file right away, the mapping keeps it alive.
+    unlink(fileName);
+
+    void * ptr = NULL;
+    if (ftruncate(fd, off_t(size)) == 0) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) ptr = NULL;
+    }
+    close(fd);
+
+    return ptr;
+#else
+    NV_UNUSED(directory);
+    return ::calloc(size, 1);
+#endif
+}
+
+void nv::mapped_free(void * ptr, size_t size)
+{
+    if (ptr == NULL) return;
+
+#if NV_OS_WIN32
+    NV_UNUSED(size);
+    UnmapViewOfFile(ptr);
+#elif NV_OS_UNIX
+    munmap(ptr, size);
+#else
+    NV_UNUSED(size);
+    ::free(ptr);
+#endif
+}
+
+const void * nv::map_file(const char * fileName, size_t * size)
+{
+#if NV_OS_WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || uint64(fileSize.QuadPart) > uint64(SIZE_MAX)) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    // The mapping keeps the file open.
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+
+    const void * ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (ptr != NULL) *size = size_t(fileSize.QuadPart);
+    return ptr;
+#elif NV_OS_UNIX
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    const void * ptr = NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && uint64(st.st_size) <= uint64(SIZE_MAX)) {
+        void * mem = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mem != MAP_FAILED) {
+            ptr = mem;
+            *size = size_t(st.st_size);
+        }
+    }
+    close(fd);
+
+    return ptr;
+#else
+    NV_UNUSED(fileName);
+    NV_UNUSED(size);
+    return NULL;
+#endif
+}
+
+void nv::unmap_file(const void * ptr, size_t size)
+{
+    if (ptr == NULL) return;
+
+#if NV_OS_WIN32
+    NV_UNUSED(size);
+    UnmapViewOfFile(ptr);
+#elif NV_OS_UNIX
+    munmap(const_cast<void *>(ptr), size);
+#else
+    NV_UNUSED(size);
+#endif
+}
+
+
+// Buffer pool.
+
+#if NV_OS_WIN32
+static SRWLOCK s_poolLock = SRWLOCK_INIT;
+static void lockPool() { AcquireSRWLockExclusive(&s_poolLock); }
+static void unlockPool() { ReleaseSRWLockExclusive(&s_poolLock); }
+#elif NV_OS_UNIX
+static pthread_mutex_t s_poolLock = PTHREAD_MUTEX_INITIALIZER;
+static void lockPool() { pthread_mutex_lock(&s_poolLock); }
+static void unlockPool() { pthread_mutex_unlock(&s_poolLock); }
+#else
+static void lockPool() {}
+static void unlockPool() {}
+#endif
+
+// The header precedes the buffer and keeps it aligned.
+struct PoolHeader {
+    PoolHeader * next;      // Next cached buffer of the same size class.
+    size_t size;            // Size of the buffer, excluding the header.
+    uint sizeClass;
+    bool mapped;
+};
+
+static const size_t s_poolAlignment = 64;
+static const size_t s_poolMinSize = 64 * 1024;          // Smaller buffers are not cached.
+static const size_t s_poolHugePageSize = 2 * 1024 * 1024;
+static const uint s_poolClassCount = 4 * 64;
+static const uint s_poolUncached = ~0U;
+
+static PoolHeader * s_poolFree[s_poolClassCount];
+static size_t s_poolCacheLimit = 256 * 1024 * 1024;
+static PoolStats s_poolStats;
+
+// Size classes are spaced 4 per power of two, so that rounding wastes at most 25%.
+static uint poolSizeClass(size_t size, size_t * classSize)
+{
+    uint log2 = 0;
+    for (uint64 x = uint64(size - 1); x > 1; x >>= 1) log2++;
+
+    const size_t step = size_t(1) << (log2 - 2);
+    *classSize = (size + step - 1) & ~(step - 1);
+
+    return (log2 - 15) * 4 + uint(*classSize / step) - 5;
+}
+
+static PoolHeader * poolAllocate(size_t size)
+{
+    const size_t total = size + s_poolAlignment;
+
+    PoolHeader * header = NULL;
+    bool mapped = false;
+
+#if NV_OS_LINUX
+    // Anonymous mappings are page aligned and can be backed by transparent huge pages.
+    if (size >= s_poolHugePageSize) {
+        void * ptr = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED) {
+#if defined(MADV_HUGEPAGE)
+            madvise(ptr, total, MADV_HUGEPAGE);
+#endif
+            header = (PoolHeader *)ptr;
+            mapped = true;
+        }
+    }
+#endif
+
+    if (header == NULL) {
+        header = (PoolHeader *)aligned_malloc(total, s_poolAlignment);
+        if (header == NULL) return NULL;
+    }
+
+    header->next = NULL;
+    header->size = size;
+    header->mapped = mapped;
+
+    return header;
+}
+
+static void poolRelease(PoolHeader * header)
+{
+#if NV_OS_LINUX
+    if (header->mapped) {
+        munmap(header, header->size + s_poolAlignment);
+        return;
+    }
+#endif
+    aligned_free(header);
+}
+
+void * nv::pool_malloc(size_t size)
+{
+    if (size == 0) return NULL;
+
+    size_t classSize = size;
+    uint sizeClass = s_poolUncached;
+    if (size >= s_poolMinSize) {
+        sizeClass = poolSizeClass(size, &classSize);
+        nvDebugCheck(sizeClass < s_poolClassCount);
+    }
+
+    PoolHeader * header = NULL;
+
+    lockPool();
+    s_poolStats.allocationCount++;
+    if (sizeClass != s_poolUncached && s_poolFree[sizeClass] != NULL) {
+        header = s_poolFree[sizeClass];
+        s_poolFree[sizeClass] = header->next;
+        s_poolStats.reuseCount++;
+        s_poolStats.cachedSize -= classSize;
+    }
+    unlockPool();
+
+    if (header == NULL) {
+        header = poolAllocate(classSize);
+        if (header == NULL) return NULL;
+    }
+    header->sizeClass = sizeClass;
+
+    lockPool();
+    s_poolStats.liveSize += classSize;
+    s_poolStats.peakSize = max(s_poolStats.peakSize, s_poolStats.liveSize);
+    unlockPool();
+
+    return (uint8 *)header + s_poolAlignment;
+}
+
+void nv::pool_free(void * ptr)
+{
+    if (ptr == NULL) return;
+
+    PoolHeader * header = (PoolHeader *)((uint8 *)ptr - s_poolAlignment);
+    bool cached = false;
+
+    lockPool();
+    s_poolStats.liveSize -= header->size;
+    if (header->sizeClass != s_poolUncached && s_poolStats.cachedSize + header->size <= s_poolCacheLimit) {
+        header->next = s_poolFree[header->sizeClass];
+        s_poolFree[header->sizeClass] = header;
+        s_poolStats.cachedSize += header->size;
+        cached = true;
+    }
+    unlockPool();
+
+    if (!cached) poolRelease(header);
+}
+
+void nv::pool_trim()
+{
+    PoolHeader * list = NULL;
+
+    lockPool();
+    for (uint i = 0; i < s_poolClassCount; i++) {
+        while (s_poolFree[i] != NULL) {
+            PoolHeader * header = s_poolFree[i];
+            s_poolFree[i] = header->next;
+            header->next = list;
+            list = header;
+        }
+    }
+    s_poolStats.cachedSize = 0;
+    unlockPool();
+
+    while (list != NULL) {
+        PoolHeader * next = list->next;
+        poolRelease(list);
+        list = next;
+    }
+}
+
+void nv::pool_set_cache_limit(size_t size)
+{
+    lockPool();
+    s_poolCacheLimit = size;
+    const bool trim = s_poolStats.cachedSize > size;
+    unlockPool();
+
+    if (trim) pool_trim();
+}
+
+PoolStats nv::pool_stats()
+{
+    lockPool();
+    PoolStats stats = s_poolStats;
+    unlockPool();
+    return stats;
+}
@@ -54,6 +54,35 @@ namespace nv {
     NVCORE_API void * aligned_malloc(size_t size, size_t alignment);
     NVCORE_API void aligned_free(void * );
 
+    // Allocate zeroed memory backed by a temporary file in the given directory, or the system temp directory if NULL.
+    // Pages are written back to the file under memory pressure instead of to the swap. Returns NULL on failure.
+    NVCORE_API void * mapped_malloc(size_t size, const char * directory = NULL);
+    NVCORE_API void mapped_free(void * ptr, size_t size);
+
+    // Map an existing file for reading. Nothing is read up front, pages are loaded the first time they are accessed.
+    // Returns NULL on failure or if the file is empty.
+    NVCORE_API const void * map_file(const char * fileName, size_t * size);
+    NVCORE_API void unmap_file(const void * ptr, size_t size);
+
+    // Pool of large buffers recycled by size class. Temporaries that are allocated and released over and over, like the
+    // images of a mipmap chain, reuse memory that is already mapped instead of faulting fresh pages every time.
+    // Buffers are 64 byte aligned, the largest ones are backed by huge pages where available. The pool is thread safe.
+    NVCORE_API void * pool_malloc(size_t size);
+    NVCORE_API void pool_free(void * ptr);
+
+    // Release the cached buffers, and limit the amount of memory the pool keeps around (256 MB by default).
+    NVCORE_API void pool_trim();
+    NVCORE_API void pool_set_cache_limit(size_t size);
+
+    struct PoolStats {
+        uint64 allocationCount;     // Number of pool_malloc calls.
+        uint64 reuseCount;          // Allocations served from the cache.
+        uint64 liveSize;            // Bytes currently allocated.
+        uint64 peakSize;            // Peak of liveSize.
+        uint64 cachedSize;          // Bytes released and kept for reuse.
+    };
+    NVCORE_API PoolStats pool_stats();
+
     // C++ helpers.
     template <typename T> NV_FORCEINLINE T * malloc(size_t count) {
         return (T *)::malloc(sizeof(T) * count);
@@ -129,6 +129,8 @@ namespace nv
         virtual bool isSeekable() const { return true; }
         //@}
 
+        FILE * handle() const { return m_fp; }
+
     protected:
 
         FILE * m_fp;
@@ -10,6 +10,10 @@
 
 #include <string.h> // memcpy
 
+#if NV_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace nv;
 
 namespace {
@@ -77,9 +81,9 @@ void ColorBlock::init(uint w, uint h, const uint * data, uint x, uint y)
     }
 }
 
-void ColorBlock::init(uint w, uint h, const float * data, uint x, uint y)
+void ColorBlock::init(uint w, uint h, const float * const channels[4], uint x, uint y)
 {
-    nvDebugCheck(data != NULL);
+    nvDebugCheck(channels != NULL);
 
     const uint bw = min(w - x, 4U);
     const uint bh = min(h - y, 4U);
@@ -89,8 +93,6 @@ void ColorBlock::init(uint w, uint h, const float * data, uint x, uint y)
     // @@ Thats only correct when block size is 1, 2 or 4, but not with 3. :(
     // @@ Ideally we should zero the weights of the pixels out of range.
 
-    uint srcPlane = w * h;
-
     for (uint i = 0; i < 4; i++)
     {
         const uint by = i % bh;
@@ -98,13 +100,82 @@ void ColorBlock::init(uint w, uint h, const float * data, uint x, uint y)
         for (uint e = 0; e < 4; e++)
         {
             const uint bx = e % bw;
-            const uint idx = ((y + by) * w + x + bx);
+            const uint64 idx = (uint64(y + by) * w + x + bx);
 
+            // Missing channels are zero.
             Color32 & c = color(e, i);
-            c.r = uint8(255 * clamp(data[idx + 0 * srcPlane], 0.0f, 1.0f)); // @@ Is this the right way to quantize floats to bytes?
-            c.g = uint8(255 * clamp(data[idx + 1 * srcPlane], 0.0f, 1.0f));
-            c.b = uint8(255 * clamp(data[idx + 2 * srcPlane], 0.0f, 1.0f));
-            c.a = uint8(255 * clamp(data[idx + 3 * srcPlane], 0.0f, 1.0f));
+            c.r = channels[0] ? uint8(255 * clamp(channels[0][idx], 0.0f, 1.0f)) : 0; // @@ Is this the right way to quantize floats to bytes?
+            c.g = channels[1] ? uint8(255 * clamp(channels[1][idx], 0.0f, 1.0f)) : 0;
+            c.b = channels[2] ? uint8(255 * clamp(channels[2][idx], 0.0f, 1.0f)) : 0;
+            c.a = channels[3] ? uint8(255 * clamp(channels[3][idx], 0.0f, 1.0f)) : 0;
+        }
+    }
+}
+
+void ColorBlock::init(const Vector4 texels[16])
+{
+    for (uint i = 0; i < 16; i++)
+    {
+        Color32 & c = m_color[i];
+        c.r = uint8(255 * clamp(texels[i].x, 0.0f, 1.0f));
+        c.g = uint8(255 * clamp(texels[i].y, 0.0f, 1.0f));
+        c.b = uint8(255 * clamp(texels[i].z, 0.0f, 1.0f));
+        c.a = uint8(255 * clamp(texels[i].w, 0.0f, 1.0f));
+    }
+}
+
+void nv::gatherBlockRow(uint w, uint h, const float * const channels[4], uint y, Vector4 * texels)
+{
+    nvDebugCheck(y < h && (y % 4) == 0);
+
+    const uint bh = min(h - y, 4U);
+    const uint bw = (w + 3) / 4;
+
+    for (uint i = 0; i < 4; i++)
+    {
+        const uint64 row = uint64(y + (i % bh)) * w;
+
+#if NV_USE_SSE
+        // Blocks that are entirely inside the image.
+        const uint fullCount = w / 4;
+        const __m128 zero = _mm_setzero_ps();
+        for (uint b = 0; b < fullCount; b++)
+        {
+            const uint64 idx = row + 4 * b;
+
+            // Load the 4 texels of the block row for every channel and transpose them to RGBA.
+            __m128 r = channels[0] ? _mm_loadu_ps(channels[0] + idx) : zero;
+            __m128 g = channels[1] ? _mm_loadu_ps(channels[1] + idx) : zero;
+            __m128 bl = channels[2] ? _mm_loadu_ps(channels[2] + idx) : zero;
+            __m128 a = channels[3] ? _mm_loadu_ps(channels[3] + idx) : zero;
+            _MM_TRANSPOSE4_PS(r, g, bl, a);
+
+            float * dst = texels[16 * b + 4 * i].component;
+            _mm_storeu_ps(dst + 0, r);
+            _mm_storeu_ps(dst + 4, g);
+            _mm_storeu_ps(dst + 8, bl);
+            _mm_storeu_ps(dst + 12, a);
+        }
+        const uint first = fullCount;
+#else
+        const uint first = 0;
+#endif
+
+        for (uint b = first; b < bw; b++)
+        {
+            const uint x = 4 * b;
+            const uint bx = min(w - x, 4U);
+
+            for (uint e = 0; e < 4; e++)
+            {
+                const uint64 idx = row + x + (e % bx);
+
+                Vector4 & t = texels[16 * b + 4 * i + e];
+                t.x = channels[0] ? channels[0][idx] : 0.0f;
+                t.y = channels[1] ? channels[1][idx] : 0.0f;
+                t.z = channels[2] ? channels[2][idx] : 0.0f;
+                t.w = channels[3] ? channels[3][idx] : 0.0f;
+            }
         }
     }
 }
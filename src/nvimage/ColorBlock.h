@@ -18,7 +18,8 @@ namespace nv
         ColorBlock(const ColorBlock & block);
 
         void init(uint w, uint h, const uint * data, uint x, uint y);
-        void init(uint w, uint h, const float * data, uint x, uint y);
+        void init(uint w, uint h, const float * const channels[4], uint x, uint y);
+        void init(const Vector4 texels[16]);
 
         void swizzle(uint x, uint y, uint z, uint w); // 0=r, 1=g, 2=b, 3=a, 4=0xFF, 5=0
 
@@ -151,6 +152,11 @@ namespace nv
 
 
 
+    // Gather the row of 4x4 blocks that starts at the given pixel row into block linear RGBA texels, so that each block
+    // is stored as 16 consecutive texels. NULL channels are zero. Blocks that extend past the edges of the image repeat
+    // its pixels like ColorBlock::init does.
+    void gatherBlockRow(uint w, uint h, const float * const channels[4], uint y, Vector4 * texels);
+
 } // nv namespace
 
 #endif // NV_IMAGE_COLORBLOCK_H
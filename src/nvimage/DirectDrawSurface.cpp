@@ -9,6 +9,7 @@
 #include "nvcore/Debug.h"
 #include "nvcore/Utils.h" // max
 #include "nvcore/StdStream.h"
+#include "nvcore/Memory.h" // map_file
 #include "nvmath/Vector.inl"
 #include "nvmath/ftoi.h"
 
@@ -971,17 +972,31 @@ bool DDSHeader::isBlockFormat() const
 
 
 
-DirectDrawSurface::DirectDrawSurface() : stream(NULL)
+DirectDrawSurface::DirectDrawSurface() : stream(NULL), mappedData(NULL), mappedSize(0)
 {
 }
 
 DirectDrawSurface::~DirectDrawSurface()
 {
     delete stream;
+    unmap_file(mappedData, mappedSize);
 }
 
 bool DirectDrawSurface::load(const char * filename)
 {
+    // Map the file, so that the surfaces can be accessed without copies. Streams are limited to 32 bit sizes.
+    size_t size = 0;
+    const void * data = map_file(filename, &size);
+    if (data != NULL) {
+        if (uint64(size) <= 0xFFFFFFFFULL) {
+            bool result = load(new MemoryInputStream((const uint8 *)data, uint(size)));
+            mappedData = (const uint8 *)data;
+            mappedSize = size;
+            return result;
+        }
+        unmap_file(data, size);
+    }
+
     return load(new StdInputStream(filename));
 }
 
@@ -990,6 +1005,10 @@ bool DirectDrawSurface::load(Stream * stream)
     delete this->stream;
     this->stream = stream;
 
+    unmap_file(mappedData, mappedSize);
+    mappedData = NULL;
+    mappedSize = 0;
+
     if (!stream->isError())
     {
         (*stream) << header;
@@ -1299,7 +1318,7 @@ uint DirectDrawSurface::faceSize() const
     return size;
 }
 
-uint DirectDrawSurface::offset(uint face, uint mipmap)
+uint DirectDrawSurface::offset(uint face, uint mipmap) const
 {
     uint size = 128; // sizeof(DDSHeader);
 
@@ -1325,12 +1344,28 @@ bool DirectDrawSurface::readSurface(uint face, uint mipmap, void * data, uint si
 {
     if (size != surfaceSize(mipmap)) return false;
 
+    if (const void * src = surfaceData(face, mipmap)) {
+        memcpy(data, src, size);
+        return true;
+    }
+
     stream->seek(offset(face, mipmap));
     if (stream->isError()) return false;
 
     return stream->serialize(data, size) == size;
 }
 
+const void * DirectDrawSurface::surfaceData(uint face, uint mipmap) const
+{
+    if (mappedData == NULL) return NULL;
+
+    // Truncated files are handled by readSurface.
+    const uint64 begin = offset(face, mipmap);
+    if (begin + surfaceSize(mipmap) > mappedSize) return NULL;
+
+    return mappedData + begin;
+}
+
 
 
 void DirectDrawSurface::printInfo() const
@@ -1446,7 +1481,7 @@ void DirectDrawSurface::printInfo() const
 }
 
 
-static bool readLinearImage(Image * img, uint8 * data, uint bitcount, uint rmask, uint gmask, uint bmask, uint amask)
+static bool readLinearImage(Image * img, const uint8 * data, uint bitcount, uint rmask, uint gmask, uint bmask, uint amask)
 {
     nvDebugCheck(img != NULL);
     nvDebugCheck(data != NULL);
@@ -1495,24 +1530,24 @@ static bool readLinearImage(Image * img, uint8 * data, uint bitcount, uint rmask
 }
 
 
-static void readBlock(ColorBlock * rgba, uint8 * data, uint dxgiFormat, bool isNormalMap, bool swapRA)
+static void readBlock(ColorBlock * rgba, const uint8 * data, uint dxgiFormat, bool isNormalMap, bool swapRA)
 {
     nvDebugCheck(rgba != NULL);
     nvDebugCheck(data != NULL);
 
     if (dxgiFormat == DXGI_FORMAT_BC1_UNORM)
     {
-        BlockDXT1 * block = (BlockDXT1 *)data;
+        const BlockDXT1 * block = (const BlockDXT1 *)data;
         block->decodeBlock(rgba);
     }
     else if (dxgiFormat == DXGI_FORMAT_BC2_UNORM)
     {
-        BlockDXT3 * block = (BlockDXT3 *)data;
+        const BlockDXT3 * block = (const BlockDXT3 *)data;
         block->decodeBlock(rgba);
     }
     else if (dxgiFormat == DXGI_FORMAT_BC3_UNORM)
     {
-        BlockDXT5 * block = (BlockDXT5 *)data;
+        const BlockDXT5 * block = (const BlockDXT5 *)data;
         block->decodeBlock(rgba);
 
         if (swapRA) {
@@ -1528,17 +1563,17 @@ static void readBlock(ColorBlock * rgba, uint8 * data, uint dxgiFormat, bool isN
     }
     else if (DXGI_FORMAT_BC4_UNORM)
     {
-        BlockATI1 * block = (BlockATI1 *)data;
+        const BlockATI1 * block = (const BlockATI1 *)data;
         block->decodeBlock(rgba);
     }
     else if (DXGI_FORMAT_BC5_UNORM)
     {
-        BlockATI2 * block = (BlockATI2 *)data;
+        const BlockATI2 * block = (const BlockATI2 *)data;
         block->decodeBlock(rgba);
     }
     else if (dxgiFormat == DXGI_FORMAT_BC6H_UF16)
     {
-        BlockBC6 * block = (BlockBC6 *)data;
+        const BlockBC6 * block = (const BlockBC6 *)data;
         Vector4 colors[16];
         block->decodeBlock(colors);
 
@@ -1558,7 +1593,7 @@ static void readBlock(ColorBlock * rgba, uint8 * data, uint dxgiFormat, bool isN
     }
     else if (dxgiFormat == DXGI_FORMAT_BC7_UNORM)
     {
-        BlockBC7 * block = (BlockBC7 *)data;
+        const BlockBC7 * block = (const BlockBC7 *)data;
         block->decodeBlock(rgba);
     }
     else
@@ -1583,7 +1618,7 @@ static void readBlock(ColorBlock * rgba, uint8 * data, uint dxgiFormat, bool isN
 }
 
 
-static bool readBlockImage(Image * img, uint8 * data, uint dxgiFormat, bool isNormalMap, bool swapRA)
+static bool readBlockImage(Image * img, const uint8 * data, uint dxgiFormat, bool isNormalMap, bool swapRA)
 {
     nvDebugCheck(img != NULL);
     nvDebugCheck(data != NULL);
@@ -1666,12 +1701,19 @@ bool nv::imageFromDDS(Image * img, DirectDrawSurface & dds, uint face, uint mipm
 {
     if (!dds.isValid()) return false;
 
-    uint size = dds.surfaceSize(mipmap);
-    uint8 * data = malloc<uint8>(size);
-    defer { free(data); };
+    // Decode in place when the file is mapped, otherwise read a copy of the surface.
+    const uint8 * data = (const uint8 *)dds.surfaceData(face, mipmap);
+    uint8 * buffer = NULL;
+    defer { free(buffer); };
 
-    if (!dds.readSurface(face, mipmap, data, size)) {
-        return false;
+    if (data == NULL) {
+        uint size = dds.surfaceSize(mipmap);
+        buffer = malloc<uint8>(size);
+
+        if (!dds.readSurface(face, mipmap, buffer, size)) {
+            return false;
+        }
+        data = buffer;
     }
 
     uint w = dds.surfaceWidth(mipmap);
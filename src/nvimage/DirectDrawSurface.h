@@ -386,6 +386,10 @@ namespace nv
         uint surfaceSize(uint mipmap) const;
         bool readSurface(uint face, uint mipmap, void * data, uint size);
 
+        // Data of the given surface in place, when the file was loaded by name and could be mapped, NULL otherwise.
+        // Only the pages of the surfaces that are accessed are read from disk.
+        const void * surfaceData(uint face, uint mipmap) const;
+
         void printInfo() const;
 
         // Only initialized after loading.
@@ -394,10 +398,11 @@ namespace nv
     private:
 
         uint faceSize() const;
-        uint offset(uint face, uint mipmap);
+        uint offset(uint face, uint mipmap) const;
 
         Stream * stream;
-        //void * data;
+        const uint8 * mappedData;
+        size_t mappedSize;
     };
 
     bool imageFromDDS(Image * img, DirectDrawSurface & dds, uint face, uint mipmap);
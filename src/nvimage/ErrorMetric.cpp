@@ -1,15 +1,68 @@
-
 #include "ErrorMetric.h"
 #include "FloatImage.h"
 #include "Filter.h"
 
 #include "nvmath/Matrix.h"
 #include "nvmath/Vector.inl"
+#include "nvmath/Gamma.h"
+#include "nvmath/ftoi.h"
+
+#include "nvthread/ParallelFor.h"
+
+#include "nvcore/Array.inl"
 
 #include <float.h> // FLT_MAX
 
+#if NV_USE_SSE > 1
+#include <emmintrin.h> // SSE2
+#endif
+
 using namespace nv;
 
+namespace
+{
+    static const uint s_chunkSize = 16 * 1024;
+
+    // Sums f(begin, end) over the chunks of [0, count) in parallel. The partial sums are added in chunk order, so the
+    // result does not depend on the number of threads.
+    template <typename F>
+    static double parallelSum(uint64 count, F f)
+    {
+        Array<double> partials;
+        partials.resize(uint((count + s_chunkSize - 1) / s_chunkSize), 0.0);
+        double * partialBuffer = partials.buffer();
+
+        parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+            partialBuffer[begin / s_chunkSize] = f(begin, end);
+        });
+
+        double sum = 0;
+        for (uint i = 0; i < partials.count(); i++) sum += partials[i];
+        return sum;
+    }
+
+#if NV_USE_SSE > 1
+    // Adds the four lanes of v to a pair of double precision accumulators.
+    static inline void accumulate(__m128 v, __m128d & lo, __m128d & hi)
+    {
+        lo = _mm_add_pd(lo, _mm_cvtps_pd(v));
+        hi = _mm_add_pd(hi, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+
+    static inline double horizontalSum(__m128d lo, __m128d hi)
+    {
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(lo, hi));
+        return lanes[0] + lanes[1];
+    }
+
+    static inline __m128 absolute(__m128 v)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+    }
+#endif
+}
+
 float nv::rmsColorError(const FloatImage * ref, const FloatImage * img, bool alphaWeight)
 {
     if (!sameLayout(img, ref)) {
@@ -18,31 +71,54 @@ float nv::rmsColorError(const FloatImage * ref, const FloatImage * img, bool alp
     nvDebugCheck(img->componentCount() == 4);
     nvDebugCheck(ref->componentCount() == 4);
 
-    double mse = 0;
+    const float * r0 = ref->channel(0);
+    const float * g0 = ref->channel(1);
+    const float * b0 = ref->channel(2);
+    const float * a0 = ref->channel(3);
+    const float * r1 = img->channel(0);
+    const float * g1 = img->channel(1);
+    const float * b1 = img->channel(2);
+
+    const uint64 count = img->pixelCount();
+    double mse = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        uint64 i = begin;
+
+#if NV_USE_SSE > 1
+        __m128d lo = _mm_setzero_pd();
+        __m128d hi = _mm_setzero_pd();
+        for (; i + 4 <= end; i += 4) {
+            __m128 r = _mm_sub_ps(_mm_loadu_ps(r0 + i), _mm_loadu_ps(r1 + i));
+            __m128 g = _mm_sub_ps(_mm_loadu_ps(g0 + i), _mm_loadu_ps(g1 + i));
+            __m128 b = _mm_sub_ps(_mm_loadu_ps(b0 + i), _mm_loadu_ps(b1 + i));
+
+            __m128 a = _mm_set1_ps(1.0f);
+            if (alphaWeight) {
+                a = _mm_loadu_ps(a0 + i);
+                a = _mm_mul_ps(a, a);
+            }
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
-    {
-        float r0 = ref->pixel(i + count * 0);
-        float g0 = ref->pixel(i + count * 1);
-        float b0 = ref->pixel(i + count * 2);
-        float a0 = ref->pixel(i + count * 3);
-        float r1 = img->pixel(i + count * 0);
-        float g1 = img->pixel(i + count * 1);
-        float b1 = img->pixel(i + count * 2);
-        //float a1 = img->pixel(i + count * 3);
-
-        float r = r0 - r1;
-        float g = g0 - g1;
-        float b = b0 - b1;
-
-        float a = 1;
-        if (alphaWeight) a = a0 * a0; // @@ a0*a1 or a0*a0 ?
-
-        mse += (r * r) * a;
-        mse += (g * g) * a;
-        mse += (b * b) * a;
-    }
+            accumulate(_mm_mul_ps(_mm_mul_ps(r, r), a), lo, hi);
+            accumulate(_mm_mul_ps(_mm_mul_ps(g, g), a), lo, hi);
+            accumulate(_mm_mul_ps(_mm_mul_ps(b, b), a), lo, hi);
+        }
+        sum = horizontalSum(lo, hi);
+#endif
+
+        for (; i < end; i++) {
+            float r = r0[i] - r1[i];
+            float g = g0[i] - g1[i];
+            float b = b0[i] - b1[i];
+
+            float a = 1;
+            if (alphaWeight) a = a0[i] * a0[i]; // @@ a0*a1 or a0*a0 ?
+
+            sum += (r * r) * a;
+            sum += (g * g) * a;
+            sum += (b * b) * a;
+        }
+        return sum;
+    });
 
     return float(sqrt(mse / count));
 }
@@ -54,18 +130,84 @@ float nv::rmsAlphaError(const FloatImage * ref, const FloatImage * img)
     }
     nvDebugCheck(img->componentCount() == 4 && ref->componentCount() == 4);
 
-    double mse = 0;
+    const float * a0 = img->channel(3);
+    const float * a1 = ref->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
-    {
-        float a0 = img->pixel(i + count * 3);
-        float a1 = ref->pixel(i + count * 3);
+    const uint64 count = img->pixelCount();
+    double mse = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        uint64 i = begin;
+
+#if NV_USE_SSE > 1
+        __m128d lo = _mm_setzero_pd();
+        __m128d hi = _mm_setzero_pd();
+        for (; i + 4 <= end; i += 4) {
+            __m128 a = _mm_sub_ps(_mm_loadu_ps(a0 + i), _mm_loadu_ps(a1 + i));
+            accumulate(_mm_mul_ps(a, a), lo, hi);
+        }
+        sum = horizontalSum(lo, hi);
+#endif
+
+        for (; i < end; i++) {
+            float a = a0[i] - a1[i];
+            sum += a * a;
+        }
+        return sum;
+    });
 
-        float a = a0 - a1;
+    return float(sqrt(mse / count));
+}
 
-        mse += a * a;
+// Same as rmsColorError after scaling the colors of both images by 1/exposure and applying the Reindhart tone mapper
+// and the sRGB transfer function, without making copies of the images.
+float nv::rmsToneMappedError(const FloatImage * ref, const FloatImage * img, float exposure, bool alphaWeight)
+{
+    if (!sameLayout(img, ref)) {
+        return FLT_MAX;
     }
+    nvDebugCheck(img->componentCount() == 4);
+    nvDebugCheck(ref->componentCount() == 4);
+
+    const float scale = 1.0f / exposure;
+    const float * a0 = ref->channel(3);
+
+    const uint64 count = img->pixelCount();
+    double mse = parallelSum(count, [=](uint64 begin, uint64 end) {
+        const int blockSize = 256;
+        float c0[3][blockSize], c1[3][blockSize];
+        double sum = 0;
+
+        for (uint64 i = begin; i < end; i += blockSize) {
+            const int n = int(min<uint64>(end - i, blockSize));
+
+            for (uint c = 0; c < 3; c++) {
+                const float * src0 = ref->channel(c) + i;
+                const float * src1 = img->channel(c) + i;
+                for (int k = 0; k < n; k++) {
+                    float x0 = scale * src0[k] + 0.0f;
+                    float x1 = scale * src1[k] + 0.0f;
+                    c0[c][k] = x0 / (x0 + 1);
+                    c1[c][k] = x1 / (x1 + 1);
+                }
+                linear_to_srgb_array(c0[c], c0[c], n);
+                linear_to_srgb_array(c1[c], c1[c], n);
+            }
+
+            for (int k = 0; k < n; k++) {
+                float r = c0[0][k] - c1[0][k];
+                float g = c0[1][k] - c1[1][k];
+                float b = c0[2][k] - c1[2][k];
+
+                float a = 1;
+                if (alphaWeight) a = a0[i + k] * a0[i + k];
+
+                sum += (r * r) * a;
+                sum += (g * g) * a;
+                sum += (b * b) * a;
+            }
+        }
+        return sum;
+    });
 
     return float(sqrt(mse / count));
 }
@@ -79,98 +221,203 @@ float nv::averageColorError(const FloatImage * ref, const FloatImage * img, bool
     nvDebugCheck(img->componentCount() == 4);
     nvDebugCheck(ref->componentCount() == 4);
 
-    double mae = 0;
+    const float * r0 = img->channel(0);
+    const float * g0 = img->channel(1);
+    const float * b0 = img->channel(2);
+    const float * r1 = ref->channel(0);
+    const float * g1 = ref->channel(1);
+    const float * b1 = ref->channel(2);
+    const float * a1 = ref->channel(3);
+
+    const uint64 count = img->pixelCount();
+    double mae = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        uint64 i = begin;
+
+#if NV_USE_SSE > 1
+        __m128d lo = _mm_setzero_pd();
+        __m128d hi = _mm_setzero_pd();
+        for (; i + 4 <= end; i += 4) {
+            __m128 r = absolute(_mm_sub_ps(_mm_loadu_ps(r0 + i), _mm_loadu_ps(r1 + i)));
+            __m128 g = absolute(_mm_sub_ps(_mm_loadu_ps(g0 + i), _mm_loadu_ps(g1 + i)));
+            __m128 b = absolute(_mm_sub_ps(_mm_loadu_ps(b0 + i), _mm_loadu_ps(b1 + i)));
+
+            __m128 a = alphaWeight ? _mm_loadu_ps(a1 + i) : _mm_set1_ps(1.0f);
+
+            accumulate(_mm_mul_ps(r, a), lo, hi);
+            accumulate(_mm_mul_ps(g, a), lo, hi);
+            accumulate(_mm_mul_ps(b, a), lo, hi);
+        }
+        sum = horizontalSum(lo, hi);
+#endif
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
-    {
-        float r0 = img->pixel(i + count * 0);
-        float g0 = img->pixel(i + count * 1);
-        float b0 = img->pixel(i + count * 2);
-        //float a0 = img->pixel(i + count * 3);
-        float r1 = ref->pixel(i + count * 0);
-        float g1 = ref->pixel(i + count * 1);
-        float b1 = ref->pixel(i + count * 2);
-        float a1 = ref->pixel(i + count * 3);
-
-        float r = fabsf(r0 - r1);
-        float g = fabsf(g0 - g1);
-        float b = fabsf(b0 - b1);
-
-        float a = 1;
-        if (alphaWeight) a = a1;
-
-        mae += r * a;
-        mae += g * a;
-        mae += b * a;
-    }
+        for (; i < end; i++) {
+            float r = fabsf(r0[i] - r1[i]);
+            float g = fabsf(g0[i] - g1[i]);
+            float b = fabsf(b0[i] - b1[i]);
+
+            float a = 1;
+            if (alphaWeight) a = a1[i];
+
+            sum += r * a;
+            sum += g * a;
+            sum += b * a;
+        }
+        return sum;
+    });
 
     return float(mae / count);
 }
 
 float nv::averageAlphaError(const FloatImage * ref, const FloatImage * img)
 {
-    if (img == NULL || ref == NULL || img->width() != ref->width() || img->height() != ref->height()) {
+    if (!sameLayout(img, ref)) {
         return FLT_MAX;
     }
     nvDebugCheck(img->componentCount() == 4 && ref->componentCount() == 4);
 
-    double mae = 0;
+    const float * a0 = img->channel(3);
+    const float * a1 = ref->channel(3);
 
-    const uint count = img->width() * img->height();
-    for (uint i = 0; i < count; i++)
-    {
-        float a0 = img->pixel(i + count * 3);
-        float a1 = ref->pixel(i + count * 3);
+    const uint64 count = img->pixelCount();
+    double mae = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        uint64 i = begin;
 
-        float a = a0 - a1;
+#if NV_USE_SSE > 1
+        __m128d lo = _mm_setzero_pd();
+        __m128d hi = _mm_setzero_pd();
+        for (; i + 4 <= end; i += 4) {
+            accumulate(absolute(_mm_sub_ps(_mm_loadu_ps(a0 + i), _mm_loadu_ps(a1 + i))), lo, hi);
+        }
+        sum = horizontalSum(lo, hi);
+#endif
 
-        mae += fabsf(a);
-    }
+        for (; i < end; i++) {
+            sum += fabsf(a0[i] - a1[i]);
+        }
+        return sum;
+    });
 
     return float(mae / count);
 }
 
 
+namespace
+{
+    // FloatImage::sampleLinear is separable, the indices and weight of each axis only depend on that coordinate.
+    struct LinearTap {
+        int i0, i1;
+        float frac;
+    };
+
+    // Taps of sampleLinear at the coordinates float(i) / dstSize of an image axis with srcSize texels.
+    static void computeLinearTaps(uint dstSize, uint srcSize, FloatImage::WrapMode wm, Array<LinearTap> & taps)
+    {
+        const int w = srcSize;
+        taps.resize(dstSize);
+
+        for (uint i = 0; i < dstSize; i++) {
+            const float f = float(i) / dstSize;
+            LinearTap & tap = taps[i];
+
+            if (wm == FloatImage::WrapMode_Clamp) {
+                const float x = f * w;
+                tap.frac = frac(x);
+                tap.i0 = nv::clamp(ifloor(x), 0, w-1);
+                tap.i1 = nv::clamp(ifloor(x)+1, 0, w-1);
+            }
+            else if (wm == FloatImage::WrapMode_Repeat) {
+                tap.frac = frac(f * w);
+                tap.i0 = ifloor(frac(f) * w);
+                tap.i1 = ifloor(frac(f + 1.0f/w) * w);
+            }
+            else {
+                const float x = f * w;
+                tap.frac = frac(x);
+                tap.i0 = wrapMirror(iround(x), w);
+                tap.i1 = wrapMirror(iround(x) + 1, w);
+            }
+        }
+    }
+}
+
+// Compares ref against img upsampled with sampleLinear. The upsampled texels are computed on the fly, one row at a time,
+// with the same operations as FloatImage::trilerp.
 float nv::rmsBilinearColorError(const FloatImage * ref, const FloatImage * img, FloatImage::WrapMode wm, bool alphaWeight)
 {
     nvDebugCheck(img->componentCount() == 4);
     nvDebugCheck(ref->componentCount() == 4);
 
-    double mse = 0;
-
     const uint w0 = ref->width();
     const uint h0 = ref->height();
     const uint d0 = ref->depth();
 
     const uint w1 = img->width();
     const uint h1 = img->height();
-    const uint d1 = img->depth();
 
-    for (uint z = 0; z < d0; z++) {
-        for (uint y = 0; y < h0; y++) {
+    Array<LinearTap> xTaps, yTaps, zTaps;
+    computeLinearTaps(w0, w1, wm, xTaps);
+    computeLinearTaps(h0, h1, wm, yTaps);
+    computeLinearTaps(d0, img->depth(), wm, zTaps);
+
+    const uint rowCount = h0 * d0;
+    const uint chunkRows = max(1U, s_chunkSize / w0);
+
+    Array<double> partials;
+    partials.resize((rowCount + chunkRows - 1) / chunkRows, 0.0);
+
+    const LinearTap * xt = xTaps.buffer();
+    const LinearTap * yt = yTaps.buffer();
+    const LinearTap * zt = zTaps.buffer();
+    double * partialBuffer = partials.buffer();
+
+    parallel_for_range(rowCount, chunkRows, [=](uint64 begin, uint64 end) {
+        double mse = 0;
+
+        for (uint row = uint(begin); row < end; row++) {
+            const uint y = row % h0;
+            const uint z = row / h0;
+            const LinearTap & ty = yt[y];
+            const LinearTap & tz = zt[z];
+
+            const float * r0 = ref->channel(0) + uint64(row) * w0;
+            const float * g0 = ref->channel(1) + uint64(row) * w0;
+            const float * b0 = ref->channel(2) + uint64(row) * w0;
+            const float * a0 = ref->channel(3) + uint64(row) * w0;
+
+            // Rows of img around the sample, indexed as [y][z].
+            const float * s[4][2][2];
+            for (uint c = 0; c < 4; c++) {
+                s[c][0][0] = img->channel(c) + img->index(0, uint(ty.i0), uint(tz.i0));
+                s[c][1][0] = img->channel(c) + img->index(0, uint(ty.i1), uint(tz.i0));
+                s[c][0][1] = img->channel(c) + img->index(0, uint(ty.i0), uint(tz.i1));
+                s[c][1][1] = img->channel(c) + img->index(0, uint(ty.i1), uint(tz.i1));
+            }
+
             for (uint x = 0; x < w0; x++) {
-                float r0 = ref->pixel(0, x, y, z);
-                float g0 = ref->pixel(1, x, y, z);
-                float b0 = ref->pixel(2, x, y, z);
-                float a0 = ref->pixel(3, x, y, z);
+                const LinearTap & tx = xt[x];
+
+                float sample[4];
+                for (uint c = 0; c < 4; c++) {
+                    float i1 = lerp(s[c][0][0][tx.i0], s[c][0][1][tx.i0], tz.frac);
+                    float i2 = lerp(s[c][1][0][tx.i0], s[c][1][1][tx.i0], tz.frac);
+                    float j1 = lerp(s[c][0][0][tx.i1], s[c][0][1][tx.i1], tz.frac);
+                    float j2 = lerp(s[c][1][0][tx.i1], s[c][1][1][tx.i1], tz.frac);
 
-                float fx = float(x) / w0;
-                float fy = float(y) / h0;
-                float fz = float(z) / d0;
+                    float u1 = lerp(i1, i2, ty.frac);
+                    float u2 = lerp(j1, j2, ty.frac);
 
-                float r1 = img->sampleLinear(0, fx, fy, fz, wm);
-                float g1 = img->sampleLinear(1, fx, fy, fz, wm);
-                float b1 = img->sampleLinear(2, fx, fy, fz, wm);
-                float a1 = img->sampleLinear(2, fx, fy, fz, wm);
+                    sample[c] = lerp(u1, u2, tx.frac);
+                }
 
-                float dr = r0 - r1;
-                float dg = g0 - g1;
-                float db = b0 - b1;
-                float da = a0 - a1;
+                float dr = r0[x] - sample[0];
+                float dg = g0[x] - sample[1];
+                float db = b0[x] - sample[2];
+                float da = a0[x] - sample[3];
 
                 float w = 1;
-                if (alphaWeight) w = a0 * a0; // @@ a0*a1 or a0*a0 ?
+                if (alphaWeight) w = a0[x] * a0[x]; // @@ a0*a1 or a0*a0 ?
 
                 mse += (dr * dr) * w;
                 mse += (dg * dg) * w;
@@ -178,9 +425,14 @@ float nv::rmsBilinearColorError(const FloatImage * ref, const FloatImage * img,
                 mse += (da * da);
             }
         }
-    }
 
-    int count = w0 * h0 * d0;
+        partialBuffer[begin / chunkRows] = mse;
+    });
+
+    double mse = 0;
+    for (uint i = 0; i < partials.count(); i++) mse += partials[i];
+
+    const uint64 count = uint64(w0) * h0 * d0;
     return float(sqrt(mse / count));
 }
 
@@ -283,15 +535,55 @@ static Vector3 cieLabToLCh(Vector3::Arg c)
     return Vector3(c.x, sqrtf(c.y*c.y + c.z*c.z), atan2f(c.y, c.z));
 }
 
+// Number of texels converted at once by rgbToCieLab.
+static const int s_labBlockSize = 256;
+
+// Same as rgbToCieLab above for a block of texels. The powers are evaluated with the vectorized nvmath functions.
+static void rgbToCieLab(const float * R, const float * G, const float * B, float * L, float * a, float * b, int count)
+{
+    nvDebugCheck(count <= s_labBlockSize);
+
+    // Normalized white point.
+    const float Xn = 0.950456f;
+    const float Yn = 1.0f;
+    const float Zn = 1.088754f;
+
+    const float epsilon = powf(6.0f/29.0f, 3);
+    const float slope = 1.0f/3.0f * powf(29.0f/6.0f, 2);
+
+    float X[s_labBlockSize], Y[s_labBlockSize], Z[s_labBlockSize];
+    pow_array(R, X, count, 2.2f);
+    pow_array(G, Y, count, 2.2f);
+    pow_array(B, Z, count, 2.2f);
+
+    for (int i = 0; i < count; i++) {
+        Vector3 xyz = rgbToXyz(Vector3(X[i], Y[i], Z[i]));
+        X[i] = xyz.x / Xn;
+        Y[i] = xyz.y / Yn;
+        Z[i] = xyz.z / Zn;
+    }
+
+    pow_array(X, L, count, 1.0f/3.0f);
+    pow_array(Y, a, count, 1.0f/3.0f);
+    pow_array(Z, b, count, 1.0f/3.0f);
+
+    for (int i = 0; i < count; i++) {
+        float fx = (X[i] > epsilon) ? L[i] : slope * X[i] + 4.0f / 29.0f;
+        float fy = (Y[i] > epsilon) ? a[i] : slope * Y[i] + 4.0f / 29.0f;
+        float fz = (Z[i] > epsilon) ? b[i] : slope * Z[i] + 4.0f / 29.0f;
+
+        L[i] = 116 * fx - 16;
+        a[i] = 500 * (fx - fy);
+        b[i] = 200 * (fy - fz);
+    }
+}
+
 static void rgbToCieLab(const FloatImage * rgbImage, FloatImage * LabImage)
 {
     nvDebugCheck(rgbImage != NULL && LabImage != NULL);
-    nvDebugCheck(rgbImage->width() == LabImage->width() && rgbImage->height() == LabImage->height());
+    nvDebugCheck(rgbImage->pixelCount() == LabImage->pixelCount());
     nvDebugCheck(rgbImage->componentCount() >= 3 && LabImage->componentCount() >= 3);
 
-    const uint w = rgbImage->width();
-    const uint h = LabImage->height();
-
     const float * R = rgbImage->channel(0);
     const float * G = rgbImage->channel(1);
     const float * B = rgbImage->channel(2);
@@ -300,14 +592,9 @@ static void rgbToCieLab(const FloatImage * rgbImage, FloatImage * LabImage)
     float * a = LabImage->channel(1);
     float * b = LabImage->channel(2);
 
-    const uint count = w*h;
-    for (uint i = 0; i < count; i++)
-    {
-        Vector3 Lab = rgbToCieLab(Vector3(R[i], G[i], B[i]));
-        L[i] = Lab.x;
-        a[i] = Lab.y;
-        b[i] = Lab.z;
-    }
+    parallel_for_range(rgbImage->pixelCount(), s_labBlockSize, [=](uint64 begin, uint64 end) {
+        rgbToCieLab(R + begin, G + begin, B + begin, L + begin, a + begin, b + begin, int(end - begin));
+    });
 }
 
 
@@ -325,19 +612,27 @@ float nv::cieLabError(const FloatImage * img0, const FloatImage * img1)
     const float * g1 = img1->channel(1);
     const float * b1 = img1->channel(2);
 
-    double error = 0.0f;
+    const uint64 count = img0->pixelCount();
+    double error = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
 
-    const uint count = img0->pixelCount();
-    for (uint i = 0; i < count; i++)
-    {
-        Vector3 lab0 = rgbToCieLab(Vector3(r0[i], g0[i], b0[i]));
-        Vector3 lab1 = rgbToCieLab(Vector3(r1[i], g1[i], b1[i]));
+        for (uint64 i = begin; i < end; i += s_labBlockSize) {
+            const int n = int(min<uint64>(end - i, s_labBlockSize));
 
-        // @@ Measure Delta E.
-        Vector3 delta = lab0 - lab1;
-        
-        error += length(delta);
-    }
+            float lab0[3][s_labBlockSize], lab1[3][s_labBlockSize];
+            rgbToCieLab(r0 + i, g0 + i, b0 + i, lab0[0], lab0[1], lab0[2], n);
+            rgbToCieLab(r1 + i, g1 + i, b1 + i, lab1[0], lab1[1], lab1[2], n);
+
+            // @@ Measure Delta E.
+            for (int k = 0; k < n; k++) {
+                float dL = lab0[0][k] - lab1[0][k];
+                float da = lab0[1][k] - lab1[1][k];
+                float db = lab0[2][k] - lab1[2][k];
+                sum += sqrtf(dL * dL + da * da + db * db);
+            }
+        }
+        return sum;
+    });
 
     return float(error / count);
 }
@@ -366,8 +661,8 @@ float nv::cieLab94Error(const FloatImage * img0, const FloatImage * img1)
 
     double error = 0.0f;
 
-    const uint count = img0->pixelCount();
-    for (uint i = 0; i < count; ++i)
+    const uint64 count = img0->pixelCount();
+    for (uint64 i = 0; i < count; ++i)
     {
         Vector3 lab0 = rgbToCieLab(Vector3(r0[i], g0[i], b0[i]));
         Vector3 lch0 = cieLabToLCh(lab0);
@@ -433,81 +728,275 @@ float nv::spatialCieLabError(const FloatImage * img0, const FloatImage * img1)
 }
 
 
-// Assumes input images are normal maps.
-float nv::averageAngularError(const FloatImage * img0, const FloatImage * img1)
+namespace
 {
-    if (img0 == NULL || img1 == NULL || img0->width() != img1->width() || img0->height() != img1->height()) {
-        return FLT_MAX;
-    }
-    nvDebugCheck(img0->componentCount() == 4 && img1->componentCount() == 4);
+    // Angle between the normals encoded in texel i of both images.
+    struct NormalAngle {
+        const float * x0, * y0, * z0;
+        const float * x1, * y1, * z1;
 
-    uint w = img0->width();
-    uint h = img0->height();
+        NormalAngle(const FloatImage * img0, const FloatImage * img1) :
+            x0(img0->channel(0)), y0(img0->channel(1)), z0(img0->channel(2)),
+            x1(img1->channel(0)), y1(img1->channel(1)), z1(img1->channel(2)) {}
 
-    const float * x0 = img0->channel(0);
-    const float * y0 = img0->channel(1);
-    const float * z0 = img0->channel(2);
+        float operator()(uint64 i) const {
+            Vector3 n0 = Vector3(x0[i], y0[i], z0[i]);
+            Vector3 n1 = Vector3(x1[i], y1[i], z1[i]);
 
-    const float * x1 = img1->channel(0);
-    const float * y1 = img1->channel(1);
-    const float * z1 = img1->channel(2);
+            n0 = 2.0f * n0 - Vector3(1);
+            n1 = 2.0f * n1 - Vector3(1);
 
-    double error = 0.0f;
+            n0 = normalizeSafe(n0, Vector3(0), 0.0f);
+            n1 = normalizeSafe(n1, Vector3(0), 0.0f);
 
-    const uint count = w*h;
-    for (uint i = 0; i < count; i++)
-    {
-        Vector3 n0 = Vector3(x0[i], y0[i], z0[i]);
-        Vector3 n1 = Vector3(x1[i], y1[i], z1[i]);
+            return acosf(clamp(dot(n0, n1), -1.0f, 1.0f));
+        }
+    };
+}
 
-        n0 = 2.0f * n0 - Vector3(1);
-        n1 = 2.0f * n1 - Vector3(1);
+// Assumes input images are normal maps.
+float nv::averageAngularError(const FloatImage * img0, const FloatImage * img1)
+{
+    if (!sameLayout(img0, img1)) {
+        return FLT_MAX;
+    }
+    nvDebugCheck(img0->componentCount() == 4 && img1->componentCount() == 4);
 
-        n0 = normalizeSafe(n0, Vector3(0), 0.0f);
-        n1 = normalizeSafe(n1, Vector3(0), 0.0f);
+    const NormalAngle angle(img0, img1);
 
-        error += acos(clamp(dot(n0, n1), -1.0f, 1.0f));
-    }
+    const uint64 count = img0->pixelCount();
+    double error = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        for (uint64 i = begin; i < end; i++) {
+            sum += angle(i);
+        }
+        return sum;
+    });
 
     return float(error / count);
 }
 
 float nv::rmsAngularError(const FloatImage * img0, const FloatImage * img1)
 {
-    if (img0 == NULL || img1 == NULL || img0->width() != img1->width() || img0->height() != img1->height()) {
+    if (!sameLayout(img0, img1)) {
         return FLT_MAX;
     }
     nvDebugCheck(img0->componentCount() == 4 && img1->componentCount() == 4);
 
-    uint w = img0->width();
-    uint h = img0->height();
+    const NormalAngle angle(img0, img1);
 
-    const float * x0 = img0->channel(0);
-    const float * y0 = img0->channel(1);
-    const float * z0 = img0->channel(2);
+    const uint64 count = img0->pixelCount();
+    double error = parallelSum(count, [=](uint64 begin, uint64 end) {
+        double sum = 0;
+        for (uint64 i = begin; i < end; i++) {
+            float a = angle(i);
+            sum += a * a;
+        }
+        return sum;
+    });
 
-    const float * x1 = img1->channel(0);
-    const float * y1 = img1->channel(1);
-    const float * z1 = img1->channel(2);
+    return float(sqrt(error / count));
+}
 
-    double error = 0.0f;
 
-    const uint count = w*h;
-    for (uint i = 0; i < count; i++)
+namespace
+{
+    // Mean luminance and contrast-structure terms of SSIM over a set of windows.
+    struct SsimSums {
+        double ssim;
+        double cs;
+    };
+
+    // SSIM of two w*h planes, evaluated with box windows of windowSize*windowSize texels at every position where they fit
+    // in the plane. Each task slides the window down a band of rows: the sums of the rows in the window are updated one
+    // row at a time for every column, and the window sums are differences of their prefix sums along the row. The cost
+    // does not depend on windowSize, and each task only needs a few rows of sums.
+    static SsimSums planeSsim(const float * p0, const float * p1, uint w, uint h, uint windowSize)
     {
-        Vector3 n0 = Vector3(x0[i], y0[i], z0[i]);
-        Vector3 n1 = Vector3(x1[i], y1[i], z1[i]);
+        // Stabilizing constants for a dynamic range of 1.
+        const double C1 = 0.01 * 0.01;
+        const double C2 = 0.03 * 0.03;
+
+        const uint n = windowSize;
+        const double invArea = 1.0 / (double(n) * n);
+        const uint columns = w - n + 1;
+        const uint rows = h - n + 1;
+
+        // Bands are at least as tall as the window, so that filling the first window doesn't dominate the cost.
+        const uint chunkRows = max(n, max(1U, s_chunkSize / columns));
+
+        Array<SsimSums> partials;
+        partials.resize((rows + chunkRows - 1) / chunkRows);
+        SsimSums * partialBuffer = partials.buffer();
+
+        parallel_for_range(rows, chunkRows, [=](uint64 begin, uint64 end) {
+            // Sums of x, y, x^2, y^2 and x*y, interleaved. The prefix sums have an extra column of zeros.
+            Array<double> buffer;
+            buffer.resize(5 * w + 5 * (w + 1), 0.0);
+            double * column = buffer.buffer();
+            double * prefix = column + 5 * w;
+
+            auto addRow = [=](uint y, double sign) {
+                const float * r0 = p0 + uint64(y) * w;
+                const float * r1 = p1 + uint64(y) * w;
+                for (uint x = 0; x < w; x++) {
+                    const double a = r0[x];
+                    const double b = r1[x];
+                    double * c = column + 5 * x;
+                    c[0] += sign * a;
+                    c[1] += sign * b;
+                    c[2] += sign * a * a;
+                    c[3] += sign * b * b;
+                    c[4] += sign * a * b;
+                }
+            };
+
+            for (uint y = uint(begin); y < uint(begin) + n; y++) addRow(y, 1.0);
+
+            SsimSums sums = { 0, 0 };
+
+            for (uint y = uint(begin); y < end; y++) {
+                if (y != begin) {
+                    addRow(y - 1, -1.0);
+                    addRow(y + n - 1, 1.0);
+                }
+
+                for (uint i = 0; i < 5 * w; i++) prefix[i + 5] = prefix[i] + column[i];
+
+                for (uint x = 0; x < columns; x++) {
+                    const double * s0 = prefix + 5 * x;
+                    const double * s1 = prefix + 5 * (x + n);
+
+                    const double mu0 = (s1[0] - s0[0]) * invArea;
+                    const double mu1 = (s1[1] - s0[1]) * invArea;
+                    const double var0 = (s1[2] - s0[2]) * invArea - mu0 * mu0;
+                    const double var1 = (s1[3] - s0[3]) * invArea - mu1 * mu1;
+                    const double cov = (s1[4] - s0[4]) * invArea - mu0 * mu1;
+
+                    const double l = (2 * mu0 * mu1 + C1) / (mu0 * mu0 + mu1 * mu1 + C1);
+                    const double cs = (2 * cov + C2) / (var0 + var1 + C2);
+
+                    sums.ssim += l * cs;
+                    sums.cs += cs;
+                }
+            }
 
-        n0 = 2.0f * n0 - Vector3(1);
-        n1 = 2.0f * n1 - Vector3(1);
+            partialBuffer[begin / chunkRows] = sums;
+        });
 
-        n0 = normalizeSafe(n0, Vector3(0), 0.0f);
-        n1 = normalizeSafe(n1, Vector3(0), 0.0f);
+        SsimSums sums = { 0, 0 };
+        for (uint i = 0; i < partials.count(); i++) {
+            sums.ssim += partials[i].ssim;
+            sums.cs += partials[i].cs;
+        }
 
-        float angle = acosf(clamp(dot(n0, n1), -1.0f, 1.0f));
-        error += angle * angle;
+        const double windowCount = double(columns) * rows;
+        sums.ssim /= windowCount;
+        sums.cs /= windowCount;
+        return sums;
     }
 
-    return float(sqrt(error / count));
+    // Halves a w*h plane with a 2x2 box filter. The last row and column are dropped when the size is odd.
+    static void downSamplePlane(const float * src, uint w, uint h, Array<float> & dst)
+    {
+        const uint dw = w / 2;
+        const uint dh = h / 2;
+        nvCheck(uint64(dw) * dh <= NV_UINT32_MAX);
+        dst.resize(dw * dh);
+        float * d = dst.buffer();
+
+        parallel_for_range(dh, max(1U, s_chunkSize / max(1U, dw)), [=](uint64 begin, uint64 end) {
+            for (uint y = uint(begin); y < end; y++) {
+                const float * row0 = src + uint64(2 * y) * w;
+                const float * row1 = row0 + w;
+                for (uint x = 0; x < dw; x++) {
+                    d[uint64(y) * dw + x] = 0.25f * (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]);
+                }
+            }
+        });
+    }
 }
 
+// SSIM of the color channels, computed for each channel and depth slice and averaged.
+float nv::ssim(const FloatImage * ref, const FloatImage * img, uint windowSize)
+{
+    if (!sameLayout(img, ref) || img->pixelCount() == 0) {
+        return 0.0f;
+    }
+    nvDebugCheck(img->componentCount() == 4 && ref->componentCount() == 4);
+
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint d = img->depth();
+    windowSize = clamp(windowSize, 1U, min(w, h));
+
+    double sum = 0;
+    for (uint z = 0; z < d; z++) {
+        for (uint c = 0; c < 3; c++) {
+            const uint64 offset = uint64(z) * w * h;
+            sum += planeSsim(ref->channel(c) + offset, img->channel(c) + offset, w, h, windowSize).ssim;
+        }
+    }
+
+    return float(sum / (3 * d));
+}
+
+// Multi-scale SSIM with the scale weights of Wang et al. Scales at which the window does not fit are skipped and the
+// remaining weights renormalized.
+float nv::multiScaleSsim(const FloatImage * ref, const FloatImage * img, uint windowSize)
+{
+    if (!sameLayout(img, ref) || img->pixelCount() == 0) {
+        return 0.0f;
+    }
+    nvDebugCheck(img->componentCount() == 4 && ref->componentCount() == 4);
+
+    static const double weights[] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+    static const uint scaleCount = NV_ARRAY_SIZE(weights);
+
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint d = img->depth();
+    windowSize = clamp(windowSize, 1U, min(w, h));
+
+    // Number of scales at which the window fits.
+    uint levels = 1;
+    while (levels < scaleCount && min(w >> levels, h >> levels) >= windowSize) levels++;
+
+    double weightSum = 0;
+    for (uint s = 0; s < levels; s++) weightSum += weights[s];
+
+    double sum = 0;
+    for (uint z = 0; z < d; z++) {
+        for (uint c = 0; c < 3; c++) {
+            const uint64 offset = uint64(z) * w * h;
+            const float * p0 = ref->channel(c) + offset;
+            const float * p1 = img->channel(c) + offset;
+
+            Array<float> level0, level1;
+            uint lw = w, lh = h;
+            double product = 1;
+
+            for (uint s = 0; s < levels; s++) {
+                if (s > 0) {
+                    Array<float> next0, next1;
+                    downSamplePlane(p0, lw, lh, next0);
+                    downSamplePlane(p1, lw, lh, next1);
+                    swap(level0, next0);
+                    swap(level1, next1);
+                    p0 = level0.buffer();
+                    p1 = level1.buffer();
+                    lw /= 2;
+                    lh /= 2;
+                }
+
+                SsimSums sums = planeSsim(p0, p1, lw, lh, windowSize);
+                double term = (s + 1 == levels) ? sums.ssim : sums.cs;
+                product *= pow(max(term, 0.0), weights[s] / weightSum);
+            }
+
+            sum += product;
+        }
+    }
+
+    return float(sum / (3 * d));
+}
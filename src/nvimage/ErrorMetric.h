@@ -9,6 +9,7 @@ namespace nv
 
     float rmsColorError(const FloatImage * ref, const FloatImage * img, bool alphaWeight);
     float rmsAlphaError(const FloatImage * ref, const FloatImage * img);
+    float rmsToneMappedError(const FloatImage * ref, const FloatImage * img, float exposure, bool alphaWeight);
 
     float averageColorError(const FloatImage * ref, const FloatImage * img, bool alphaWeight);
     float averageAlphaError(const FloatImage * ref, const FloatImage * img);
@@ -22,4 +23,8 @@ namespace nv
     float averageAngularError(const FloatImage * img0, const FloatImage * img1);
     float rmsAngularError(const FloatImage * img0, const FloatImage * img1);
 
+    // Structural similarity of the color channels, 1 for identical images.
+    float ssim(const FloatImage * ref, const FloatImage * img, uint windowSize);
+    float multiScaleSsim(const FloatImage * ref, const FloatImage * img, uint windowSize);
+
 } // nv namespace
@@ -368,6 +368,40 @@ void Kernel2::normalize()
     }
 }
 
+// Factor the kernel into the outer product of a horizontal and a vertical 1D kernel, each of windowSize() values.
+// Returns false if the kernel is not separable within the given threshold, relative to its largest value.
+bool Kernel2::isSeparable(float * horizontal, float * vertical, float threshold/*= 1e-5f*/) const
+{
+    // Pivot on the largest value.
+    uint px = 0, py = 0;
+    float maxValue = 0.0f;
+    for (uint y = 0; y < m_windowSize; y++) {
+        for (uint x = 0; x < m_windowSize; x++) {
+            if (fabsf(valueAt(x, y)) > maxValue) {
+                maxValue = fabsf(valueAt(x, y));
+                px = x;
+                py = y;
+            }
+        }
+    }
+
+    const float pivot = valueAt(px, py);
+    for (uint i = 0; i < m_windowSize; i++) {
+        horizontal[i] = valueAt(i, py);
+        vertical[i] = (pivot != 0.0f) ? valueAt(px, i) / pivot : 0.0f;
+    }
+
+    for (uint y = 0; y < m_windowSize; y++) {
+        for (uint x = 0; x < m_windowSize; x++) {
+            if (fabsf(horizontal[x] * vertical[y] - valueAt(x, y)) > threshold * maxValue) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 // Transpose the kernel.
 void Kernel2::transpose()
 {
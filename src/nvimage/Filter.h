@@ -170,6 +170,8 @@ namespace nv
         void normalize();
         void transpose();
 
+        bool isSeparable(float * horizontal, float * vertical, float threshold = 1e-5f) const;
+
         float valueAt(uint x, uint y) const {
             return m_data[y * m_windowSize + x];
         }
@@ -16,30 +16,114 @@
 #include "nvcore/Ptr.h"
 #include "nvcore/Memory.h"
 #include "nvcore/Array.inl"
+#include "nvcore/StrLib.h" // Path
 
 #include <math.h>
+#include <float.h> // DBL_MAX
 #include <string.h> // memset, memcpy
 
 
 using namespace nv;
 
 
+static uint64 s_scratchFileThreshold = 0;
+static Path s_scratchDirectory;
+
+// Allocate in a scratch file if the image is large enough, fall back to the heap otherwise.
+static FloatImage::Block * allocateBlock(uint64 count)
+{
+    FloatImage::Block * block = new FloatImage::Block;
+    block->mem = NULL;
+    block->count = count;
+    block->refCount = 0;
+    block->mapped = false;
+    block->release = NULL;
+    block->context = NULL;
+
+    const uint64 size = count * sizeof(float);
+
+    if (s_scratchFileThreshold != 0 && size >= s_scratchFileThreshold) {
+        block->mem = (float *)mapped_malloc(size_t(size), s_scratchDirectory.isNull() ? NULL : s_scratchDirectory.str());
+        block->mapped = (block->mem != NULL);
+    }
+
+    // Pooled memory is recycled by the temporaries of resize and mipmap passes.
+    if (block->mem == NULL) {
+        block->mem = (float *)pool_malloc(size_t(size));
+    }
+
+    return block;
+}
+
+static FloatImage::Channel * createChannel(FloatImage::Block * block, float * data)
+{
+    FloatImage::Channel * channel = new FloatImage::Channel;
+    channel->data = data;
+    channel->block = block;
+    channel->refCount = 1;
+
+    block->refCount++;
+
+    return channel;
+}
+
+static void releaseChannel(FloatImage::Channel * channel)
+{
+    if (--channel->refCount != 0) return;
+
+    FloatImage::Block * block = channel->block;
+    delete channel;
+
+    if (--block->refCount != 0) return;
+
+    if (block->release != NULL) block->release(block->context);
+    else if (block->mapped) mapped_free(block->mem, size_t(block->count * sizeof(float)));
+    else pool_free(block->mem);
+
+    delete block;
+}
+
+// Shared channels and wrapped memory must be copied before modifying them.
+static bool isWritable(const FloatImage::Channel * channel)
+{
+    return channel->refCount == 1 && channel->block->release == NULL;
+}
+
+// Replace the given channels by copies stored one after another in a new block.
+static void copyChannels(FloatImage::Channel ** channels, const Array<uint> & indices, uint64 pixelCount)
+{
+    FloatImage::Block * block = allocateBlock(indices.count() * pixelCount);
+
+    for (uint i = 0; i < indices.count(); i++) {
+        FloatImage::Channel *& channel = channels[indices[i]];
+
+        float * data = block->mem + i * pixelCount;
+        memcpy(data, channel->data, size_t(pixelCount * sizeof(float)));
+
+        releaseChannel(channel);
+        channel = createChannel(block, data);
+    }
+}
+
+
 /// Ctor.
 FloatImage::FloatImage() : m_componentCount(0), m_width(0), m_height(0), m_depth(0),
-  m_pixelCount(0), m_floatCount(0), m_mem(NULL)
+  m_pixelCount(0), m_floatCount(0), m_channel(NULL)
 {
 }
 
 FloatImage::FloatImage(const FloatImage & img) : m_componentCount(0), m_width(0), m_height(0), m_depth(0),
-    m_pixelCount(0), m_floatCount(0), m_mem(NULL)
+    m_pixelCount(0), m_floatCount(0), m_channel(NULL)
 {
     allocate(img.m_componentCount, img.m_width, img.m_height, img.m_depth);
-    memcpy(m_mem, img.m_mem, m_floatCount * sizeof(float));
+    for (uint c = 0; c < m_componentCount; c++) {
+        memcpy(channel(c), img.channel(c), size_t(m_pixelCount * sizeof(float)));
+    }
 }
 
 /// Ctor. Init from image.
 FloatImage::FloatImage(const Image * img) : m_componentCount(0), m_width(0), m_height(0), m_depth(0),
-    m_pixelCount(0), m_floatCount(0), m_mem(NULL)
+    m_pixelCount(0), m_floatCount(0), m_channel(NULL)
 {
     initFrom(img);
 }
@@ -67,8 +151,8 @@ void FloatImage::initFrom(const Image * img)
 
     float scale = 1.0f / 255.0f;
 
-    const uint count = m_pixelCount;
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = m_pixelCount;
+    for (uint64 i = 0; i < count; i++) {
     //parallel_for(count, 128, [&](int i) {
         Color32 pixel = img->pixel(i);
         red_channel[i] = float(pixel.r) * scale;
@@ -87,7 +171,7 @@ Image * FloatImage::createImage(uint baseComponent/*= 0*/, uint num/*= 4*/) cons
     AutoPtr<Image> img(new Image());
     img->allocate(m_width, m_height, m_depth);
 
-    for (uint i = 0; i < m_pixelCount; i++) {
+    for (uint64 i = 0; i < m_pixelCount; i++) {
 
         uint c;
         uint8 rgba[4]= {0, 0, 0, 0xff};
@@ -117,8 +201,8 @@ Image * FloatImage::createImageGammaCorrect(float gamma/*= 2.2f*/) const
     const float * bChannel = this->channel(2);
     const float * aChannel = this->channel(3);
 
-    const uint count = m_pixelCount;
-    for (uint i = 0; i < count; i++)
+    const uint64 count = m_pixelCount;
+    for (uint64 i = 0; i < count; i++)
     {
         const uint8 r = nv::clamp(int(255.0f * pow(rChannel[i], 1.0f/gamma)), 0, 255);
         const uint8 g = nv::clamp(int(255.0f * pow(gChannel[i], 1.0f/gamma)), 0, 255);
@@ -134,46 +218,168 @@ Image * FloatImage::createImageGammaCorrect(float gamma/*= 2.2f*/) const
 /// Allocate a 2D float image of the given format and the given extents.
 void FloatImage::allocate(uint c, uint w, uint h, uint d)
 {
-    if (m_componentCount != c || m_width != w || m_height != h || m_depth != d)
+    if (m_channel == NULL || m_componentCount != c || m_width != w || m_height != h || m_depth != d || !isWritable())
     {
-        free();
+        setHeader(c, w, h, d);
 
-        m_width = w;
-        m_height = h;
-        m_depth = d;
-        m_componentCount = c;
-        m_pixelCount = w * h * d;
-        m_floatCount = m_pixelCount * c;
-        m_mem = malloc<float>(m_floatCount);
+        Block * block = allocateBlock(m_floatCount);
+
+        m_channel = malloc<Channel *>(c);
+        for (uint i = 0; i < c; i++) {
+            m_channel[i] = createChannel(block, block->mem + i * m_pixelCount);
+        }
     }
 }
 
+/// Free the image and set the members for the given extents.
+void FloatImage::setHeader(uint c, uint w, uint h, uint d)
+{
+    free();
+
+    m_width = w;
+    m_height = h;
+    m_depth = d;
+    m_componentCount = c;
+    m_pixelCount = uint64(w) * h * d;
+    m_floatCount = m_pixelCount * c;
+}
+
 /// Free the image, but don't clear the members.
 void FloatImage::free()
 {
-    ::free(m_mem);
-    m_mem = NULL;
+    if (m_channel != NULL) {
+        for (uint i = 0; i < m_componentCount; i++) {
+            releaseChannel(m_channel[i]);
+        }
+        ::free(m_channel);
+        m_channel = NULL;
+    }
 }
 
 void FloatImage::resizeChannelCount(uint c)
 {
-    if (m_componentCount != c) {
-        uint count = m_pixelCount * c;
-        m_mem = realloc<float>(m_mem, count);
+    if (m_channel == NULL) {
+        setHeader(c, m_width, m_height, m_depth);
+    }
+    else if (m_componentCount != c) {
+        // Keep the existing channels, new channels are zeroed and stored in a block of their own.
+        Channel ** channels = malloc<Channel *>(c);
+        const uint keep = min(c, m_componentCount);
+        for (uint i = 0; i < keep; i++) {
+            channels[i] = m_channel[i];
+        }
+        for (uint i = keep; i < m_componentCount; i++) {
+            releaseChannel(m_channel[i]);
+        }
+
+        if (c > keep) {
+            Block * block = allocateBlock(m_pixelCount * (c - keep));
+            memset(block->mem, 0, size_t(block->count * sizeof(float)));
 
-        if (c > m_componentCount) {
-            memset(m_mem + m_floatCount, 0, (count - m_floatCount) * sizeof(float));
+            for (uint i = keep; i < c; i++) {
+                channels[i] = createChannel(block, block->mem + (i - keep) * m_pixelCount);
+            }
         }
 
+        ::free(m_channel);
+
+        m_channel = channels;
         m_componentCount = c;
-        m_floatCount = count;
+        m_floatCount = m_pixelCount * c;
+    }
+}
+
+/// Reference the given channels without copying them.
+bool FloatImage::wrap(uint c, uint w, uint h, uint d, const float * const * channels, ReleaseFunction * release/*= NULL*/, void * context/*= NULL*/)
+{
+    if (c == 0 || w == 0 || h == 0 || d == 0) return false;
+    for (uint i = 0; i < c; i++) {
+        if (channels[i] == NULL) return false;
+    }
+
+    setHeader(c, w, h, d);
+
+    Block * block = new Block;
+    block->mem = NULL;
+    block->count = 0;
+    block->refCount = 0;
+    block->mapped = false;
+    block->release = release;
+    block->context = context;
+
+    // Wrapped blocks are never written, so they need a release function even if there's nothing to free.
+    if (block->release == NULL) block->release = [](void *) {};
+
+    m_channel = malloc<Channel *>(c);
+    for (uint i = 0; i < c; i++) {
+        m_channel[i] = createChannel(block, (float *)channels[i]);
+    }
+
+    return true;
+}
+
+/// Copy shared and wrapped channels, so that all of them can be modified.
+void FloatImage::detach()
+{
+    detach(0, m_componentCount);
+}
+
+/// Copy the given channels if they are shared or wrapped.
+void FloatImage::detach(uint baseComponent, uint num)
+{
+    if (m_channel == NULL) return;
+    nvDebugCheck(baseComponent + num <= m_componentCount);
+
+    Array<uint> indices;
+    for (uint i = baseComponent; i < baseComponent + num; i++) {
+        if (!::isWritable(m_channel[i])) indices.append(i);
+    }
+
+    if (indices.count() != 0) {
+        copyChannels(m_channel, indices, m_pixelCount);
+    }
+}
+
+bool FloatImage::isWritable() const
+{
+    for (uint i = 0; i < m_componentCount; i++) {
+        if (!::isWritable(m_channel[i])) return false;
+    }
+    return true;
+}
+
+bool FloatImage::isContiguous() const
+{
+    for (uint i = 1; i < m_componentCount; i++) {
+        if (m_channel[i]->data != m_channel[0]->data + i * m_pixelCount) return false;
+    }
+    return true;
+}
+
+/// Copy the channels to a single block, if they are not already.
+void FloatImage::makeContiguous()
+{
+    if (m_channel == NULL || isContiguous()) return;
+
+    Array<uint> indices;
+    for (uint i = 0; i < m_componentCount; i++) {
+        indices.append(i);
     }
+
+    copyChannels(m_channel, indices, m_pixelCount);
+}
+
+/*static*/ void FloatImage::setScratchFileThreshold(uint64 byteCount, const char * directory/*= NULL*/)
+{
+    s_scratchFileThreshold = byteCount;
+    if (directory != NULL) s_scratchDirectory = directory;
+    else s_scratchDirectory.reset();
 }
 
 void FloatImage::clear(float f/*=0.0f*/)
 {
-    for (uint i = 0; i < m_floatCount; i++) {
-        m_mem[i] = f;
+    for (uint c = 0; c < m_componentCount; c++) {
+        clear(c, f);
     }
 }
 
@@ -181,8 +387,8 @@ void FloatImage::clear(uint c, float f/*= 0.0f*/)
 {
     float * channel = this->channel(c);
 
-    const uint count = m_pixelCount;
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = m_pixelCount;
+    for (uint64 i = 0; i < count; i++) {
         channel[i] = f;
     }
 }
@@ -206,8 +412,8 @@ void FloatImage::normalize(uint baseComponent)
     float * yChannel = this->channel(baseComponent + 1);
     float * zChannel = this->channel(baseComponent + 2);
 
-    const uint count = m_pixelCount;
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = m_pixelCount;
+    for (uint64 i = 0; i < count; i++) {
 
         Vector3 normal(xChannel[i], yChannel[i], zChannel[i]);
         normal = normalizeSafe(normal, Vector3(0), 0.0f);
@@ -230,12 +436,12 @@ void FloatImage::expandNormals(uint baseComponent)
 
 void FloatImage::scaleBias(uint baseComponent, uint num, float scale, float bias)
 {
-    const uint size = m_pixelCount;
+    const uint64 size = m_pixelCount;
 
     for (uint c = 0; c < num; c++) {
         float * ptr = this->channel(baseComponent + c);
 
-        for (uint i = 0; i < size; i++) {
+        for (uint64 i = 0; i < size; i++) {
             ptr[i] = scale * ptr[i] + bias;
         }
     }
@@ -244,12 +450,12 @@ void FloatImage::scaleBias(uint baseComponent, uint num, float scale, float bias
 /// Clamp the elements of the image.
 void FloatImage::clamp(uint baseComponent, uint num, float low, float high)
 {
-    const uint size = m_pixelCount;
+    const uint64 size = m_pixelCount;
 
     for (uint c = 0; c < num; c++) {
         float * ptr = this->channel(baseComponent + c);
 
-        for (uint i = 0; i < size; i++) {
+        for (uint64 i = 0; i < size; i++) {
             ptr[i] = nv::clamp(ptr[i], low, high);
         }
     }
@@ -262,7 +468,9 @@ void FloatImage::toLinear(uint baseComponent, uint num, float gamma /*= 2.2f*/)
         for (uint c = 0; c < num; c++) {
             float * ptr = this->channel(baseComponent + c);
 
-            powf_11_5(ptr, ptr, m_pixelCount);
+            parallel_for_range(m_pixelCount, 16 * 1024, [=](uint64 begin, uint64 end) {
+                powf_11_5(ptr + begin, ptr + begin, int(end - begin));
+            });
         }
     } else {
         exponentiate(baseComponent, num, gamma);
@@ -276,7 +484,9 @@ void FloatImage::toGamma(uint baseComponent, uint num, float gamma /*= 2.2f*/)
         for (uint c = 0; c < num; c++) {
             float * ptr = this->channel(baseComponent + c);
 
-            powf_5_11(ptr, ptr, m_pixelCount);
+            parallel_for_range(m_pixelCount, 16 * 1024, [=](uint64 begin, uint64 end) {
+                powf_5_11(ptr + begin, ptr + begin, int(end - begin));
+            });
         }
     } else {
         exponentiate(baseComponent, num, 1.0f/gamma);
@@ -286,14 +496,12 @@ void FloatImage::toGamma(uint baseComponent, uint num, float gamma /*= 2.2f*/)
 /// Exponentiate the elements of the image.
 void FloatImage::exponentiate(uint baseComponent, uint num, float power)
 {
-    const uint size = m_pixelCount;
-
-    for(uint c = 0; c < num; c++) {
+    for (uint c = 0; c < num; c++) {
         float * ptr = this->channel(baseComponent + c);
 
-        for(uint i = 0; i < size; i++) {
-            ptr[i] = powf(max(0.0f, ptr[i]), power);
-        }
+        parallel_for_range(m_pixelCount, 16 * 1024, [=](uint64 begin, uint64 end) {
+            pow_array(ptr + begin, ptr + begin, int(end - begin), power);
+        });
     }
 }
 
@@ -307,8 +515,8 @@ void FloatImage::transform(uint baseComponent, const Matrix & m, Vector4::Arg of
     float * b = this->channel(baseComponent + 2);
     float * a = this->channel(baseComponent + 3);
 
-    const uint size = m_pixelCount;
-    for (uint i = 0; i < size; i++)
+    const uint64 size = m_pixelCount;
+    for (uint64 i = 0; i < size; i++)
     {
         Vector4 color = nv::transform(m, Vector4(*r, *g, *b, *a)) + offset;
 
@@ -334,8 +542,8 @@ void FloatImage::swizzle(uint baseComponent, uint r, uint g, uint b, uint a)
     c[5] = consts + 1;
     c[6] = consts + 2;
 
-    const uint size = m_pixelCount;
-    for (uint i = 0; i < size; i++)
+    const uint64 size = m_pixelCount;
+    for (uint64 i = 0; i < size; i++)
     {
         float tmp[4] = { *c[r], *c[g], *c[b], *c[a] };
 
@@ -563,8 +771,8 @@ FloatImage * FloatImage::fastDownSample() const
 
     AutoPtr<FloatImage> dst_image( new FloatImage() );
 
-    const uint w = max(1, m_width / 2);
-    const uint h = max(1, m_height / 2);
+    const uint w = max(1U, m_width / 2);
+    const uint h = max(1U, m_height / 2);
     dst_image->allocate(m_componentCount, w, h);
 
     // 1D box filter.
@@ -739,9 +947,9 @@ FloatImage * FloatImage::fastDownSample() const
 /// Downsample applying a 1D kernel separately in each dimension.
 FloatImage * FloatImage::downSample(const Filter & filter, WrapMode wm) const
 {
-    const uint w = max(1, m_width / 2);
-    const uint h = max(1, m_height / 2);
-    const uint d = max(1, m_depth / 2);
+    const uint w = max(1U, m_width / 2);
+    const uint h = max(1U, m_height / 2);
+    const uint d = max(1U, m_depth / 2);
 
     return resize(filter, w, h, d, wm);
 }
@@ -749,9 +957,9 @@ FloatImage * FloatImage::downSample(const Filter & filter, WrapMode wm) const
 /// Downsample applying a 1D kernel separately in each dimension.
 FloatImage * FloatImage::downSample(const Filter & filter, WrapMode wm, uint alpha) const
 {
-    const uint w = max(1, m_width / 2);
-    const uint h = max(1, m_height / 2);
-    const uint d = max(1, m_depth / 2);
+    const uint w = max(1U, m_width / 2);
+    const uint h = max(1U, m_height / 2);
+    const uint d = max(1U, m_depth / 2);
 
     return resize(filter, w, h, d, wm, alpha);
 }
@@ -994,22 +1202,268 @@ FloatImage * FloatImage::resize(const Filter & filter, uint w, uint h, uint d, W
 }
 
 
+// Kernels of at least this size are applied with the FFT, unless they are separable.
+static const uint s_fftKernelThreshold = 8;
+
+// Copy of plane z of channel c with the border required by a kernel of the given window size, so that the kernel can be
+// applied without wrapping the texel indices. The copy is a single channel image, so it has no 32-bit size limit.
+static void padPlane(const FloatImage * img, uint c, uint z, FloatImage::WrapMode wm, uint window, FloatImage & padded)
+{
+    const uint w = img->width();
+    const uint h = img->height();
+    const int offset = int(window / 2);
+    const uint stride = w + window - 1;
+
+    padded.allocate(1, stride, h + window - 1);
+
+    const float * channel = img->channel(c);
+
+    parallel_for(h + window - 1, [&](int py) {
+        const int y = py - offset;
+        float * dst = padded.scanline(0, py, 0);
+
+        if (y >= 0 && y < int(h)) {
+            for (int x = 0; x < offset; x++) {
+                dst[x] = channel[img->index(x - offset, y, z, wm)];
+            }
+            memcpy(dst + offset, channel + img->index(0, y, z), w * sizeof(float));
+            for (uint x = offset + w; x < stride; x++) {
+                dst[x] = channel[img->index(int(x) - offset, y, z, wm)];
+            }
+        }
+        else {
+            for (uint x = 0; x < stride; x++) {
+                dst[x] = channel[img->index(int(x) - offset, y, z, wm)];
+            }
+        }
+    });
+}
+
+// Radix-2 FFT of n complex values stored as interleaved (re, im) pairs, in place. The twiddle table holds the n/2 factors
+// exp(-2 pi i k / n), conjugated for the inverse transform, which is not scaled.
+static void fft(float * data, uint n, const float * twiddles, bool inverse)
+{
+    for (uint i = 1, j = 0; i < n; i++) {
+        uint bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+
+        if (i < j) {
+            swap(data[2 * i + 0], data[2 * j + 0]);
+            swap(data[2 * i + 1], data[2 * j + 1]);
+        }
+    }
+
+    const float sign = inverse ? -1.0f : 1.0f;
+
+    for (uint length = 2; length <= n; length *= 2) {
+        const uint half = length / 2;
+        const uint step = n / length;
+
+        for (uint i = 0; i < n; i += length) {
+            float * a = data + 2 * i;
+            float * b = data + 2 * (i + half);
+
+            for (uint k = 0; k < half; k++) {
+                const float wr = twiddles[2 * k * step + 0];
+                const float wi = twiddles[2 * k * step + 1] * sign;
+
+                const float tr = b[2 * k + 0] * wr - b[2 * k + 1] * wi;
+                const float ti = b[2 * k + 0] * wi + b[2 * k + 1] * wr;
+
+                b[2 * k + 0] = a[2 * k + 0] - tr;
+                b[2 * k + 1] = a[2 * k + 1] - ti;
+                a[2 * k + 0] += tr;
+                a[2 * k + 1] += ti;
+            }
+        }
+    }
+}
+
+// 2D FFT of an n x n complex tile, rows first. The columns are transformed through the given scratch buffer of n values.
+static void fft2D(float * tile, uint n, const float * twiddles, bool inverse, float * column)
+{
+    for (uint y = 0; y < n; y++) {
+        fft(tile + 2 * y * n, n, twiddles, inverse);
+    }
+
+    for (uint x = 0; x < n; x++) {
+        for (uint y = 0; y < n; y++) {
+            column[2 * y + 0] = tile[2 * (y * n + x) + 0];
+            column[2 * y + 1] = tile[2 * (y * n + x) + 1];
+        }
+
+        fft(column, n, twiddles, inverse);
+
+        for (uint y = 0; y < n; y++) {
+            tile[2 * (y * n + x) + 0] = column[2 * y + 0];
+            tile[2 * (y * n + x) + 1] = column[2 * y + 1];
+        }
+    }
+}
+
+// Apply the kernel to a padded plane with an overlap-save FFT convolution of n x n tiles, each one producing
+// n - window + 1 rows and columns of the output. Since the kernel is real, pairs of tiles are transformed together
+// as the real and imaginary parts of a single complex tile.
+static void convolveFFT(const Kernel2 & k, const float * padded, uint w, uint h, float * output)
+{
+    const uint window = k.windowSize();
+    const uint stride = w + window - 1;
+    const uint n = min(nextPowerOfTwo(4 * window), nextPowerOfTwo(max(w, h) + window - 1));
+    const uint m = n - window + 1;
+
+    Array<float> twiddles;
+    twiddles.resize(n);
+    for (uint i = 0; i < n / 2; i++) {
+        const double angle = -2.0 * 3.14159265358979323846 * double(i) / double(n);
+        twiddles[2 * i + 0] = float(cos(angle));
+        twiddles[2 * i + 1] = float(sin(angle));
+    }
+
+    // Spectrum of the flipped kernel, so that the convolution computes the same correlation as applyKernelXY. The
+    // normalization of the inverse transform is folded into it.
+    Array<float> spectrum;
+    spectrum.resize(2 * n * n, 0.0f);
+    {
+        const float scale = 1.0f / float(n * n);
+        for (uint y = 0; y < window; y++) {
+            for (uint x = 0; x < window; x++) {
+                spectrum[2 * (y * n + x)] = k.valueAt(window - 1 - x, window - 1 - y) * scale;
+            }
+        }
+
+        Array<float> column;
+        column.resize(2 * n);
+        fft2D(spectrum.buffer(), n, twiddles.buffer(), false, column.buffer());
+    }
+
+    const uint tilesX = (w + m - 1) / m;
+    const uint tilesY = (h + m - 1) / m;
+    const uint tileCount = tilesX * tilesY;
+
+    parallel_for((tileCount + 1) / 2, [&](int pair) {
+        Array<float> tile;
+        tile.resize(2 * n * n);
+        Array<float> column;
+        column.resize(2 * n);
+
+        for (uint j = 0; j < 2; j++) {
+            const uint t = 2 * pair + j;
+            const uint tx = (t % tilesX) * m;
+            const uint ty = (t / tilesX) * m;
+
+            for (uint y = 0; y < n; y++) {
+                float * dst = tile.buffer() + 2 * y * n + j;
+                if (t < tileCount && ty + y < h + window - 1) {
+                    const float * src = padded + uint64(ty + y) * stride + tx;
+                    const uint count = min(n, stride - tx);
+                    for (uint x = 0; x < count; x++) dst[2 * x] = src[x];
+                    for (uint x = count; x < n; x++) dst[2 * x] = 0.0f;
+                }
+                else {
+                    for (uint x = 0; x < n; x++) dst[2 * x] = 0.0f;
+                }
+            }
+        }
+
+        fft2D(tile.buffer(), n, twiddles.buffer(), false, column.buffer());
+
+        for (uint i = 0; i < n * n; i++) {
+            const float re = tile[2 * i + 0] * spectrum[2 * i + 0] - tile[2 * i + 1] * spectrum[2 * i + 1];
+            const float im = tile[2 * i + 0] * spectrum[2 * i + 1] + tile[2 * i + 1] * spectrum[2 * i + 0];
+            tile[2 * i + 0] = re;
+            tile[2 * i + 1] = im;
+        }
+
+        fft2D(tile.buffer(), n, twiddles.buffer(), true, column.buffer());
+
+        // The first window - 1 rows and columns wrap around the tile and are discarded.
+        for (uint j = 0; j < 2; j++) {
+            const uint t = 2 * pair + j;
+            if (t >= tileCount) break;
+
+            const uint tx = (t % tilesX) * m;
+            const uint ty = (t / tilesX) * m;
+            const uint width = min(m, w - tx);
+            const uint height = min(m, h - ty);
+
+            for (uint y = 0; y < height; y++) {
+                const float * src = tile.buffer() + 2 * ((y + window - 1) * n + window - 1) + j;
+                float * dst = output + uint64(ty + y) * w + tx;
+                for (uint x = 0; x < width; x++) dst[x] = src[2 * x];
+            }
+        }
+    });
+}
+
+/// Convolve channel c with the given 2D kernel, using the wrap mode at the borders. Separable kernels are applied as
+/// a horizontal and a vertical pass, large kernels with an FFT convolution.
 void FloatImage::convolve(const Kernel2 & k, uint c, WrapMode wm)
 {
-    AutoPtr<FloatImage> tmpImage(clone());
+    const uint w = m_width;
+    const uint h = m_height;
+    const uint d = m_depth;
+    const uint window = k.windowSize();
+
+    Array<float> horizontal, vertical;
+    horizontal.resize(window);
+    vertical.resize(window);
+    const bool separable = k.isSeparable(horizontal.buffer(), vertical.buffer());
 
-    uint w = m_width;
-    uint h = m_height;
-    uint d = m_depth;
+    FloatImage padded;
+    FloatImage tmp;
 
     for (uint z = 0; z < d; z++)
     {
-        for (uint y = 0; y < h; y++)
+        padPlane(this, c, z, wm, window, padded);
+
+        float * output = channel(c) + index(0, 0, z);
+
+        if (separable)
         {
-            for (uint x = 0; x < w; x++)
-            {
-                pixel(c, x, y, 0) = tmpImage->applyKernelXY(&k, x, y, z, c, wm);
-            }
+            tmp.allocate(1, w, h + window - 1);
+
+            parallel_for(h + window - 1, [&](int y) {
+                const float * src = padded.scanline(0, y, 0);
+                float * dst = tmp.scanline(0, y, 0);
+
+                for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+                for (uint e = 0; e < window; e++) {
+                    const float kx = horizontal[e];
+                    for (uint x = 0; x < w; x++) dst[x] += kx * src[x + e];
+                }
+            });
+
+            parallel_for(h, [&](int y) {
+                float * dst = output + uint64(y) * w;
+
+                for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+                for (uint i = 0; i < window; i++) {
+                    const float ky = vertical[i];
+                    const float * src = tmp.scanline(0, y + i, 0);
+                    for (uint x = 0; x < w; x++) dst[x] += ky * src[x];
+                }
+            });
+        }
+        else if (window >= s_fftKernelThreshold)
+        {
+            convolveFFT(k, padded.channel(0), w, h, output);
+        }
+        else
+        {
+            // Same order of accumulation as applyKernelXY, a row at a time.
+            parallel_for(h, [&](int y) {
+                float * dst = output + uint64(y) * w;
+
+                for (uint x = 0; x < w; x++) dst[x] = 0.0f;
+                for (uint i = 0; i < window; i++) {
+                    const float * src = padded.scanline(0, y + i, 0);
+                    for (uint e = 0; e < window; e++) {
+                        const float kxy = k.valueAt(e, i);
+                        for (uint x = 0; x < w; x++) dst[x] += kxy * src[x + e];
+                    }
+                }
+            });
         }
     }
 }
@@ -1386,8 +1840,8 @@ float FloatImage::alphaTestCoverage(float alphaRef, int alphaChannel, float alph
 #if 0
     const float * alpha = channel(alphaChannel);
 
-    const uint count = m_pixelCount;
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = m_pixelCount;
+    for (uint64 i = 0; i < count; i++) {
         if (alpha[i] > alphaRef) coverage += 1.0f; // @@ gt or lt?
     }
     
@@ -1421,6 +1875,62 @@ float FloatImage::alphaTestCoverage(float alphaRef, int alphaChannel, float alph
 #endif
 }
 
+// The alpha scales visited by the binary search in scaleAlphaToCoverage are all multiples of 1/512 below 4.
+static const uint s_alphaScaleSteps = 512;
+static const uint s_alphaScaleEdgeCount = 4 * s_alphaScaleSteps + 1;
+
+// One of the 4x4 bilinear samples of alphaTestCoverage between the corner alphas a, with the same floating point operations.
+static inline float alphaCoverageSample(const float a[4], float alphaScale, uint sx, uint sy)
+{
+    const uint n = 4;
+    const float alpha00 = nv::saturate(a[0] * alphaScale);
+    const float alpha10 = nv::saturate(a[1] * alphaScale);
+    const float alpha01 = nv::saturate(a[2] * alphaScale);
+    const float alpha11 = nv::saturate(a[3] * alphaScale);
+    const float fx = (sx + 0.5f) / n;
+    const float fy = (sy + 0.5f) / n;
+    return alpha00 * (1 - fx) * (1 - fy) + alpha10 * fx * (1 - fy) + alpha01 * (1 - fx) * fy + alpha11 * fx * fy;
+}
+
+// Index of the first alpha scale edge at which the sample passes the alpha test, or s_alphaScaleEdgeCount if it never
+// does. The sample is a sum of saturated ramps, so it grows with the scale. The crossing is solved analytically, then
+// checked against the float evaluation of the neighboring edges, so that the result is the same as testing every edge.
+static uint alphaCoverageEdge(const float a[4], const uint order[4], float alphaRef, uint sx, uint sy)
+{
+    const uint n = 4;
+    const double fx = (sx + 0.5f) / n;
+    const double fy = (sy + 0.5f) / n;
+    const double w[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+    // Walk the segments between the scales at which each corner saturates, corners in order of decreasing alpha.
+    double saturated = 0.0, slope = 0.0;
+    for (uint k = 0; k < 4; k++) {
+        if (a[k] > 0.0f) slope += w[k] * a[k];
+    }
+
+    double t = (alphaRef < 0.0f) ? -1.0 : DBL_MAX;
+    for (uint i = 0; i < 4 && t == DBL_MAX; i++) {
+        const uint k = order[i];
+        if (a[k] <= 0.0f) break;
+
+        const double end = 1.0 / a[k];
+        if (saturated + end * slope > alphaRef) t = (alphaRef - saturated) / slope;
+
+        saturated += w[k];
+        slope -= w[k] * a[k];
+    }
+
+    uint e;
+    if (t < 0.0) e = 0;
+    else if (t >= 4.0) e = s_alphaScaleEdgeCount;
+    else e = uint(t * s_alphaScaleSteps) + 1;
+
+    while (e > 0 && alphaCoverageSample(a, float(e - 1) / s_alphaScaleSteps, sx, sy) > alphaRef) e--;
+    while (e < s_alphaScaleEdgeCount && !(alphaCoverageSample(a, float(e) / s_alphaScaleSteps, sx, sy) > alphaRef)) e++;
+
+    return e;
+}
+
 void FloatImage::scaleAlphaToCoverage(float desiredCoverage, float alphaRef, int alphaChannel)
 {
 #if 0
@@ -1451,15 +1961,72 @@ void FloatImage::scaleAlphaToCoverage(float desiredCoverage, float alphaRef, int
     scaleBias(alphaChannel, 1, alphaScale, 0.0f);
     clamp(alphaChannel, 1, 0.0f, 1.0f); 
 #else
+    const uint w = m_width;
+    const uint h = m_height;
+
+    // Histogram of the scale edges at which the alpha test samples become covered, built in a single pass over the
+    // first slice. The coverage of any scale visited by the search is then a prefix sum of the histogram.
+    Array<uint64> histogram;
+    histogram.resize(s_alphaScaleEdgeCount + 1, 0);
+
+    if (w > 1 && h > 1) {
+        const uint quadRows = h - 1;
+        const uint rowsPerTask = max(1U, (16 * 1024) / w);
+        const uint taskCount = min((quadRows + rowsPerTask - 1) / rowsPerTask, 64U);
+        const uint taskRows = (quadRows + taskCount - 1) / taskCount;
+
+        Array<uint64> partials;
+        partials.resize(taskCount * histogram.count(), 0);
+
+        const float * alpha = channel(alphaChannel);
+        uint64 * partialBuffer = partials.buffer();
+        const uint binCount = histogram.count();
+
+        parallel_for(taskCount, [=](int t) {
+            uint64 * bins = partialBuffer + t * binCount;
+            const uint yEnd = min((t + 1) * taskRows, quadRows);
+
+            for (uint y = t * taskRows; y < yEnd; y++) {
+                const float * row0 = alpha + uint64(y) * w;
+                const float * row1 = row0 + w;
+
+                for (uint x = 0; x < w - 1; x++) {
+                    const float a[4] = { row0[x], row0[x + 1], row1[x], row1[x + 1] };
+
+                    uint order[4] = { 0, 1, 2, 3 };
+                    for (uint i = 1; i < 4; i++) {
+                        for (uint j = i; j > 0 && a[order[j]] > a[order[j - 1]]; j--) swap(order[j], order[j - 1]);
+                    }
+
+                    for (uint sy = 0; sy < 4; sy++) {
+                        for (uint sx = 0; sx < 4; sx++) {
+                            bins[alphaCoverageEdge(a, order, alphaRef, sx, sy)]++;
+                        }
+                    }
+                }
+            }
+        });
+
+        for (uint t = 0; t < taskCount; t++) {
+            for (uint i = 0; i < binCount; i++) histogram[i] += partials[t * binCount + i];
+        }
+        for (uint i = 1; i < binCount; i++) histogram[i] += histogram[i - 1];
+    }
+
+    const double sampleCount = double(w - 1) * double(h - 1) * 16;
+
     float minAlphaScale = 0.0f;
     float maxAlphaScale = 4.0f;
     float alphaScale = 1.0f;
     float bestAlphaScale = 1.0f;
     float bestError = NV_FLOAT_MAX;
 
+    // Images without quads have no defined coverage, leave them unscaled.
+    const int stepCount = (w > 1 && h > 1) ? 10 : 0;
+
     // Determine desired scale using a binary search. Hardcoded to 10 steps max.
-    for (int i = 0; i < 10; i++) {
-        float currentCoverage = alphaTestCoverage(alphaRef, alphaChannel, alphaScale);
+    for (int i = 0; i < stepCount; i++) {
+        float currentCoverage = float(double(histogram[uint(alphaScale * s_alphaScaleSteps)]) / sampleCount);
 
         float error = fabsf(currentCoverage - desiredCoverage);
         if (error < bestError) {
@@ -1489,12 +2056,30 @@ void FloatImage::scaleAlphaToCoverage(float desiredCoverage, float alphaRef, int
 #endif
 }
 
+FloatImage * FloatImage::share() const
+{
+    FloatImage * copy = new FloatImage();
+    copy->setHeader(m_componentCount, m_width, m_height, m_depth);
+
+    if (m_channel != NULL) {
+        copy->m_channel = malloc<Channel *>(m_componentCount);
+        for (uint i = 0; i < m_componentCount; i++) {
+            copy->m_channel[i] = m_channel[i];
+            m_channel[i]->refCount++;
+        }
+    }
+
+    return copy;
+}
+
 FloatImage* FloatImage::clone() const
 {
     FloatImage* copy = new FloatImage();
 
     copy->allocate(m_componentCount, m_width, m_height, m_depth);
-    memcpy(copy->m_mem, m_mem, m_floatCount * sizeof(float));
+    for (uint c = 0; c < m_componentCount; c++) {
+        memcpy(copy->channel(c), channel(c), size_t(m_pixelCount * sizeof(float)));
+    }
 
     return copy;
 }
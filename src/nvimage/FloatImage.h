@@ -28,6 +28,25 @@ namespace nv
     {
     public:
 
+        typedef void ReleaseFunction(void * context);
+
+        // Memory block that holds the texels of one or more channels.
+        struct Block {
+            float * mem;
+            uint64 count;
+            uint refCount;
+            bool mapped;                // Backed by a scratch file.
+            ReleaseFunction * release;  // Wrapped caller memory, it's never modified.
+            void * context;
+        };
+
+        // Channels point to a block and are reference counted, so that images can share them.
+        struct Channel {
+            float * data;
+            Block * block;
+            uint refCount;
+        };
+
         enum WrapMode {
             WrapMode_Clamp,
             WrapMode_Repeat,
@@ -50,7 +69,25 @@ namespace nv
         //@{
         void allocate(uint c, uint w, uint h, uint d = 1);
         void free(); // Does not clear members.
+        void setHeader(uint c, uint w, uint h, uint d = 1); // Sets the members without allocating memory.
         void resizeChannelCount(uint c);
+
+        // Reference caller owned channels without copying them. Release is called once no image references them anymore.
+        // Returns false and leaves the image unchanged if it would be empty or a channel is NULL.
+        bool wrap(uint c, uint w, uint h, uint d, const float * const * channels, ReleaseFunction * release = NULL, void * context = NULL);
+        void detach(); // Copy the channels that can't be modified in place.
+        void detach(uint baseComponent, uint num);
+        bool isWritable() const;
+
+        // Copy that references the same channels, they are copied once detached.
+        FloatImage * share() const;
+
+        // Channels are contiguous when they are stored one after another in the same block.
+        bool isContiguous() const;
+        void makeContiguous();
+
+        // Images larger than byteCount are allocated in memory mapped scratch files, 0 disables them.
+        static void setScratchFileThreshold(uint64 byteCount, const char * directory = NULL);
         //@}
 
         /** @name Manipulation. */
@@ -112,8 +149,8 @@ namespace nv
         uint height() const { return m_height; }
         uint depth() const { return m_depth; }
         uint componentCount() const { return m_componentCount; }
-        uint floatCount() const { return m_floatCount; }
-        uint pixelCount() const { return m_pixelCount; }
+        uint64 floatCount() const { return m_floatCount; }
+        uint64 pixelCount() const { return m_pixelCount; }
 
 
         /** @name Pixel access. */
@@ -133,11 +170,11 @@ namespace nv
         float pixel(uint c, uint x, uint y, uint z) const;
         float & pixel(uint c, uint x, uint y, uint z);
 
-        float pixel(uint c, uint idx) const;
-        float & pixel(uint c, uint idx);
+        float pixel(uint c, uint64 idx) const;
+        float & pixel(uint c, uint64 idx);
 
-        float pixel(uint idx) const;
-        float & pixel(uint idx);
+        float pixel(uint64 idx) const;
+        float & pixel(uint64 idx);
 
         float sampleNearest(uint c, float x, float y, WrapMode wm) const;
         float sampleLinear(uint c, float x, float y, WrapMode wm) const;
@@ -167,24 +204,24 @@ namespace nv
 
     public:
 
-        uint index(uint x, uint y, uint z) const;
-        uint indexClamp(int x, int y, int z) const;
-        uint indexRepeat(int x, int y, int z) const;
-        uint indexMirror(int x, int y, int z) const;
-        uint index(int x, int y, int z, WrapMode wm) const;
+        uint64 index(uint x, uint y, uint z) const;
+        uint64 indexClamp(int x, int y, int z) const;
+        uint64 indexRepeat(int x, int y, int z) const;
+        uint64 indexMirror(int x, int y, int z) const;
+        uint64 index(int x, int y, int z, WrapMode wm) const;
 
         float bilerp(uint c, int ix0, int iy0, int ix1, int iy1, float fx, float fy) const;
         float trilerp(uint c, int ix0, int iy0, int iz0, int ix1, int iy1, int iz1, float fx, float fy, float fz) const;
 
     public:
 
-        uint16 m_componentCount;
-        uint16 m_width;
-        uint16 m_height;
-        uint16 m_depth;
-        uint32 m_pixelCount;
-        uint32 m_floatCount;
-        float * m_mem;
+        uint32 m_componentCount;
+        uint32 m_width;
+        uint32 m_height;
+        uint32 m_depth;
+        uint64 m_pixelCount;
+        uint64 m_floatCount;
+        Channel ** m_channel;
 
     };
 
@@ -192,104 +229,98 @@ namespace nv
     /// Get const channel pointer.
     inline const float * FloatImage::channel(uint c) const
     {
-        nvDebugCheck(m_mem != NULL);
+        nvDebugCheck(m_channel != NULL);
         nvDebugCheck(c < m_componentCount);
-        return m_mem + c * m_pixelCount;
+        return m_channel[c]->data;
     }
 
     /// Get channel pointer.
     inline float * FloatImage::channel(uint c) {
-        nvDebugCheck(m_mem != NULL);
+        nvDebugCheck(m_channel != NULL);
         nvDebugCheck(c < m_componentCount);
-        return m_mem + c * m_pixelCount;
+        return m_channel[c]->data;
     }
 
     inline const float * FloatImage::plane(uint c, uint z) const {
         nvDebugCheck(z < m_depth);
-        return channel(c) + z * m_width * m_height;        
+        return channel(c) + uint64(z) * m_width * m_height;        
     }
 
     inline float * FloatImage::plane(uint c, uint z) {
         nvDebugCheck(z < m_depth);
-        return channel(c) + z * m_width * m_height;        
+        return channel(c) + uint64(z) * m_width * m_height;        
     }
 
     /// Get const scanline pointer.
     inline const float * FloatImage::scanline(uint c, uint y, uint z) const
     {
         nvDebugCheck(y < m_height);
-        return plane(c, z) + y * m_width;
+        return plane(c, z) + uint64(y) * m_width;
     }
 
     /// Get scanline pointer.
     inline float * FloatImage::scanline(uint c, uint y, uint z)
     {
         nvDebugCheck(y < m_height);
-        return plane(c, z) + y * m_width;
+        return plane(c, z) + uint64(y) * m_width;
     }
 
     /// Get pixel component.
     inline float FloatImage::pixel(uint c, uint x, uint y, uint z) const
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(c < m_componentCount);
         nvDebugCheck(x < m_width);
         nvDebugCheck(y < m_height);
         nvDebugCheck(z < m_depth);
-        return m_mem[c * m_pixelCount + index(x, y, z)];
+        return channel(c)[index(x, y, z)];
     }
 
     /// Get pixel component.
     inline float & FloatImage::pixel(uint c, uint x, uint y, uint z)
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(c < m_componentCount);
         nvDebugCheck(x < m_width);
         nvDebugCheck(y < m_height);
         nvDebugCheck(z < m_depth);
-        return m_mem[c * m_pixelCount + index(x, y, z)];
+        return channel(c)[index(x, y, z)];
     }
 
     /// Get pixel component.
-    inline float FloatImage::pixel(uint c, uint idx) const
+    inline float FloatImage::pixel(uint c, uint64 idx) const
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(c < m_componentCount);
         nvDebugCheck(idx < m_pixelCount);
-        return m_mem[c * m_pixelCount + idx];
+        return channel(c)[idx];
     }
 
     /// Get pixel component.
-    inline float & FloatImage::pixel(uint c, uint idx)
+    inline float & FloatImage::pixel(uint c, uint64 idx)
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(c < m_componentCount);
         nvDebugCheck(idx < m_pixelCount);
-        return m_mem[c * m_pixelCount + idx];
+        return channel(c)[idx];
     }
 
     /// Get pixel component.
-    inline float FloatImage::pixel(uint idx) const
+    inline float FloatImage::pixel(uint64 idx) const
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(idx < m_floatCount);
-        return m_mem[idx];
+        return channel(uint(idx / m_pixelCount))[idx % m_pixelCount];
     }
 
     /// Get pixel component.
-    inline float & FloatImage::pixel(uint idx)
+    inline float & FloatImage::pixel(uint64 idx)
     {
-        nvDebugCheck(m_mem != NULL);
         nvDebugCheck(idx < m_floatCount);
-        return m_mem[idx];
+        return channel(uint(idx / m_pixelCount))[idx % m_pixelCount];
     }
 
-    inline uint FloatImage::index(uint x, uint y, uint z) const
+    inline uint64 FloatImage::index(uint x, uint y, uint z) const
     {
         nvDebugCheck(x < m_width);
         nvDebugCheck(y < m_height);
         nvDebugCheck(z < m_depth);
-        uint idx = (z * m_height + y) * m_width + x;
+        uint64 idx = (uint64(z) * m_height + y) * m_width + x;
         nvDebugCheck(idx < m_pixelCount);
         return idx;
     }
@@ -318,7 +349,7 @@ namespace nv
 
 
 
-    inline uint FloatImage::indexClamp(int x, int y, int z) const
+    inline uint64 FloatImage::indexClamp(int x, int y, int z) const
     {
         x = wrapClamp(x, m_width);
         y = wrapClamp(y, m_height);
@@ -327,7 +358,7 @@ namespace nv
     }
 
 
-    inline uint FloatImage::indexRepeat(int x, int y, int z) const
+    inline uint64 FloatImage::indexRepeat(int x, int y, int z) const
     {
         x = wrapRepeat(x, m_width);
         y = wrapRepeat(y, m_height);
@@ -335,7 +366,7 @@ namespace nv
         return index(x, y, z);
    }
 
-    inline uint FloatImage::indexMirror(int x, int y, int z) const
+    inline uint64 FloatImage::indexMirror(int x, int y, int z) const
     {
         x = wrapMirror(x, m_width);
         y = wrapMirror(y, m_height);
@@ -343,7 +374,7 @@ namespace nv
         return index(x, y, z);
     }
 
-    inline uint FloatImage::index(int x, int y, int z, WrapMode wm) const
+    inline uint64 FloatImage::index(int x, int y, int z, WrapMode wm) const
     {
         if (wm == WrapMode_Clamp) return indexClamp(x, y, z);
         if (wm == WrapMode_Repeat) return indexRepeat(x, y, z);
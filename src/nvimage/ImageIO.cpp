@@ -573,17 +573,22 @@ static FloatImage * loadFloatDDS(Stream & s)
         FloatImage * img = new FloatImage;
         img->allocate(4, header.width, header.height);
 
-        uint32 * r = (uint32 *)img->channel(0);
-        uint32 * g = (uint32 *)img->channel(1);
-        uint32 * b = (uint32 *)img->channel(2);
-        uint32 * a = (uint32 *)img->channel(3);
-
-        uint16 * ptr = data;
-        for (int i = 0; i < size; i++) {
-            *r++ = half_to_float( *ptr++ );
-            *g++ = half_to_float( *ptr++ );
-            *b++ = half_to_float( *ptr++ );
-            *a++ = half_to_float( *ptr++ );
+        float * r = img->channel(0);
+        float * g = img->channel(1);
+        float * b = img->channel(2);
+        float * a = img->channel(3);
+
+        // Expand a few texels at a time, then deinterleave.
+        float tmp[4 * 256];
+        for (int i = 0; i < size; i += 256) {
+            const int n = min(size - i, 256);
+            half_to_float_array(data + 4 * i, tmp, 4 * n);
+            for (int j = 0; j < n; j++) {
+                *r++ = tmp[4 * j + 0];
+                *g++ = tmp[4 * j + 1];
+                *b++ = tmp[4 * j + 2];
+                *a++ = tmp[4 * j + 3];
+            }
         }
 
         delete [] data;
@@ -689,22 +694,28 @@ static bool saveFloatDDS(Stream & s, const FloatImage * img, uint base_component
 
     s << header;
 
-    uint32 * r = (uint32 *)img->channel(base_component + 0);
-    uint32 * g = (uint32 *)img->channel(base_component + 1);
-    uint32 * b = (uint32 *)img->channel(base_component + 2);
-    uint32 * a = (uint32 *)img->channel(base_component + 3);
+    const float * r = img->channel(base_component + 0);
+    const float * g = img->channel(base_component + 1);
+    const float * b = img->channel(base_component + 2);
+    const float * a = img->channel(base_component + 3);
+
+    // Convert a few texels at a time, then interleave.
+    uint16 half[4][256];
 
     const uint size = img->width() * img->height();
-    for (uint i = 0; i < size; i++) {
-        uint16 R = half_from_float( *r++ );
-        uint16 G = half_from_float( *g++ );
-        uint16 B = half_from_float( *b++ );
-        uint16 A = half_from_float( *a++ );
-
-        s.serialize(&R, sizeof(uint16));
-        s.serialize(&G, sizeof(uint16));
-        s.serialize(&B, sizeof(uint16));
-        s.serialize(&A, sizeof(uint16));
+    for (uint i = 0; i < size; i += 256) {
+        const uint n = min(size - i, 256U);
+        half_from_float_array(r + i, half[0], n);
+        half_from_float_array(g + i, half[1], n);
+        half_from_float_array(b + i, half[2], n);
+        half_from_float_array(a + i, half[3], n);
+
+        for (uint j = 0; j < n; j++) {
+            s.serialize(&half[0][j], sizeof(uint16));
+            s.serialize(&half[1][j], sizeof(uint16));
+            s.serialize(&half[2][j], sizeof(uint16));
+            s.serialize(&half[3][j], sizeof(uint16));
+        }
     }
 
     return true;
@@ -29,18 +29,184 @@
 #include "nvmath/Color.inl"
 #include "nvmath/Vector.h"
 
+#include "nvthread/ParallelFor.h"
+
 #include "nvcore/Ptr.h"
+#include "nvcore/Array.inl"
 
 #include <string.h> // memcpy
 
+#if NV_USE_SSE > 1
+#include <emmintrin.h> // SSE2
+#endif
+
 
 using namespace nv;
 
+// Size of the tiles processed in parallel.
+static const uint s_tileSize = 64;
+
+// Copy of a channel with a border of the given size on each side, so that the kernels can be applied without wrapping
+// the texel indices. The copy is a single channel image, so it has no 32-bit size limit.
+static void padChannel(const FloatImage * img, uint c, FloatImage::WrapMode wm, uint border, FloatImage & padded)
+{
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint stride = w + 2 * border;
+
+    padded.allocate(1, stride, h + 2 * border);
+
+    const float * channel = img->channel(c);
+
+    parallel_for(h + 2 * border, [&](int py) {
+        const int y = py - int(border);
+        float * dst = padded.scanline(0, py, 0);
+
+        if (y >= 0 && y < int(h)) {
+            for (uint x = 0; x < border; x++) {
+                dst[x] = channel[img->index(int(x) - int(border), y, 0, wm)];
+                dst[border + w + x] = channel[img->index(int(w + x), y, 0, wm)];
+            }
+            memcpy(dst + border, img->scanline(c, y, 0), w * sizeof(float));
+        }
+        else {
+            for (uint x = 0; x < stride; x++) {
+                dst[x] = channel[img->index(int(x) - int(border), y, 0, wm)];
+            }
+        }
+    });
+}
+
+#if NV_USE_SSE > 1
+
+// Normalize (du, dv, heightScale) for 4 texels and store scale * n + bias.
+static inline void storeNormals(__m128 du, __m128 dv, float heightScale, float scale, float bias, float * nx, float * ny, float * nz)
+{
+    const __m128 hs = _mm_set1_ps(heightScale);
+    const __m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv)), _mm_mul_ps(hs, hs));
+    const __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(l2));
+
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 b = _mm_set1_ps(bias);
+    _mm_storeu_ps(nx, _mm_add_ps(_mm_mul_ps(s, _mm_mul_ps(du, inv)), b));
+    _mm_storeu_ps(ny, _mm_add_ps(_mm_mul_ps(s, _mm_mul_ps(dv, inv)), b));
+    _mm_storeu_ps(nz, _mm_add_ps(_mm_mul_ps(s, _mm_mul_ps(hs, inv)), b));
+}
+
+#endif
+
+// Compute the normals of the height field stored in the given channel, using the given gradient kernels. Channels 0 to 2
+// of the output are set to scale * n + bias.
+// The tiles are processed in parallel, and up to sixteen texels of a row at a time with SSE2. The taps of both kernels
+// are accumulated in the same order as applyKernelXY.
+static void computeNormals(const FloatImage * img, uint heightChannel, FloatImage::WrapMode wm, const Kernel2 & kdu, const Kernel2 & kdv, float heightScale, float scale, float bias, FloatImage * out)
+{
+    nvDebugCheck(kdu.windowSize() == kdv.windowSize());
+
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint windowSize = kdu.windowSize();
+    const uint border = windowSize / 2;
+    const uint stride = w + 2 * border;
+
+    FloatImage padded;
+    padChannel(img, heightChannel, wm, border, padded);
+
+    // Offsets of the taps in the padded channel, and the weights of both kernels.
+    const uint tapCount = windowSize * windowSize;
+    Array<uint> tapOffset;
+    Array<float> tapWeight;
+    tapOffset.resize(tapCount);
+    tapWeight.resize(2 * tapCount);
+    for (uint i = 0; i < windowSize; i++) {
+        for (uint e = 0; e < windowSize; e++) {
+            tapOffset[i * windowSize + e] = i * stride + e;
+            tapWeight[2 * (i * windowSize + e) + 0] = kdu.valueAt(e, i);
+            tapWeight[2 * (i * windowSize + e) + 1] = kdv.valueAt(e, i);
+        }
+    }
+
+    const uint tileCountX = (w + s_tileSize - 1) / s_tileSize;
+    const uint tileCountY = (h + s_tileSize - 1) / s_tileSize;
+
+    parallel_for(tileCountX * tileCountY, [&](int tile) {
+        const uint x0 = (tile % tileCountX) * s_tileSize;
+        const uint y0 = (tile / tileCountX) * s_tileSize;
+        const uint x1 = min(x0 + s_tileSize, w);
+        const uint y1 = min(y0 + s_tileSize, h);
+
+        for (uint y = y0; y < y1; y++) {
+            // Window of the texel (x, y) starts at (x, y) in the padded channel.
+            const float * window = padded.scanline(0, y, 0);
+
+            float * nx = out->scanline(0, y, 0);
+            float * ny = out->scanline(1, y, 0);
+            float * nz = out->scanline(2, y, 0);
+
+            uint x = x0;
+
+#if NV_USE_SSE > 1
+            // Four independent sums per kernel hide the latency of the accumulation.
+            for (; x + 16 <= x1; x += 16) {
+                __m128 du[4], dv[4];
+                for (uint k = 0; k < 4; k++) {
+                    du[k] = _mm_setzero_ps();
+                    dv[k] = _mm_setzero_ps();
+                }
+
+                for (uint t = 0; t < tapCount; t++) {
+                    const float * src = window + x + tapOffset[t];
+                    const __m128 ku = _mm_set1_ps(tapWeight[2 * t + 0]);
+                    const __m128 kv = _mm_set1_ps(tapWeight[2 * t + 1]);
+                    for (uint k = 0; k < 4; k++) {
+                        const __m128 v = _mm_loadu_ps(src + 4 * k);
+                        du[k] = _mm_add_ps(du[k], _mm_mul_ps(ku, v));
+                        dv[k] = _mm_add_ps(dv[k], _mm_mul_ps(kv, v));
+                    }
+                }
+
+                for (uint k = 0; k < 4; k++) {
+                    storeNormals(du[k], dv[k], heightScale, scale, bias, nx + x + 4 * k, ny + x + 4 * k, nz + x + 4 * k);
+                }
+            }
+
+            for (; x + 4 <= x1; x += 4) {
+                __m128 du = _mm_setzero_ps();
+                __m128 dv = _mm_setzero_ps();
+
+                for (uint t = 0; t < tapCount; t++) {
+                    const __m128 v = _mm_loadu_ps(window + x + tapOffset[t]);
+                    du = _mm_add_ps(du, _mm_mul_ps(_mm_set1_ps(tapWeight[2 * t + 0]), v));
+                    dv = _mm_add_ps(dv, _mm_mul_ps(_mm_set1_ps(tapWeight[2 * t + 1]), v));
+                }
+
+                storeNormals(du, dv, heightScale, scale, bias, nx + x, ny + x, nz + x);
+            }
+#endif
+
+            for (; x < x1; x++) {
+                float du = 0.0f;
+                float dv = 0.0f;
+
+                for (uint t = 0; t < tapCount; t++) {
+                    const float v = window[x + tapOffset[t]];
+                    du += tapWeight[2 * t + 0] * v;
+                    dv += tapWeight[2 * t + 1] * v;
+                }
+
+                Vector3 n = normalize(Vector3(du, dv, heightScale));
+
+                nx[x] = scale * n.x + bias;
+                ny[x] = scale * n.y + bias;
+                nz[x] = scale * n.z + bias;
+            }
+        }
+    });
+}
+
 // Create normal map using the given kernels.
-static FloatImage * createNormalMap(const Image * img, FloatImage::WrapMode wm, Vector4::Arg heightWeights, const Kernel2 * kdu, const Kernel2 * kdv)
+static FloatImage * createNormalMap(const Image * img, FloatImage::WrapMode wm, Vector4::Arg heightWeights, const Kernel2 & kdu, const Kernel2 & kdv)
 {
-    nvDebugCheck(kdu != NULL);
-    nvDebugCheck(kdv != NULL);
     nvDebugCheck(img != NULL);
 
     const uint w = img->width;
@@ -59,30 +225,15 @@ static FloatImage * createNormalMap(const Image * img, FloatImage::WrapMode wm,
 
     float heightScale = 1.0f / 16.0f;	// @@ Use a user defined factor.
 
-    for(uint y = 0; y < h; y++)
-    {
-        for(uint x = 0; x < w; x++)
-        {
-            const float du = fimage->applyKernelXY(kdu, x, y, 0, 3, wm);
-            const float dv = fimage->applyKernelXY(kdv, x, y, 0, 3, wm);
-
-            Vector3 n = normalize(Vector3(du, dv, heightScale));
-
-            fimage->pixel(0, x, y, 0) = 0.5f * n.x + 0.5f;
-            fimage->pixel(1, x, y, 0) = 0.5f * n.y + 0.5f;
-            fimage->pixel(2, x, y, 0) = 0.5f * n.z + 0.5f;
-        }
-    }
+    computeNormals(fimage.ptr(), 3, wm, kdu, kdv, heightScale, 0.5f, 0.5f, fimage.ptr());
 
     return fimage.release();
 }
 
 
 // Create normal map using the given kernels.
-static FloatImage * createNormalMap(const FloatImage * img, FloatImage::WrapMode wm, const Kernel2 * kdu, const Kernel2 * kdv)
+static FloatImage * createNormalMap(const FloatImage * img, FloatImage::WrapMode wm, const Kernel2 & kdu, const Kernel2 & kdv)
 {
-    nvDebugCheck(kdu != NULL);
-    nvDebugCheck(kdv != NULL);
     nvDebugCheck(img != NULL);
 
 #pragma NV_MESSAGE("FIXME: Height scale parameter should go away. It should be a sensible value that produces good results when the heightmap is in the [0, 1] range.")
@@ -94,30 +245,9 @@ static FloatImage * createNormalMap(const FloatImage * img, FloatImage::WrapMode
     AutoPtr<FloatImage> img_out(new FloatImage());
     img_out->allocate(4, w, h);
 
-    for (uint y = 0; y < h; y++)
-    {
-        for (uint x = 0; x < w; x++)
-        {
-            const float du = img->applyKernelXY(kdu, x, y, 0, 3, wm);
-            const float dv = img->applyKernelXY(kdv, x, y, 0, 3, wm);
-
-            Vector3 n = normalize(Vector3(du, dv, heightScale));
-
-            img_out->pixel(0, x, y, 0) = n.x;
-            img_out->pixel(1, x, y, 0) = n.y;
-            img_out->pixel(2, x, y, 0) = n.z;
-        }
-    }
+    computeNormals(img, 3, wm, kdu, kdv, heightScale, 1.0f, 0.0f, img_out.ptr());
 
     // Copy alpha channel.
-    /*for (uint y = 0; y < h; y++)
-    {
-        for (uint x = 0; x < w; x++)
-        {
-            
-            img_out->pixel(3, x, y, 0) = img->pixel(3, x, y, 0);
-        }
-    }*/
     memcpy(img_out->channel(3), img->channel(3), w * h * sizeof(float));
 
     return img_out.release();
@@ -130,32 +260,32 @@ FloatImage * nv::createNormalMap(const Image * img, FloatImage::WrapMode wm, Vec
     nvDebugCheck(img != NULL);
 
     // Init the kernels.
-    Kernel2 * kdu = NULL;
-    Kernel2 * kdv = NULL;
+    uint windowSize = 3;
 
     switch(filter)
     {
         case NormalMapFilter_Sobel3x3:
-            kdu = new Kernel2(3);
+            windowSize = 3;
             break;
         case NormalMapFilter_Sobel5x5:
-            kdu = new Kernel2(5);
+            windowSize = 5;
             break;
         case NormalMapFilter_Sobel7x7:
-            kdu = new Kernel2(7);
+            windowSize = 7;
             break;
         case NormalMapFilter_Sobel9x9:
-            kdu = new Kernel2(9);
+            windowSize = 9;
             break;
         default:
             nvDebugCheck(false);
     };
 
-    kdu->initSobel();
-    kdu->normalize();
+    Kernel2 kdu(windowSize);
+    kdu.initSobel();
+    kdu.normalize();
 
-    kdv = new Kernel2(*kdu);
-    kdv->transpose();
+    Kernel2 kdv(kdu);
+    kdv.transpose();
 
     return ::createNormalMap(img, wm, heightWeights, kdu, kdv);
 }
@@ -166,15 +296,12 @@ FloatImage * nv::createNormalMap(const Image * img, FloatImage::WrapMode wm, Vec
 {
     nvDebugCheck(img != NULL);
 
-    Kernel2 * kdu = NULL;
-    Kernel2 * kdv = NULL;
+    Kernel2 kdu(9);
+    kdu.initBlendedSobel(filterWeights);
+    kdu.normalize();
 
-    kdu = new Kernel2(9);
-    kdu->initBlendedSobel(filterWeights);
-    kdu->normalize();
-
-    kdv = new Kernel2(*kdu);
-    kdv->transpose();
+    Kernel2 kdv(kdu);
+    kdv.transpose();
 
     return ::createNormalMap(img, wm, heightWeights, kdu, kdv);
 }
@@ -184,15 +311,12 @@ FloatImage * nv::createNormalMap(const FloatImage * img, FloatImage::WrapMode wm
 {
     nvDebugCheck(img != NULL);
 
-    Kernel2 * kdu = NULL;
-    Kernel2 * kdv = NULL;
-
-    kdu = new Kernel2(9);
-    kdu->initBlendedSobel(filterWeights);
-    kdu->normalize();
+    Kernel2 kdu(9);
+    kdu.initBlendedSobel(filterWeights);
+    kdu.normalize();
 
-    kdv = new Kernel2(*kdu);
-    kdv->transpose();
+    Kernel2 kdv(kdu);
+    kdv.transpose();
 
     return ::createNormalMap(img, wm, kdu, kdv);
 }
@@ -442,3 +442,295 @@ void nv::powf_11_5(const float* src, float* dst, int count) {
 }
 
 #endif // SSE2
+
+
+//
+// log2(x)
+//
+// for x = 0, returns -inf
+// for x < 0 or NaN, returns NaN
+// for x = +inf, returns +inf
+//
+// |error| < 2.4e-7 over the normal range
+//
+static inline float _log2f(float x) {
+
+    if (!(x > 0.0f)) return (x == 0.0f) ? -INFINITE_RESULT : std::numeric_limits<float>::quiet_NaN();
+    if (x == INFINITE_RESULT) return INFINITE_RESULT;
+
+    union { float f; uint32_t u; } m = { x };
+
+    // split into mantissa and exponent
+    int e = int(m.u >> 23) - 127;
+    m.u = (m.u & ((1 << 23) - 1)) | (127 << 23);    // mantissa with zero exponent
+
+    // reduce mantissa to [sqrt(1/2), sqrt(2))
+    if (m.f > 1.41421356f) {
+        m.f *= 0.5f;
+        e += 1;
+    }
+
+    // log2(m) = 2/ln(2) * atanh(t), with t = (m-1)/(m+1) in [-0.172, 0.172]
+    float t = (m.f - 1.0f) / (m.f + 1.0f);
+    float t2 = t * t;
+    float p = ((((0.111111111f * t2 + 0.142857143f) * t2 + 0.2f) * t2 + 0.333333333f) * t2 + 1.0f) * t;
+
+    return float(e) + p * 2.88539008f;
+}
+
+//
+// exp2(x)
+//
+// for x >= 128, returns +inf
+// for x < -125.5, returns 0.0f (no subnormals)
+//
+// rel |error| < 1.2e-7
+//
+static inline float _exp2f(float x) {
+
+    if (x != x) return x;
+    if (x >= 128.0f) return INFINITE_RESULT;
+    if (x < -126.0f) return 0.0f;
+
+    // split into integer and fraction in [-0.5, 0.5]
+    float n = floorf(x + 0.5f);
+    float f = x - n;
+
+    // polynomial for exp2(f) over f=[-0.5,0.5]
+    float p = ((((((1.52527338e-5f * f + 1.54035304e-4f) * f + 1.33335581e-3f) * f + 9.61812911e-3f) * f + 5.55041087e-2f) * f + 2.40226507e-1f) * f + 6.93147181e-1f) * f + 1.0f;
+
+    // pow(2, n-1) from exponent bits, so that n = 128 does not overflow
+    union { uint32_t u; float f; } e = { uint32_t(int(n) + 126) << 23 };
+
+    // recontruct the result
+    return p * e.f * 2.0f;
+}
+
+static inline float _linear_to_srgb(float f) {
+    if (!(f > 0.0f))        return 0.0f;
+    if (f <= 0.0031308f)    return 12.92f * f;
+    if (f > 1.0f)           f = 1.0f;
+    return _exp2f(_log2f(f) * 0.41666f) * 1.055f - 0.055f;
+}
+
+static inline float _srgb_to_linear(float f) {
+    if (!(f > 0.0f))        return 0.0f;
+    if (f < 0.04045f)       return f / 12.92f;
+    if (f > 1.0f)           f = 1.0f;
+    return _exp2f(_log2f((f + 0.055f) / 1.055f) * 2.4f);
+}
+
+#if (NV_USE_SSE > 1)
+
+static inline __m128 _select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// x must be positive and finite, special cases are handled by the callers.
+static inline __m128 _log2_ps(__m128 x) {
+
+    // split into mantissa and exponent
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23), _mm_set1_epi32(127));
+    __m128 m = _mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32((1 << 23) - 1)));
+    m = _mm_or_ps(m, _mm_castsi128_ps(_mm_set1_epi32(127 << 23)));
+
+    // reduce mantissa to [sqrt(1/2), sqrt(2))
+    __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_mul_ps(m, _select_ps(big, _mm_set1_ps(0.5f), _mm_set1_ps(1.0f)));
+    e = _mm_sub_epi32(e, _mm_castps_si128(big));
+
+    // log2(m) = 2/ln(2) * atanh(t)
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+
+    __m128 p = _mm_set1_ps(0.111111111f);
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.142857143f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.2f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.333333333f));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), one);
+    p = _mm_mul_ps(p, t);
+
+    return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(p, _mm_set1_ps(2.88539008f)));
+}
+
+// x must not be NaN, special cases are handled by the callers.
+static inline __m128 _exp2_ps(__m128 x) {
+
+    __m128 underflow = _mm_cmplt_ps(x, _mm_set1_ps(-126.0f));
+    __m128 overflow = _mm_cmpge_ps(x, _mm_set1_ps(128.0f));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)), _mm_set1_ps(128.0f));
+
+    // split into integer and fraction in [-0.5, 0.5]
+    __m128i n = _mm_cvtps_epi32(x);
+    __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(n));
+
+    // polynomial for exp2(f) over f=[-0.5,0.5]
+    __m128 p = _mm_set1_ps(1.52527338e-5f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.54035304e-4f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.33335581e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.61812911e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.55041087e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.40226507e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.93147181e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+    // pow(2, n-1) from exponent bits, so that n = 128 does not overflow
+    __m128 e = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(126)), 23));
+    __m128 r = _mm_mul_ps(_mm_mul_ps(p, e), _mm_set1_ps(2.0f));
+
+    r = _mm_andnot_ps(underflow, r);
+    return _select_ps(overflow, _mm_set1_ps(INFINITE_RESULT), r);
+}
+
+void nv::log2_array(const float* src, float* dst, int count) {
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inf = _mm_set1_ps(INFINITE_RESULT);
+
+    int i = 0;
+    for (; i < count - 3; i += 4) {
+        __m128 x = _mm_loadu_ps(&src[i]);
+
+        __m128 positive = _mm_cmpgt_ps(x, zero);
+        __m128 r = _log2_ps(_select_ps(positive, x, _mm_set1_ps(1.0f)));
+
+        r = _select_ps(_mm_cmpeq_ps(x, inf), inf, r);
+        r = _select_ps(positive, r, _mm_set1_ps(std::numeric_limits<float>::quiet_NaN()));
+        r = _select_ps(_mm_cmpeq_ps(x, zero), _mm_set1_ps(-INFINITE_RESULT), r);
+
+        _mm_storeu_ps(&dst[i], r);
+    }
+
+    for (; i < count; i++) {
+        dst[i] = _log2f(src[i]);
+    }
+}
+
+void nv::exp2_array(const float* src, float* dst, int count) {
+
+    int i = 0;
+    for (; i < count - 3; i += 4) {
+        __m128 x = _mm_loadu_ps(&src[i]);
+
+        __m128 nan = _mm_cmpunord_ps(x, x);
+        __m128 r = _exp2_ps(_mm_andnot_ps(nan, x));
+
+        _mm_storeu_ps(&dst[i], _select_ps(nan, x, r));
+    }
+
+    for (; i < count; i++) {
+        dst[i] = _exp2f(src[i]);
+    }
+}
+
+void nv::pow_array(const float* src, float* dst, int count, float power) {
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 pow_zero = _mm_set1_ps(powf(0.0f, power));
+    const __m128 p = _mm_set1_ps(power);
+
+    int i = 0;
+    for (; i < count - 3; i += 4) {
+        __m128 x = _mm_loadu_ps(&src[i]);
+
+        // x <= 0 and NaN behave like zero
+        __m128 positive = _mm_cmpgt_ps(x, zero);
+        __m128 finite = _mm_cmplt_ps(x, _mm_set1_ps(INFINITE_RESULT));
+        __m128 l = _log2_ps(_select_ps(_mm_and_ps(positive, finite), x, _mm_set1_ps(1.0f)));
+        l = _select_ps(finite, l, _mm_set1_ps(INFINITE_RESULT));
+
+        __m128 r = _exp2_ps(_mm_mul_ps(l, p));
+
+        _mm_storeu_ps(&dst[i], _select_ps(positive, r, pow_zero));
+    }
+
+    for (; i < count; i++) {
+        float x = src[i];
+        dst[i] = (x > 0.0f) ? _exp2f(_log2f(x) * power) : powf(0.0f, power);
+    }
+}
+
+void nv::linear_to_srgb_array(const float* src, float* dst, int count) {
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i < count - 3; i += 4) {
+        __m128 x = _mm_loadu_ps(&src[i]);
+
+        // clamp to [0, 1], NaN goes to 0
+        x = _mm_min_ps(_mm_max_ps(x, zero), one);
+
+        __m128 linear = _mm_cmple_ps(x, _mm_set1_ps(0.0031308f));
+
+        __m128 l = _log2_ps(_select_ps(linear, one, x));
+        __m128 r = _exp2_ps(_mm_mul_ps(l, _mm_set1_ps(0.41666f)));
+        r = _mm_sub_ps(_mm_mul_ps(r, _mm_set1_ps(1.055f)), _mm_set1_ps(0.055f));
+
+        _mm_storeu_ps(&dst[i], _select_ps(linear, _mm_mul_ps(x, _mm_set1_ps(12.92f)), r));
+    }
+
+    for (; i < count; i++) {
+        dst[i] = _linear_to_srgb(src[i]);
+    }
+}
+
+void nv::srgb_to_linear_array(const float* src, float* dst, int count) {
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i < count - 3; i += 4) {
+        __m128 x = _mm_loadu_ps(&src[i]);
+
+        // clamp to [0, 1], NaN goes to 0
+        x = _mm_min_ps(_mm_max_ps(x, zero), one);
+
+        __m128 linear = _mm_cmplt_ps(x, _mm_set1_ps(0.04045f));
+
+        __m128 y = _mm_div_ps(_mm_add_ps(x, _mm_set1_ps(0.055f)), _mm_set1_ps(1.055f));
+        __m128 l = _log2_ps(_select_ps(linear, one, y));
+        __m128 r = _exp2_ps(_mm_mul_ps(l, _mm_set1_ps(2.4f)));
+
+        _mm_storeu_ps(&dst[i], _select_ps(linear, _mm_div_ps(x, _mm_set1_ps(12.92f)), r));
+    }
+
+    for (; i < count; i++) {
+        dst[i] = _srgb_to_linear(src[i]);
+    }
+}
+
+#else
+
+void nv::log2_array(const float* src, float* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = _log2f(src[i]);
+    }
+}
+void nv::exp2_array(const float* src, float* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = _exp2f(src[i]);
+    }
+}
+void nv::pow_array(const float* src, float* dst, int count, float power) {
+    const float pow_zero = powf(0.0f, power);
+    for (int i = 0; i < count; i++) {
+        float x = src[i];
+        dst[i] = (x > 0.0f) ? _exp2f(_log2f(x) * power) : pow_zero;
+    }
+}
+void nv::linear_to_srgb_array(const float* src, float* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = _linear_to_srgb(src[i]);
+    }
+}
+void nv::srgb_to_linear_array(const float* src, float* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = _srgb_to_linear(src[i]);
+    }
+}
+
+#endif // SSE2
@@ -33,6 +33,17 @@ namespace nv {
     void powf_5_11(const float* src, float* dst, int count);
     void powf_11_5(const float* src, float* dst, int count);
 
+    // log2, exp2 and pow of float array (in-place is allowed)
+    // rel |error| < 2e-6 for normal results, pow_array(x <= 0) returns powf(0, power)
+    void log2_array(const float* src, float* dst, int count);
+    void exp2_array(const float* src, float* dst, int count);
+    void pow_array(const float* src, float* dst, int count, float power);
+
+    // sRGB transfer functions of float array (in-place is allowed)
+    // input is clamped to [0, 1], |error| < 2e-6
+    void linear_to_srgb_array(const float* src, float* dst, int count);
+    void srgb_to_linear_array(const float* src, float* dst, int count);
+
 } // nv namespace
 
 #endif // NV_MATH_GAMMA_H
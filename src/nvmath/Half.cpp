@@ -139,6 +139,12 @@ static inline uint32 _uint32_srl( uint32 a, int sa )
     return (a >> sa);
 }
 
+// Shift Right Logical, shifting out all the bits when sa >= 32 instead of relying on the hardware masking the shift amount.
+static inline uint32 _uint32_srlz( uint32 a, int sa )
+{
+    return (uint32(sa) < 32) ? (a >> sa) : 0;
+}
+
 // Shift Left Logical
 static inline uint32 _uint32_sll( uint32 a, int sa )
 {
@@ -407,7 +413,7 @@ nv::half_from_float( uint32 f )
     const uint32 f_m_rounded                = _uint32_add( f_m,             f_m_round_offset );
     const uint32 f_m_denorm_sa              = _uint32_sub( one,             f_e_half_bias    );
     const uint32 f_m_with_hidden            = _uint32_or(  f_m_rounded,     f_m_hidden_bit   );
-    const uint32 f_m_denorm                 = _uint32_srl( f_m_with_hidden, f_m_denorm_sa    );
+    const uint32 f_m_denorm                 = _uint32_srlz( f_m_with_hidden, f_m_denorm_sa   );
     const uint32 h_m_denorm                 = _uint32_srl( f_m_denorm,      f_h_m_pos_offset );
     const uint32 f_m_rounded_overflow       = _uint32_and( f_m_rounded,     f_m_hidden_bit   );
     const uint32 m_nan                      = _uint32_srl( f_m,             f_h_m_pos_offset );
@@ -570,6 +576,283 @@ void nv::half_to_float_array_SSE2(const uint16 * vin, float * vout, int count) {
 #endif 
 
 
+// Batch conversions.
+//
+// The float to half kernels have to round exactly like half_from_float above, which rounds half ulps away from zero and
+// truncates denormals. F16C only rounds to nearest even, so the hardware path biases the mantissa by half an ulp and
+// truncates. That is only exact when the result is a normal half, so blocks that contain denormals, overflows or
+// NaNs go through the SSE2 port of the scalar code instead.
+
+#if NV_USE_SSE > 1 && !NV_OS_IOS && (defined(__i386__) || defined(__x86_64__))
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <cpuid.h>
+
+#define NV_TARGET_F16C __attribute__((target("avx,f16c")))
+#define NV_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+
+namespace {
+
+    enum HalfPath {
+        HalfPath_SSE2,
+        HalfPath_F16C,
+        HalfPath_AVX2,
+    };
+
+    static void cpuid(int leaf, int info[4])
+    {
+        __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+    }
+
+    static HalfPath detectHalfPath()
+    {
+        int info[4];
+        cpuid(0, info);
+        const int maxLeaf = info[0];
+
+        cpuid(1, info);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        const bool f16c = (info[2] & (1 << 29)) != 0;
+        if (!osxsave || !avx || !f16c) return HalfPath_SSE2;
+
+        // The OS has to save the YMM registers, F16C instructions are VEX encoded.
+        uint32 eax, edx;
+        __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        const uint64 xcr0 = (uint64(edx) << 32) | eax;
+        if ((xcr0 & 6) != 6) return HalfPath_SSE2;
+
+        if (maxLeaf >= 7) {
+            cpuid(7, info);
+            if (info[1] & (1 << 5)) return HalfPath_AVX2;
+        }
+        return HalfPath_F16C;
+    }
+
+    static HalfPath halfPath()
+    {
+        // Racing threads all compute the same value.
+        static int s_path = -1;
+        if (s_path < 0) s_path = detectHalfPath();
+        return HalfPath(s_path);
+    }
+
+    // Shorthands for the port of half_from_float below.
+    inline __m128i sels(__m128i test, __m128i a, __m128i b)
+    {
+        const __m128i mask = _mm_srai_epi32(test, 31);
+        return _mm_or_si128(_mm_and_si128(a, mask), _mm_andnot_si128(mask, b));
+    }
+
+    inline __m128i li(uint32 a) { return _mm_set1_epi32(int(a)); }
+
+    // Four lanes of half_from_float. This follows the scalar code step by step. The only variable shift, used for
+    // denormals, is done by building the float f_m_with_hidden * 2^-(f_m_denorm_sa + 13) and truncating it.
+    static __m128i half_from_float4_SSE2(__m128i f)
+    {
+        const __m128i one                       = li( 0x00000001 );
+        const __m128i f_e_mask                  = li( 0x7f800000 );
+        const __m128i f_m_mask                  = li( 0x007fffff );
+        const __m128i f_m_hidden_bit            = li( 0x00800000 );
+        const __m128i f_snan_mask               = li( 0x7fc00000 );
+        const __m128i h_e_mask                  = li( 0x00007c00 );
+        const __m128i f_h_bias_offset           = li( 0x00000070 );
+        const __m128i f_h_e_biased_flag         = li( 0x0000008f );
+        const __m128i h_e_mask_value            = li( 0x0000001f );
+        const __m128i f_s                       = _mm_and_si128( f, li( 0x80000000 ) );
+        const __m128i f_e                       = _mm_and_si128( f, f_e_mask );
+        const __m128i h_s                       = _mm_srli_epi32( f_s, 16 );
+        const __m128i f_m                       = _mm_and_si128( f, f_m_mask );
+        const __m128i f_e_amount                = _mm_srli_epi32( f_e, 23 );
+        const __m128i f_e_half_bias             = _mm_sub_epi32( f_e_amount, f_h_bias_offset );
+        const __m128i f_snan                    = _mm_and_si128( f, f_snan_mask );
+        const __m128i f_m_round_mask            = _mm_and_si128( f_m, li( 0x00001000 ) );
+        const __m128i f_m_round_offset          = _mm_slli_epi32( f_m_round_mask, 1 );
+        const __m128i f_m_rounded               = _mm_add_epi32( f_m, f_m_round_offset );
+        const __m128i f_m_with_hidden           = _mm_or_si128( f_m_rounded, f_m_hidden_bit );
+        const __m128i f_m_denorm_scaled         = _mm_or_si128( _mm_slli_epi32( _mm_add_epi32( f_e_amount, li( 24 ) ), 23 ), _mm_and_si128( f_m_with_hidden, f_m_mask ) );
+        const __m128i h_m_denorm                = _mm_cvttps_epi32( _mm_castsi128_ps( f_m_denorm_scaled ) );
+        const __m128i f_m_rounded_overflow      = _mm_and_si128( f_m_rounded, f_m_hidden_bit );
+        const __m128i m_nan                     = _mm_srli_epi32( f_m, 13 );
+        const __m128i h_em_nan                  = _mm_or_si128( h_e_mask, m_nan );
+        const __m128i h_e_norm_overflow         = _mm_slli_epi32( _mm_add_epi32( f_e_half_bias, one ), 10 );
+        const __m128i h_e_norm                  = _mm_slli_epi32( f_e_half_bias, 10 );
+        const __m128i h_m_norm                  = _mm_srli_epi32( f_m_rounded, 13 );
+        const __m128i h_em_norm                 = _mm_or_si128( h_e_norm, h_m_norm );
+        const __m128i is_h_ndenorm_msb          = _mm_sub_epi32( f_h_bias_offset, f_e_amount );
+        const __m128i is_f_e_flagged_msb        = _mm_sub_epi32( f_h_e_biased_flag, f_e_half_bias );
+        const __m128i is_h_denorm_msb           = _mm_xor_si128( is_h_ndenorm_msb, li( 0xffffffff ) );
+        const __m128i is_f_m_eqz_msb            = _mm_sub_epi32( f_m, one );
+        const __m128i is_h_nan_eqz_msb          = _mm_sub_epi32( m_nan, one );
+        const __m128i is_f_inf_msb              = _mm_and_si128( is_f_e_flagged_msb, is_f_m_eqz_msb );
+        const __m128i is_f_nan_underflow_msb    = _mm_and_si128( is_f_e_flagged_msb, is_h_nan_eqz_msb );
+        const __m128i is_e_overflow_msb         = _mm_sub_epi32( h_e_mask_value, f_e_half_bias );
+        const __m128i is_h_inf_msb              = _mm_or_si128( is_e_overflow_msb, is_f_inf_msb );
+        const __m128i is_f_nsnan_msb            = _mm_sub_epi32( f_snan, f_snan_mask );
+        const __m128i is_m_norm_overflow_msb    = _mm_sub_epi32( _mm_setzero_si128(), f_m_rounded_overflow );
+        const __m128i is_f_snan_msb             = _mm_xor_si128( is_f_nsnan_msb, li( 0xffffffff ) );
+        const __m128i h_em_overflow_result      = sels( is_m_norm_overflow_msb, h_e_norm_overflow, h_em_norm );
+        const __m128i h_em_nan_result           = sels( is_f_e_flagged_msb, h_em_nan, h_em_overflow_result );
+        const __m128i h_em_nan_underflow_result = sels( is_f_nan_underflow_msb, li( 0x00007c01 ), h_em_nan_result );
+        const __m128i h_em_inf_result           = sels( is_h_inf_msb, h_e_mask, h_em_nan_underflow_result );
+        const __m128i h_em_denorm_result        = sels( is_h_denorm_msb, h_m_denorm, h_em_inf_result );
+        const __m128i h_em_snan_result          = sels( is_f_snan_msb, li( 0x00007e00 ), h_em_denorm_result );
+        const __m128i h_result                  = _mm_or_si128( h_s, h_em_snan_result );
+
+        // Keep the low 16 bits of each lane, sign extended so that the saturating pack leaves them untouched.
+        return _mm_srai_epi32( _mm_slli_epi32( h_result, 16 ), 16 );
+    }
+
+    // True when every lane converts to a normal half, or to zero, so that the biased and truncated hardware conversion
+    // matches half_from_float. 0x38800000 is the smallest normal half and 0x477ff000 is the first value that rounds up
+    // to infinity.
+    inline bool isHardwareExact(__m128i f)
+    {
+        const __m128i a = _mm_and_si128(f, li(0x7fffffff));
+        const __m128i normal = _mm_and_si128(_mm_cmpgt_epi32(a, li(0x387fffff)), _mm_cmpgt_epi32(li(0x477ff000), a));
+        const __m128i exact = _mm_or_si128(normal, _mm_cmpeq_epi32(a, _mm_setzero_si128()));
+        return _mm_movemask_epi8(exact) == 0xffff;
+    }
+
+    static void half_from_float_SSE2(const float * vin, uint16 * vout, uint count)
+    {
+        uint i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i a = half_from_float4_SSE2(_mm_loadu_si128((const __m128i *)(vin + i)));
+            const __m128i b = half_from_float4_SSE2(_mm_loadu_si128((const __m128i *)(vin + i + 4)));
+            _mm_storeu_si128((__m128i *)(vout + i), _mm_packs_epi32(a, b));
+        }
+        for (; i < count; i++) {
+            vout[i] = nv::to_half(vin[i]);
+        }
+    }
+
+    NV_TARGET_F16C static void half_from_float_F16C(const float * vin, uint16 * vout, uint count)
+    {
+        const __m128i bias = li(0x00001000);
+
+        uint i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i f = _mm_loadu_si128((const __m128i *)(vin + i));
+            __m128i h;
+            if (isHardwareExact(f)) {
+                h = _mm_cvtps_ph(_mm_castsi128_ps(_mm_add_epi32(f, bias)), _MM_FROUND_TO_ZERO);
+            }
+            else {
+                h = half_from_float4_SSE2(f);
+                h = _mm_packs_epi32(h, h);
+            }
+            _mm_storel_epi64((__m128i *)(vout + i), h);
+        }
+        for (; i < count; i++) {
+            vout[i] = nv::to_half(vin[i]);
+        }
+    }
+
+    NV_TARGET_AVX2 static void half_from_float_AVX2(const float * vin, uint16 * vout, uint count)
+    {
+        const __m256i bias = _mm256_set1_epi32(0x00001000);
+        const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+        const __m256i min_normal = _mm256_set1_epi32(0x387fffff);
+        const __m256i overflow = _mm256_set1_epi32(0x477ff000);
+
+        uint i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i f = _mm256_loadu_si256((const __m256i *)(vin + i));
+            const __m256i a = _mm256_and_si256(f, abs_mask);
+            const __m256i normal = _mm256_and_si256(_mm256_cmpgt_epi32(a, min_normal), _mm256_cmpgt_epi32(overflow, a));
+            const __m256i exact = _mm256_or_si256(normal, _mm256_cmpeq_epi32(a, _mm256_setzero_si256()));
+
+            __m128i h;
+            if (_mm256_movemask_epi8(exact) == -1) {
+                h = _mm256_cvtps_ph(_mm256_castsi256_ps(_mm256_add_epi32(f, bias)), _MM_FROUND_TO_ZERO);
+            }
+            else {
+                h = _mm_packs_epi32(half_from_float4_SSE2(_mm256_castsi256_si128(f)), half_from_float4_SSE2(_mm256_extracti128_si256(f, 1)));
+            }
+            _mm_storeu_si128((__m128i *)(vout + i), h);
+        }
+        for (; i < count; i++) {
+            vout[i] = nv::to_half(vin[i]);
+        }
+    }
+
+    static void half_to_float_SSE2(const uint16 * vin, float * vout, uint count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        uint i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i h = _mm_loadu_si128((const __m128i *)(vin + i));
+            _mm_storeu_ps(vout + i, half_to_float4_SSE2(_mm_unpacklo_epi16(h, zero)));
+            _mm_storeu_ps(vout + i + 4, half_to_float4_SSE2(_mm_unpackhi_epi16(h, zero)));
+        }
+        for (; i < count; i++) {
+            ((uint32 *)vout)[i] = nv::half_to_float(vin[i]);
+        }
+    }
+
+    // F16C quiets signaling NaNs while half_to_float keeps their payload, so blocks with NaNs use the SSE2 code.
+    NV_TARGET_F16C static void half_to_float_F16C(const uint16 * vin, float * vout, uint count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i abs_mask = _mm_set1_epi16(0x7fff);
+        const __m128i inf = _mm_set1_epi16(0x7c00);
+
+        uint i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i h = _mm_loadu_si128((const __m128i *)(vin + i));
+            if (_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_and_si128(h, abs_mask), inf)) == 0) {
+                _mm256_storeu_ps(vout + i, _mm256_cvtph_ps(h));
+            }
+            else {
+                _mm_storeu_ps(vout + i, half_to_float4_SSE2(_mm_unpacklo_epi16(h, zero)));
+                _mm_storeu_ps(vout + i + 4, half_to_float4_SSE2(_mm_unpackhi_epi16(h, zero)));
+            }
+        }
+        for (; i < count; i++) {
+            ((uint32 *)vout)[i] = nv::half_to_float(vin[i]);
+        }
+    }
+
+} // namespace
+
+void nv::half_from_float_array(const float * vin, uint16 * vout, uint count)
+{
+    switch (halfPath()) {
+        case HalfPath_AVX2: half_from_float_AVX2(vin, vout, count); break;
+        case HalfPath_F16C: half_from_float_F16C(vin, vout, count); break;
+        default: half_from_float_SSE2(vin, vout, count); break;
+    }
+}
+
+void nv::half_to_float_array(const uint16 * vin, float * vout, uint count)
+{
+    // The 256 bit conversion only needs F16C, there is nothing to gain from AVX2 here.
+    if (halfPath() != HalfPath_SSE2) half_to_float_F16C(vin, vout, count);
+    else half_to_float_SSE2(vin, vout, count);
+}
+
+#else
+
+void nv::half_from_float_array(const float * vin, uint16 * vout, uint count)
+{
+    for (uint i = 0; i < count; i++) {
+        vout[i] = nv::to_half(vin[i]);
+    }
+}
+
+void nv::half_to_float_array(const uint16 * vin, float * vout, uint count)
+{
+    for (uint i = 0; i < count; i++) {
+        ((uint32 *)vout)[i] = nv::half_to_float(vin[i]);
+    }
+}
+
+#endif
+
+
 // @@ These tables could be smaller.
 namespace nv {
     uint32 mantissa_table[2048] = { 0xDEADBEEF };
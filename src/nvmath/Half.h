@@ -13,6 +13,11 @@ namespace nv {
     // implement a non-SSE version if we need it. For now, this naming makes it clear this is only available when SSE2 is
     void half_to_float_array_SSE2(const uint16 * vin, float * vout, int count);
 
+    // Convert arrays of any size and alignment. The results are bit exact with half_from_float and half_to_float, the
+    // F16C, AVX2 or SSE2 implementation is selected at runtime.
+    void half_from_float_array(const float * vin, uint16 * vout, uint count);
+    void half_to_float_array(const uint16 * vin, float * vout, uint count);
+
     void half_init_tables();
 
     extern uint32 mantissa_table[2048];
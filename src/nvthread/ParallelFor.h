@@ -72,6 +72,24 @@ namespace nv
     }
 
 
+    // Split [0, count) in ranges of chunk_size elements and call f(begin, end) for each of them in parallel.
+    // Small workloads that fit in a single chunk run on the calling thread.
+    template <typename F>
+    void parallel_for_range(uint64 count, uint chunk_size, F f) {
+        const uint chunk_count = uint((count + chunk_size - 1) / chunk_size);
+        if (chunk_count <= 1) {
+            f(uint64(0), count);
+            return;
+        }
+
+        parallel_for(chunk_count, [&](int i) {
+            const uint64 begin = uint64(uint(i)) * chunk_size;
+            const uint64 end = (count - begin < chunk_size) ? count : begin + chunk_size;
+            f(begin, end);
+        });
+    }
+
+
 #if 0
     template <typename F, typename T>
     void parallel_for_each(Array<T> & array, uint step, F f) {
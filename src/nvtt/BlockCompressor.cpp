@@ -47,14 +47,37 @@ struct CompressorContext
 {
     AlphaMode alphaMode;
     uint w, h, d;
-    const float * data;
+    const float * const * channels;
     const CompressionOptions::Private * compressionOptions;
 
     uint bw, bh, bs;
-    uint8 * mem;
+    uint by;            // First block row of the current band.
+    Vector4 * texels;   // Block linear texels of the current band, 16 per block.
+    uint8 * mem;        // Compressed blocks of the current band.
     CompressorInterface * compressor;
 };
 
+// Blocks are compressed and output in bands of block rows, so that the size of the intermediate buffers
+// is bounded for very large images.
+static const uint s_bandSize = 1024 * 1024;
+static const uint s_texelBandSize = 16 * 1024 * 1024;
+
+static uint bandHeight(const CompressorContext & context)
+{
+    const uint outputRows = s_bandSize / (context.bw * context.bs);
+    const uint texelRows = s_texelBandSize / (context.bw * 16 * sizeof(Vector4));
+    return max(1U, min(outputRows, texelRows));
+}
+
+// Each task gathers one row of blocks of the current band, so that the compression tasks read every block from
+// a single contiguous run of texels instead of 16 rows scattered over 4 channels.
+static void GatherBlockRowTask(void * data, int i)
+{
+    CompressorContext * d = (CompressorContext *) data;
+
+    gatherBlockRow(d->w, d->h, d->channels, 4 * (d->by + i), d->texels + size_t(i) * d->bw * 16);
+}
+
 
 // Each task compresses one block.
 void ColorBlockCompressorTask(void * data, int i)
@@ -67,14 +90,14 @@ void ColorBlockCompressorTask(void * data, int i)
     //for (uint x = 0; x < d->bw; x++)
     {
         ColorBlock rgba;
-        rgba.init(d->w, d->h, d->data, 4*x, 4*y);
+        rgba.init(d->texels + (size_t(y) * d->bw + x) * 16);
 
-        uint8 * ptr = d->mem + (y * d->bw + x) * d->bs;
+        uint8 * ptr = d->mem + (size_t(y) * d->bw + x) * d->bs;
         ((ColorBlockCompressor *) d->compressor)->compressBlock(rgba, d->alphaMode, *d->compressionOptions, ptr);
     }
 }
 
-void ColorBlockCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * data, TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
+void ColorBlockCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
 {
     nvDebugCheck(d == 1);
 
@@ -83,7 +106,7 @@ void ColorBlockCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d,
     context.w = w;
     context.h = h;
     context.d = d;
-    context.data = data;
+    context.channels = channels;
     context.compressionOptions = &compressionOptions;
 
     context.bs = blockSize();
@@ -101,15 +124,23 @@ void ColorBlockCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d,
     dispatcher = &sequential;
 #endif
 
-    const uint count = context.bw * context.bh;
-    const uint size = context.bs * count;
-    context.mem = new uint8[size];
+    const uint band = min(bandHeight(context), context.bh);
+    context.mem = (uint8 *)pool_malloc(context.bs * context.bw * band);
+    context.texels = (Vector4 *)pool_malloc(sizeof(Vector4) * 16 * context.bw * band);
+
+    for (context.by = 0; context.by < context.bh; context.by += band) {
+        const uint rows = min(band, context.bh - context.by);
+        const uint count = context.bw * rows;
+        const uint size = context.bs * count;
 
-    dispatcher->dispatch(ColorBlockCompressorTask, &context, count);
+        dispatcher->dispatch(GatherBlockRowTask, &context, rows);
+        dispatcher->dispatch(ColorBlockCompressorTask, &context, count);
 
-    outputOptions.writeData(context.mem, size);
+        outputOptions.writeData(context.mem, size);
+    }
 
-    delete [] context.mem;
+    pool_free(context.texels);
+    pool_free(context.mem);
 }
 
 // Each task compresses one block.
@@ -119,32 +150,25 @@ void FloatColorCompressorTask(void * data, int i)
 
     // Copy image to block.
     const uint block_x = (i % d->bw);
-    const uint block_y = (i / d->bw);
+    const uint block_y = d->by + (i / d->bw);
 
     const uint src_x_offset = block_x * 4;
     const uint src_y_offset = block_y * 4;
 
-    const float * r = (const float *)d->data + d->w * d->h * d->d * 0;
-    const float * g = (const float *)d->data + d->w * d->h * d->d * 1;
-    const float * b = (const float *)d->data + d->w * d->h * d->d * 2;
-    const float * a = (const float *)d->data + d->w * d->h * d->d * 3;
+    const Vector4 * texels = d->texels + (size_t(i / d->bw) * d->bw + block_x) * 16;
 
     Vector4 colors[16];
     float weights[16];
 
-    const uint block_w = min(d->w - block_x * 4, 4U);
-    const uint block_h = min(d->h - block_y * 4, 4U);
+    const uint block_w = min(d->w - src_x_offset, 4U);
+    const uint block_h = min(d->h - src_y_offset, 4U);
 
     uint x, y;
     for (y = 0; y < block_h; y++) {
         for (x = 0; x < block_w; x++) {
             uint dst_idx = 4 * y + x;
-            uint src_idx = (y + src_y_offset) * d->w + (x + src_x_offset);
-            colors[dst_idx].x = r[src_idx];
-            colors[dst_idx].y = g[src_idx];
-            colors[dst_idx].z = b[src_idx];
-            colors[dst_idx].w = a[src_idx];
-            weights[dst_idx] = (d->alphaMode == AlphaMode_Transparency) ? saturate(a[src_idx]) : 1.0f;
+            colors[dst_idx] = texels[dst_idx];
+            weights[dst_idx] = (d->alphaMode == AlphaMode_Transparency) ? saturate(colors[dst_idx].w) : 1.0f;
         }
         for (; x < 4; x++) {
             uint dst_idx = 4 * y + x;
@@ -161,12 +185,12 @@ void FloatColorCompressorTask(void * data, int i)
     }
     
     // Compress block.
-    uint8 * output = d->mem + (block_y * d->bw + block_x) * d->bs;
+    uint8 * output = d->mem + (size_t(i / d->bw) * d->bw + block_x) * d->bs;
     ((FloatColorCompressor *)d->compressor)->compressBlock(colors, weights, *d->compressionOptions, output);
 }
 
 
-void FloatColorCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * data, TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
+void FloatColorCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
 {
     nvDebugCheck(d == 1);   // @@ Add support for compressed 3D textures.
 
@@ -175,7 +199,7 @@ void FloatColorCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d,
     context.w = w;
     context.h = h;
     context.d = d;
-    context.data = data;
+    context.channels = channels;
     context.compressionOptions = &compressionOptions;
 
     context.bs = blockSize(compressionOptions);
@@ -193,15 +217,23 @@ void FloatColorCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d,
     dispatcher = &sequential;
 #endif
 
-    const uint count = context.bw * context.bh;
-    const uint size = context.bs * count;
-    context.mem = new uint8[size];
+    const uint band = min(bandHeight(context), context.bh);
+    context.mem = (uint8 *)pool_malloc(context.bs * context.bw * band);
+    context.texels = (Vector4 *)pool_malloc(sizeof(Vector4) * 16 * context.bw * band);
+
+    for (context.by = 0; context.by < context.bh; context.by += band) {
+        const uint rows = min(band, context.bh - context.by);
+        const uint count = context.bw * rows;
+        const uint size = context.bs * count;
 
-    dispatcher->dispatch(FloatColorCompressorTask, &context, count);
+        dispatcher->dispatch(GatherBlockRowTask, &context, rows);
+        dispatcher->dispatch(FloatColorCompressorTask, &context, count);
 
-    outputOptions.writeData(context.mem, size);
+        outputOptions.writeData(context.mem, size);
+    }
 
-    delete [] context.mem;
+    pool_free(context.texels);
+    pool_free(context.mem);
 }
 
 
@@ -361,7 +393,7 @@ void StbCompressorDXT1::compressBlock(ColorBlock & rgba, AlphaMode alphaMode, co
 #if defined(HAVE_ETCLIB)
 #include "Etc.h"
 
-void EtcLibCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * data, TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
+void EtcLibCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
 {
     //nvCheck(d == 1);  // Encode one layer at a time?
 
@@ -415,10 +447,10 @@ void EtcLibCompressor::compress(AlphaMode alphaMode, uint w, uint h, uint d, con
     uint count = w * h;
     tmp.resize(4 * count);
     for (uint i = 0; i < count; i++) {
-        tmp[4*i+0] = data[count*0 + i];
-        tmp[4*i+1] = data[count*1 + i];
-        tmp[4*i+2] = data[count*2 + i];
-        tmp[4*i+3] = data[count*3 + i];
+        tmp[4*i+0] = channels[0][i];
+        tmp[4*i+1] = channels[1][i];
+        tmp[4*i+2] = channels[2][i];
+        tmp[4*i+3] = channels[3][i];
     }
 
     Etc::Encode(tmp.buffer(), w, h, format, error_metric, effort, jobs, max_jobs, &out_data, &out_size, &out_width, &out_height, &out_time);
@@ -457,7 +489,7 @@ void RgEtcCompressor::compressBlock(ColorBlock & rgba, AlphaMode alphaMode, cons
 
 #if defined(HAVE_ETCPACK)
 
-void EtcPackCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions) 
+void EtcPackCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions) 
 {
     uint8 *imgdec = (uint8 *)malloc(expandedwidth*expandedheight * 3);
 
@@ -476,7 +508,7 @@ void EtcPackCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint
 #if defined(HAVE_ETCINTEL)
 #include "kernel_ispc.h"
 
-void EtcIntelCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
+void EtcIntelCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
 {
     nvCheck(d == 1);
 
@@ -486,10 +518,10 @@ void EtcIntelCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uin
     src.resize(4 * count);
 
     for (uint i = 0; i < count; i++) {
-        src[4 * i + 0] = data[count * 0 + i]; // @@ Scale by 256?
-        src[4 * i + 1] = data[count * 1 + i];
-        src[4 * i + 2] = data[count * 2 + i];
-        src[4 * i + 3] = data[count * 3 + i];
+        src[4 * i + 0] = channels[0][i]; // @@ Scale by 256?
+        src[4 * i + 1] = channels[1][i];
+        src[4 * i + 2] = channels[2][i];
+        src[4 * i + 3] = channels[3][i];
     }
 
     int bw = (w + 3) / 4;
@@ -516,7 +548,7 @@ void EtcIntelCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uin
 
 #include "nvmath/Color.inl"
 
-void CompressorPVR::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * data, TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
+void CompressorPVR::compress(AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], TaskDispatcher * dispatcher, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions)
 {
     EPVRTColourSpace color_space = ePVRTCSpacelRGB;
 
@@ -530,7 +562,7 @@ void CompressorPVR::compress(AlphaMode alphaMode, uint w, uint h, uint d, const
     tmp.resize(count);
 
     for (uint i = 0; i < count; i++) {
-        tmp[i] = toColor32(Vector4(data[0*count + i], data[1*count + i], data[2*count + i], data[3*count + i]));
+        tmp[i] = toColor32(Vector4(channels[0][i], channels[1][i], channels[2][i], channels[3][i]));
     }
     */
 
@@ -539,9 +571,9 @@ void CompressorPVR::compress(AlphaMode alphaMode, uint w, uint h, uint d, const
     tmp.resize(3 * count);
 
     for (uint i = 0; i < count; i++) {
-        tmp[3*i+0] = data[0*count + i] * 255.0f;
-        tmp[3*i+1] = data[1*count + i] * 255.0f;
-        tmp[3*i+2] = data[2*count + i] * 255.0f;
+        tmp[3*i+0] = channels[0][i] * 255.0f;
+        tmp[3*i+1] = channels[1][i] * 255.0f;
+        tmp[3*i+2] = channels[2][i] * 255.0f;
     }
 
     pvrtexture::CPVRTexture texture(header, tmp.buffer());
@@ -10,7 +10,7 @@ namespace nv
 
     struct ColorBlockCompressor : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
 
         virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output) = 0;
         virtual uint blockSize() const = 0;
@@ -18,7 +18,7 @@ namespace nv
 
     struct FloatColorCompressor : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
 
         virtual void compressBlock(Vector4 colors[16], float weights[16], const nvtt::CompressionOptions::Private & compressionOptions, void * output) = 0;
         virtual uint blockSize(const nvtt::CompressionOptions::Private & compressionOptions) const = 0;
@@ -50,11 +50,13 @@ namespace nv
     {
         virtual void compressBlock(Vector4 colors[16], float weights[16], const nvtt::CompressionOptions::Private & compressionOptions, void * output);
         virtual uint blockSize(const nvtt::CompressionOptions::Private & ) const { return 8; }
+        virtual uint channelCount() const { return 2; }
     };
     struct CompressorETC2_RG : public FloatColorCompressor
     {
         virtual void compressBlock(Vector4 colors[16], float weights[16], const nvtt::CompressionOptions::Private & compressionOptions, void * output);
         virtual uint blockSize(const nvtt::CompressionOptions::Private & ) const { return 16; }
+        virtual uint channelCount() const { return 2; }
     };
     struct CompressorETC2_RGB : public FloatColorCompressor
     {
@@ -121,7 +123,7 @@ namespace nv
 #if defined(HAVE_ETCLIB)
     struct EtcLibCompressor : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
     };
 #endif
 
@@ -136,21 +138,21 @@ namespace nv
 #if defined(HAVE_ETCPACK)
     struct EtcPackCompressor : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
     };
 #endif
 
 #if defined(HAVE_ETCINTEL)
     struct EtcIntelCompressor : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
     };
 #endif
 
 #if defined(HAVE_PVRTEXTOOL)
     struct CompressorPVR : public CompressorInterface
     {
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions);
     };
 #endif
 
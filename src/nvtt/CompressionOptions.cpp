@@ -70,6 +70,7 @@ void CompressionOptions::reset()
     m.enableAlphaDithering = false;
     m.binaryAlpha = false;
     m.alphaThreshold = 127;
+    m.ditherMode = DitherMode_FloydSteinberg;
 
     m.decoder = Decoder_D3D10;
 }
@@ -193,6 +194,14 @@ void CompressionOptions::setQuantization(bool colorDithering, bool alphaDitherin
     m.alphaThreshold = alphaThreshold;
 }
 
+/// Set the dithering method used when color or alpha dithering is enabled.
+/// Floyd-Steinberg is the default. The ordered and blue noise modes are faster, but
+/// their patterns are more visible.
+void CompressionOptions::setDitherMode(DitherMode mode)
+{
+    m.ditherMode = mode;
+}
+
 /// Set target decoder to optimize for.
 void CompressionOptions::setTargetDecoder(Decoder decoder)
 {
@@ -62,6 +62,7 @@ namespace nvtt
         bool enableAlphaDithering;
         bool binaryAlpha;
         int alphaThreshold;			// reference value used for binary alpha quantization.
+        DitherMode ditherMode;
 
         Decoder decoder;
 
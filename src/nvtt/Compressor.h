@@ -34,7 +34,10 @@ namespace nv
     struct CompressorInterface
     {
         virtual ~CompressorInterface() {}
-        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * rgba, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions) = 0;
+        virtual void compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions) = 0;
+
+        // Number of input channels read by the compressor, the remaining ones may be NULL.
+        virtual uint channelCount() const { return 4; }
     };
 
 } // nv namespace
@@ -36,12 +36,14 @@ namespace nv
 	{
 		virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
 		virtual uint blockSize() const { return 8; }
+		virtual uint channelCount() const { return 1; }
 	};
 
 	struct FastCompressorBC5 : public ColorBlockCompressor
 	{
 		virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
 		virtual uint blockSize() const { return 16; }
+		virtual uint channelCount() const { return 2; }
 	};
 
 
@@ -50,12 +52,14 @@ namespace nv
 	{
 		virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
 		virtual uint blockSize() const { return 8; }
+		virtual uint channelCount() const { return 1; }
 	};
 
 	struct ProductionCompressorBC5 : public ColorBlockCompressor
 	{
 		virtual void compressBlock(ColorBlock & rgba, nvtt::AlphaMode alphaMode, const nvtt::CompressionOptions::Private & compressionOptions, void * output);
 		virtual uint blockSize() const { return 16; }
+		virtual uint channelCount() const { return 2; }
 	};
 
     /*struct ProductionCompressorBC5_Luma : public ColorSetCompressor
@@ -55,7 +55,11 @@ void CompressorBC6::compressBlock(Vector4 colors[16], float weights[16], const C
         ZOH::Utils::FORMAT = ZOH::SIGNED_F16;
     }
 
-    // Convert NVTT's tile struct to ZOH's, and convert float to half.
+    // Convert float to half, all the texels at once.
+    uint16 halves[16 * 4];
+    half_from_float_array(&colors[0].x, halves, 16 * 4);
+
+    // Convert NVTT's tile struct to ZOH's.
     ZOH::Tile zohTile(4, 4);
     memset(zohTile.data, 0, sizeof(zohTile.data));
     memset(zohTile.importance_map, 0, sizeof(zohTile.importance_map));
@@ -63,13 +67,10 @@ void CompressorBC6::compressBlock(Vector4 colors[16], float weights[16], const C
     {
         for (uint x = 0; x < 4; ++x)
         {
-            Vector4 color = colors[4*y+x];
-            uint16 rHalf = to_half(color.x);
-            uint16 gHalf = to_half(color.y);
-            uint16 bHalf = to_half(color.z);
-            zohTile.data[y][x].x = ZOH::Tile::half2float(rHalf);
-            zohTile.data[y][x].y = ZOH::Tile::half2float(gHalf);
-            zohTile.data[y][x].z = ZOH::Tile::half2float(bHalf);
+            const uint16 * h = halves + 4 * (4*y+x);
+            zohTile.data[y][x].x = ZOH::Tile::half2float(h[0]);
+            zohTile.data[y][x].y = ZOH::Tile::half2float(h[1]);
+            zohTile.data[y][x].z = ZOH::Tile::half2float(h[2]);
             zohTile.importance_map[y][x] = weights[4*y+x];
         }
     }
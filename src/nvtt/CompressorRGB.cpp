@@ -25,6 +25,7 @@
 #include "CompressorRGB.h"
 #include "CompressionOptions.h"
 #include "OutputOptions.h"
+#include "TaskDispatcher.h"
 
 #include "nvimage/Image.h"
 #include "nvimage/FloatImage.h"
@@ -36,6 +37,13 @@
 #include "nvmath/Vector.inl"
 
 #include "nvcore/Debug.h"
+#include "nvcore/Memory.h"
+
+#include <string.h> // memcpy, memset
+
+#if NV_USE_SSE > 1
+#include <emmintrin.h> // SSE2
+#endif
 
 using namespace nv;
 using namespace nvtt;
@@ -328,7 +336,8 @@ namespace
             nvDebugCheck(bits < 8);
             nvDebugCheck(bitCount <= 32);
 
-            uint64 buffer = (this->buffer << bitCount) | p;
+            // Fields are packed starting at the least significant bit.
+            uint64 buffer = this->buffer | (uint64(p) << this->bits);
             uint bits = this->bits + bitCount;
 
             while (bits >= 8)
@@ -396,15 +405,288 @@ namespace
 
 
 
-void PixelFormatConverter::compress(nvtt::AlphaMode /*alphaMode*/, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
+namespace
+{
+    // Layout of the output pixels.
+    struct PixelLayout
+    {
+        nvtt::PixelType pixelType;
+        uint bitCount;
+        uint size[4];
+        uint shift[4];
+    };
+
+    // Generic conversion of a scanline, handles all layouts one bit field at a time.
+    static uint8 * convertScanline(const PixelLayout & layout, uint w, const float * const src[4], uint8 * dst)
+    {
+        const uint rsize = layout.size[0], gsize = layout.size[1], bsize = layout.size[2], asize = layout.size[3];
+        const uint bitCount = layout.bitCount;
+
+        BitStream stream(dst);
+
+        for (uint x = 0; x < w; x++)
+        {
+            float r = src[0][x];
+            float g = src[1][x];
+            float b = src[2][x];
+            float a = src[3][x];
+
+            if (layout.pixelType == nvtt::PixelType_Float)
+            {
+                if (rsize == 32) stream.putFloat(r);
+                else if (rsize == 16) stream.putHalf(r);
+                else if (rsize == 11) stream.putFloat11(r);
+                else if (rsize == 10) stream.putFloat10(r);
+                else stream.putBits(0, rsize);
+
+                if (gsize == 32) stream.putFloat(g);
+                else if (gsize == 16) stream.putHalf(g);
+                else if (gsize == 11) stream.putFloat11(g);
+                else if (gsize == 10) stream.putFloat10(g);
+                else stream.putBits(0, gsize);
+
+                if (bsize == 32) stream.putFloat(b);
+                else if (bsize == 16) stream.putHalf(b);
+                else if (bsize == 11) stream.putFloat11(b);
+                else if (bsize == 10) stream.putFloat10(b);
+                else stream.putBits(0, bsize);
+
+                if (asize == 32) stream.putFloat(a);
+                else if (asize == 16) stream.putHalf(a);
+                else if (asize == 11) stream.putFloat11(a);
+                else if (asize == 10) stream.putFloat10(a);
+                else stream.putBits(0, asize);
+            }
+            else if (layout.pixelType == nvtt::PixelType_SharedExp)
+            {
+                if (rsize == 9 && gsize == 9 && bsize == 9 && asize == 5) {
+                    Float3SE v = toFloat3SE(r, g, b);
+                    stream.putBits(v.v, 32);
+                }
+                else if (rsize == 8 && gsize == 8 && bsize == 8 && asize == 8) {
+                    // @@ 
+                }
+                else {
+                    // @@ Not supported. Filling with zeros.
+                    stream.putBits(0, bitCount);
+                }
+            }
+            else
+            {
+                // We first convert to 16 bits, then to the target size. @@ If greater than 16 bits, this will truncate and bitexpand.
+                
+                // @@ Add support for nvtt::PixelType_SignedInt, nvtt::PixelType_SignedNorm, nvtt::PixelType_UnsignedInt
+
+                int ir, ig, ib, ia;
+                if (layout.pixelType == nvtt::PixelType_UnsignedNorm) {
+                    ir = iround(clamp(r * 65535.0f, 0.0f, 65535.0f));
+                    ig = iround(clamp(g * 65535.0f, 0.0f, 65535.0f));
+                    ib = iround(clamp(b * 65535.0f, 0.0f, 65535.0f));
+                    ia = iround(clamp(a * 65535.0f, 0.0f, 65535.0f));
+                }
+                else if (layout.pixelType == nvtt::PixelType_SignedNorm) {
+                    // @@
+                    ir = ig = ib = ia = 0;
+                }
+                else if (layout.pixelType == nvtt::PixelType_UnsignedInt) {
+                    ir = iround(clamp(r, 0.0f, 65535.0f));
+                    ig = iround(clamp(g, 0.0f, 65535.0f));
+                    ib = iround(clamp(b, 0.0f, 65535.0f));
+                    ia = iround(clamp(a, 0.0f, 65535.0f));
+                }
+                else if (layout.pixelType == nvtt::PixelType_SignedInt) {
+                    // @@
+                    ir = ig = ib = ia = 0;
+                }
+                else {
+                    // @@
+                    ir = ig = ib = ia = 0;
+                }
+                
+                uint p = 0;
+                p |= PixelFormat::convert(ir, 16, rsize) << layout.shift[0];
+                p |= PixelFormat::convert(ig, 16, gsize) << layout.shift[1];
+                p |= PixelFormat::convert(ib, 16, bsize) << layout.shift[2];
+                p |= PixelFormat::convert(ia, 16, asize) << layout.shift[3];
+
+                stream.putBits(p, bitCount);
+            }
+        }
+
+        stream.flush();
+        return stream.ptr;
+    }
+
+    static inline uint packUNorm(const PixelLayout & layout, const float * const src[4], uint x)
+    {
+        uint p = 0;
+        for (uint c = 0; c < 4; c++) {
+            if (layout.size[c] != 0) {
+                uint i = iround(clamp(src[c][x] * 65535.0f, 0.0f, 65535.0f));
+                p |= (i >> (16 - layout.size[c])) << layout.shift[c];
+            }
+        }
+        return p;
+    }
+
+    // Normalized integer layouts with byte aligned pixels and fields of up to 16 bits, like RGBA8, BGRA8, RGB10A2 or RGB565.
+    static uint8 * convertScanlineUNorm(const PixelLayout & layout, uint w, const float * const src[4], uint8 * dst)
+    {
+        const uint byteCount = layout.bitCount / 8;
+        uint x = 0;
+
+#if NV_USE_SSE > 1
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(65535.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        for (; x + 4 <= w; x += 4)
+        {
+            __m128i p = _mm_setzero_si128();
+            for (uint c = 0; c < 4; c++) {
+                if (layout.size[c] == 0) continue;
+
+                // Same operations as the scalar path, so that the results are identical.
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(src[c] + x), scale);
+                v = _mm_min_ps(_mm_max_ps(v, zero), scale);
+                __m128i i = _mm_cvttps_epi32(_mm_add_ps(v, half));
+
+                i = _mm_srl_epi32(i, _mm_cvtsi32_si128(16 - layout.size[c]));
+                p = _mm_or_si128(p, _mm_sll_epi32(i, _mm_cvtsi32_si128(layout.shift[c])));
+            }
+
+            if (byteCount == 4) {
+                _mm_storeu_si128((__m128i *)dst, p);
+            }
+            else {
+                uint32 tmp[4];
+                _mm_storeu_si128((__m128i *)tmp, p);
+                for (uint i = 0; i < 4; i++) {
+                    for (uint b = 0; b < byteCount; b++) dst[i * byteCount + b] = uint8(tmp[i] >> (8 * b));
+                }
+            }
+            dst += 4 * byteCount;
+        }
+#endif
+
+        for (; x < w; x++)
+        {
+            const uint p = packUNorm(layout, src, x);
+            for (uint b = 0; b < byteCount; b++) *dst++ = uint8(p >> (8 * b));
+        }
+
+        return dst;
+    }
+
+    // Float layouts whose fields are all 16 or 32 bits, like RGBA16F, RG16F or RGBA32F.
+    static uint8 * convertScanlineFloat(const PixelLayout & layout, uint w, const float * const src[4], uint8 * dst)
+    {
+        // Convert the half channels a few texels at a time, then interleave.
+        uint16 half[4][256];
+
+        for (uint x0 = 0; x0 < w; x0 += 256)
+        {
+            const uint n = min(w - x0, 256U);
+
+            for (uint c = 0; c < 4; c++) {
+                if (layout.size[c] == 16) half_from_float_array(src[c] + x0, half[c], n);
+            }
+
+            for (uint x = 0; x < n; x++)
+            {
+                for (uint c = 0; c < 4; c++) {
+                    if (layout.size[c] == 32) {
+                        memcpy(dst, src[c] + x0 + x, 4);
+                        dst += 4;
+                    }
+                    else if (layout.size[c] == 16) {
+                        memcpy(dst, half[c] + x, 2);
+                        dst += 2;
+                    }
+                }
+            }
+        }
+        return dst;
+    }
+
+    static uint8 * convertScanlineR11G11B10F(const PixelLayout & layout, uint w, const float * const src[4], uint8 * dst)
+    {
+        for (uint x = 0; x < w; x++)
+        {
+            const uint32 p = toFloat11(src[0][x]) | (toFloat11(src[1][x]) << 11) | (toFloat10(src[2][x]) << 22);
+            memcpy(dst, &p, 4);
+            dst += 4;
+        }
+        return dst;
+    }
+
+    typedef uint8 * ConvertScanlineFunction(const PixelLayout & layout, uint w, const float * const src[4], uint8 * dst);
+
+    static ConvertScanlineFunction * chooseConverter(const PixelLayout & layout)
+    {
+        const uint * size = layout.size;
+
+        if (layout.pixelType == nvtt::PixelType_UnsignedNorm) {
+            const bool byteAligned = layout.bitCount != 0 && (layout.bitCount % 8) == 0;
+            if (byteAligned && size[0] <= 16 && size[1] <= 16 && size[2] <= 16 && size[3] <= 16) {
+                return convertScanlineUNorm;
+            }
+        }
+        else if (layout.pixelType == nvtt::PixelType_Float) {
+            bool wide = true;
+            for (uint c = 0; c < 4; c++) wide &= (size[c] == 0 || size[c] == 16 || size[c] == 32);
+            if (wide) return convertScanlineFloat;
+
+            if (size[0] == 11 && size[1] == 11 && size[2] == 10 && size[3] == 0) {
+                return convertScanlineR11G11B10F;
+            }
+        }
+
+        return convertScanline;
+    }
+
+    struct ConverterContext
+    {
+        const PixelLayout * layout;
+        ConvertScanlineFunction * convert;
+        uint w, h;
+        const float * const * channels;
+        uint pitch;
+        uint z, y;              // First scanline of the current band.
+        uint8 * mem;            // Converted scanlines of the current band.
+    };
+
+    // Each task converts one scanline.
+    static void ConvertScanlineTask(void * data, int i)
+    {
+        ConverterContext * d = (ConverterContext *) data;
+
+        const uint64 offset = (uint64(d->z) * d->h + d->y + i) * d->w;
+        const float * src[4] = { d->channels[0] + offset, d->channels[1] + offset, d->channels[2] + offset, d->channels[3] + offset };
+
+        uint8 * dst = d->mem + size_t(i) * d->pitch;
+        uint8 * end = d->convert(*d->layout, d->w, src, dst);
+        nvDebugCheck(end <= dst + d->pitch);
+
+        // Zero padding.
+        memset(end, 0, size_t(dst + d->pitch - end));
+    }
+
+    // Scanlines are converted and output in bands, so that the size of the intermediate buffer is bounded.
+    static const uint s_bandSize = 4 * 1024 * 1024;
+
+} // namespace
+
+
+void PixelFormatConverter::compress(nvtt::AlphaMode /*alphaMode*/, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
 {
     nvDebugCheck (compressionOptions.format == nvtt::Format_RGBA);
 
     uint bitCount;
-    uint rmask, rshift, rsize;
-    uint gmask, gshift, gsize;
-    uint bmask, bshift, bsize;
-    uint amask, ashift, asize;
+    uint rmask, rshift = 0, rsize;
+    uint gmask, gshift = 0, gsize;
+    uint bmask, bshift = 0, bsize;
+    uint amask, ashift = 0, asize;
 
     if (compressionOptions.pixelType == nvtt::PixelType_Float)
     {
@@ -460,117 +742,40 @@ void PixelFormatConverter::compress(nvtt::AlphaMode /*alphaMode*/, uint w, uint
         }
     }
 
-    const uint pitch = computeBytePitch(w, bitCount, compressionOptions.pitchAlignment);
-    const uint whd = w * h * d;
+    PixelLayout layout;
+    layout.pixelType = compressionOptions.pixelType;
+    layout.bitCount = bitCount;
+    layout.size[0] = rsize; layout.size[1] = gsize; layout.size[2] = bsize; layout.size[3] = asize;
+    layout.shift[0] = rshift; layout.shift[1] = gshift; layout.shift[2] = bshift; layout.shift[3] = ashift;
 
-    // Allocate output scanline.
-    uint8 * const dst = malloc<uint8>(pitch);
+    ConverterContext context;
+    context.layout = &layout;
+    context.convert = chooseConverter(layout);
+    context.w = w;
+    context.h = h;
+    context.channels = channels;
+    context.pitch = computeBytePitch(w, bitCount, compressionOptions.pitchAlignment);
 
-    for (uint z = 0; z < d; z++)
-    {
-        for (uint y = 0; y < h; y++)
-        {
-            const float * src = (const float *)data + (z * h + y) * w;
+    SequentialTaskDispatcher sequential;
 
-            BitStream stream(dst);
+    // Use a single thread to convert small textures.
+    if (h < 16) dispatcher = &sequential;
 
-            for (uint x = 0; x < w; x++)
-            {
-                float r = src[x + 0 * whd];
-                float g = src[x + 1 * whd];
-                float b = src[x + 2 * whd];
-                float a = src[x + 3 * whd];
+    const uint band = min(h, max(1U, s_bandSize / context.pitch));
+    context.mem = (uint8 *)pool_malloc(size_t(context.pitch) * band);
 
-                if (compressionOptions.pixelType == nvtt::PixelType_Float)
-                {
-                    if (rsize == 32) stream.putFloat(r);
-                    else if (rsize == 16) stream.putHalf(r);
-                    else if (rsize == 11) stream.putFloat11(r);
-                    else if (rsize == 10) stream.putFloat10(r);
-                    else stream.putBits(0, rsize);
-
-                    if (gsize == 32) stream.putFloat(g);
-                    else if (gsize == 16) stream.putHalf(g);
-                    else if (gsize == 11) stream.putFloat11(g);
-                    else if (gsize == 10) stream.putFloat10(g);
-                    else stream.putBits(0, gsize);
-
-                    if (bsize == 32) stream.putFloat(b);
-                    else if (bsize == 16) stream.putHalf(b);
-                    else if (bsize == 11) stream.putFloat11(b);
-                    else if (bsize == 10) stream.putFloat10(b);
-                    else stream.putBits(0, bsize);
-
-                    if (asize == 32) stream.putFloat(a);
-                    else if (asize == 16) stream.putHalf(a);
-                    else if (asize == 11) stream.putFloat11(a);
-                    else if (asize == 10) stream.putFloat10(a);
-                    else stream.putBits(0, asize);
-                }
-                else if (compressionOptions.pixelType == nvtt::PixelType_SharedExp)
-                {
-                    if (rsize == 9 && gsize == 9 && bsize == 9 && asize == 5) {
-                        Float3SE v = toFloat3SE(r, g, b);
-                        stream.putBits(v.v, 32);
-                    }
-                    else if (rsize == 8 && gsize == 8 && bsize == 8 && asize == 8) {
-                        // @@ 
-                    }
-                    else {
-                        // @@ Not supported. Filling with zeros.
-                        stream.putBits(0, bitCount);
-                    }
-                }
-                else
-                {
-                    // We first convert to 16 bits, then to the target size. @@ If greater than 16 bits, this will truncate and bitexpand.
-                    
-                    // @@ Add support for nvtt::PixelType_SignedInt, nvtt::PixelType_SignedNorm, nvtt::PixelType_UnsignedInt
-
-                    int ir, ig, ib, ia;
-                    if (compressionOptions.pixelType == nvtt::PixelType_UnsignedNorm) {
-                        ir = iround(clamp(r * 65535.0f, 0.0f, 65535.0f));
-                        ig = iround(clamp(g * 65535.0f, 0.0f, 65535.0f));
-                        ib = iround(clamp(b * 65535.0f, 0.0f, 65535.0f));
-                        ia = iround(clamp(a * 65535.0f, 0.0f, 65535.0f));
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_SignedNorm) {
-                        // @@
-                        ir = ig = ib = ia = 0;
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_UnsignedInt) {
-                        ir = iround(clamp(r, 0.0f, 65535.0f));
-                        ig = iround(clamp(g, 0.0f, 65535.0f));
-                        ib = iround(clamp(b, 0.0f, 65535.0f));
-                        ia = iround(clamp(a, 0.0f, 65535.0f));
-                    }
-                    else if (compressionOptions.pixelType == nvtt::PixelType_SignedInt) {
-                        // @@
-                        ir = ig = ib = ia = 0;
-                    }
-                    else {
-                        // @@
-                        ir = ig = ib = ia = 0;
-                    }
-                    
-                    uint p = 0;
-                    p |= PixelFormat::convert(ir, 16, rsize) << rshift;
-                    p |= PixelFormat::convert(ig, 16, gsize) << gshift;
-                    p |= PixelFormat::convert(ib, 16, bsize) << bshift;
-                    p |= PixelFormat::convert(ia, 16, asize) << ashift;
-
-                    stream.putBits(p, bitCount);
-                }
-            }
+    for (context.z = 0; context.z < d; context.z++)
+    {
+        for (context.y = 0; context.y < h; context.y += band)
+        {
+            const uint count = min(band, h - context.y);
 
-            // Zero padding.
-            stream.align(compressionOptions.pitchAlignment);
-            nvDebugCheck(stream.ptr == dst + pitch);
+            dispatcher->dispatch(ConvertScanlineTask, &context, count);
 
             // Scanlines are always byte-aligned.
-            outputOptions.writeData(dst, pitch);
+            outputOptions.writeData(context.mem, context.pitch * count);
         }
     }
 
-    free(dst);
+    pool_free(context.mem);
 }
@@ -51,6 +51,9 @@
 #include "nvimage/PixelFormat.h"
 #include "nvimage/ColorSpace.h"
 
+#include "nvthread/Atomic.h"
+#include "nvthread/Mutex.h"
+
 #include "nvcore/Memory.h"
 #include "nvcore/Ptr.h"
 #include "nvcore/Array.inl"
@@ -186,7 +189,10 @@ bool Compressor::outputHeader(TextureType type, int w, int h, int d, int arraySi
 
 bool Compressor::compress(int w, int h, int d, int face, int mipmap, const float * rgba, const CompressionOptions & compressionOptions, const OutputOptions & outputOptions) const
 {
-    return m.compress(AlphaMode_None, w, h, d, face, mipmap, rgba, compressionOptions.m, outputOptions.m);
+    const uint64 count = uint64(w) * h * d;
+    const float * channels[4] = { rgba, rgba + count, rgba + 2 * count, rgba + 3 * count };
+
+    return m.compress(AlphaMode_None, w, h, d, face, mipmap, channels, compressionOptions.m, outputOptions.m);
 }
 
 int Compressor::estimateSize(int w, int h, int d, int mipmapCount, const CompressionOptions & compressionOptions) const
@@ -476,15 +482,132 @@ bool Compressor::Private::compress(const InputOptions::Private & inputOptions, c
 
 bool Compressor::Private::compress(const Surface & tex, int face, int mipmap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
 {
-    if (!compress(tex.alphaMode(), tex.width(), tex.height(), tex.depth(), face, mipmap, tex.data(), compressionOptions, outputOptions)) {
+    if (tex.storagePrecision() != StoragePrecision_Float) {
+        // Expand a temporary copy, so that the input surface keeps its compact storage.
+        Surface tmp = tex;
+        tmp.setStoragePrecision(StoragePrecision_Float);
+        return compress(tmp, face, mipmap, compressionOptions, outputOptions);
+    }
+
+    // Channels are not necessarily contiguous, the compressors address them individually.
+    // Channels the surface doesn't store are passed as NULL.
+    const FloatImage * img = tex.m->image;
+    const float * channels[4] = { NULL, NULL, NULL, NULL };
+    for (uint c = 0; c < min(img->componentCount(), 4U); c++) {
+        channels[c] = img->channel(c);
+    }
+
+    if (!compress(tex.alphaMode(), tex.width(), tex.height(), tex.depth(), face, mipmap, channels, compressionOptions, outputOptions)) {
         return false;
     }
 
     return true;
 }
 
-bool Compressor::Private::compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * rgba, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
+namespace
 {
+    // Forwards the data of one image to its location in the texture, or to writeData if the handler does not support
+    // positioned writes.
+    struct PositionedOutputHandler : public OutputHandler
+    {
+        PositionedOutputHandler(const OutputOptions::Private & options, uint64 offset) : options(options), handler(options.outputHandler), offset(offset), written(0), positioned(true) {}
+
+        virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel)
+        {
+            handler->beginImage(size, width, height, depth, face, miplevel);
+        }
+
+        virtual bool writeData(const void * data, int size)
+        {
+            if (positioned) {
+                if (handler->writeDataAt(offset + written, data, size)) {
+                    written += size;
+                    if (loadAcquire(&options.positioned) == 0) storeRelease(&options.positioned, 1);
+                    return true;
+                }
+
+                // Only fall back if nothing was placed yet, sequential writes would overwrite the start of the texture.
+                if (loadAcquire(&options.positioned) != 0) return false;
+                positioned = false;
+            }
+
+            return handler->writeData(data, size);
+        }
+
+        virtual void endImage()
+        {
+            handler->endImage();
+        }
+
+        const OutputOptions::Private & options;
+        OutputHandler * handler;
+        uint64 offset;
+        uint64 written;
+        bool positioned;
+    };
+
+    static Mutex & layoutMutex()
+    {
+        static Mutex mutex("Output layout");
+        return mutex;
+    }
+
+    // Offset of the given image in the DDS texture whose header started the output, same layout as
+    // DirectDrawSurface::offset. Images that are not part of that texture are placed after it, in the space they
+    // reserve here, so that several threads can compress into the same output options.
+    static void imageOffset(const OutputOptions::Private & outputOptions, const CompressionOptions::Private & compressionOptions, int w, int h, int d, int face, int mipmap, uint64 * offset)
+    {
+        nvDebugCheck(outputOptions.hasLayout);
+
+        const uint bitCount = compressionOptions.getBitCount();
+
+        bool found = false;
+        uint64 faceSize = 0, mipmapOffset = 0;
+        int mw = outputOptions.layoutWidth;
+        int mh = outputOptions.layoutHeight;
+        int md = outputOptions.layoutDepth;
+        for (int m = 0; m < outputOptions.layoutMipmapCount; m++) {
+            if (m == mipmap && mw == w && mh == h && md == d) {
+                found = true;
+                mipmapOffset = faceSize;
+            }
+
+            faceSize += computeImageSize(mw, mh, md, bitCount, compressionOptions.pitchAlignment, compressionOptions.format);
+
+            mw = max(1, mw / 2);
+            mh = max(1, mh / 2);
+            md = max(1, md / 2);
+        }
+
+        if (found && face >= 0 && face < outputOptions.layoutFaceCount) {
+            *offset = outputOptions.layoutOffset + uint64(face) * faceSize + mipmapOffset;
+            return;
+        }
+
+        const uint64 imageSize = computeImageSize(w, h, d, bitCount, compressionOptions.pitchAlignment, compressionOptions.format);
+
+        Lock<Mutex> lock(layoutMutex());
+        *offset = max(outputOptions.layoutEnd, outputOptions.layoutOffset + uint64(outputOptions.layoutFaceCount) * faceSize);
+        outputOptions.layoutEnd = *offset + imageSize;
+    }
+}
+
+bool Compressor::Private::compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * const channels[4], const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const
+{
+    // Write the image at its final location when possible, so that the images can be compressed in any order.
+    if (outputOptions.hasLayout && outputOptions.outputHandler != NULL) {
+        uint64 offset;
+        imageOffset(outputOptions, compressionOptions, w, h, d, face, mipmap, &offset);
+
+        PositionedOutputHandler positionedHandler(outputOptions, offset);
+
+        OutputOptions::Private positionedOptions(outputOptions);
+        positionedOptions.outputHandler = &positionedHandler;
+        positionedOptions.hasLayout = false;
+
+        return compress(alphaMode, w, h, d, face, mipmap, channels, compressionOptions, positionedOptions);
+    }
+
     int size = computeImageSize(w, h, d, compressionOptions.getBitCount(), compressionOptions.pitchAlignment, compressionOptions.format);
     outputOptions.beginImage(size, w, h, d, face, mipmap);
 
@@ -507,7 +630,22 @@ bool Compressor::Private::compress(AlphaMode alphaMode, int w, int h, int d, int
     }
     else
     {
-        compressor->compress(alphaMode, w, h, d, rgba, dispatcher, compressionOptions, outputOptions);
+        // Substitute zeros for the missing channels the compressor reads. The plane is an image so that its size is not
+        // limited to 32 bits.
+        FloatImage zero;
+        const float * input[4];
+        for (uint c = 0; c < 4; c++) {
+            input[c] = channels[c];
+            if (input[c] == NULL && c < compressor->channelCount()) {
+                if (zero.componentCount() == 0) {
+                    zero.allocate(1, w, h, d);
+                    zero.clear(0, 0.0f);
+                }
+                input[c] = zero.channel(0);
+            }
+        }
+
+        compressor->compress(alphaMode, w, h, d, input, dispatcher, compressionOptions, outputOptions);
     }
 
     outputOptions.endImage();
@@ -520,23 +658,23 @@ void Compressor::Private::quantize(Surface & img, const CompressionOptions::Priv
 {
     if (compressionOptions.enableColorDithering) {
         if (compressionOptions.format >= Format_BC1 && compressionOptions.format <= Format_BC3) {
-            img.quantize(0, 5, true, true);
-            img.quantize(1, 6, true, true);
-            img.quantize(2, 5, true, true);
+            img.quantize(0, 5, true, compressionOptions.ditherMode);
+            img.quantize(1, 6, true, compressionOptions.ditherMode);
+            img.quantize(2, 5, true, compressionOptions.ditherMode);
         }
         else if (compressionOptions.format == Format_RGB) {
-            img.quantize(0, compressionOptions.rsize, true, true);
-            img.quantize(1, compressionOptions.gsize, true, true);
-            img.quantize(2, compressionOptions.bsize, true, true);
+            img.quantize(0, compressionOptions.rsize, true, compressionOptions.ditherMode);
+            img.quantize(1, compressionOptions.gsize, true, compressionOptions.ditherMode);
+            img.quantize(2, compressionOptions.bsize, true, compressionOptions.ditherMode);
         }
     }
     if (compressionOptions.enableAlphaDithering) {
         if (compressionOptions.format == Format_RGB) {
-            img.quantize(3, compressionOptions.asize, true, true);
+            img.quantize(3, compressionOptions.asize, true, compressionOptions.ditherMode);
         }
     }
     else if (compressionOptions.binaryAlpha) {
-        img.binarize(3, float(compressionOptions.alphaThreshold)/255.0f, compressionOptions.enableAlphaDithering);
+        img.binarize(3, float(compressionOptions.alphaThreshold)/255.0f, compressionOptions.enableAlphaDithering ? compressionOptions.ditherMode : DitherMode_None);
     }
 }
 
@@ -609,6 +747,8 @@ bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int
         return false;
     }
 
+    outputOptions.hasLayout = false;
+
     if (!outputOptions.outputHeader)
     {
         return true;
@@ -865,6 +1005,16 @@ bool Compressor::Private::outputHeader(nvtt::TextureType textureType, int w, int
             outputOptions.error(Error_FileWrite);
         }
 
+        // When the header starts the output the location of every image is known.
+        outputOptions.hasLayout = writeSucceed && outputOptions.position == headerSize;
+        outputOptions.layoutOffset = headerSize;
+        outputOptions.layoutEnd = 0;
+        outputOptions.layoutWidth = w;
+        outputOptions.layoutHeight = h;
+        outputOptions.layoutDepth = d;
+        outputOptions.layoutFaceCount = (textureType == TextureType_Cube ? 6 : 1) * arraySize;
+        outputOptions.layoutMipmapCount = mipmapCount;
+
         return writeSucceed;
     }
     else if (outputOptions.container == Container_KTX) 
@@ -47,7 +47,7 @@ namespace nvtt
 
         bool compress(const InputOptions::Private & inputOptions, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
         bool compress(const Surface & tex, int face, int mipmap, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
-        bool compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * data, const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
+        bool compress(AlphaMode alphaMode, int w, int h, int d, int face, int mipmap, const float * const channels[4], const CompressionOptions::Private & compressionOptions, const OutputOptions::Private & outputOptions) const;
 
         void quantize(Surface & tex, const CompressionOptions::Private & compressionOptions) const;
 
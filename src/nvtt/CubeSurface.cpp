@@ -25,12 +25,20 @@
 #include "Surface.h"
 
 #include "nvimage/DirectDrawSurface.h"
+#include "nvimage/Filter.h"
 
 #include "nvmath/Vector.inl"
+#include "nvmath/ftoi.h"
+
+#include "nvthread/ParallelFor.h"
 
 #include "nvcore/Array.inl"
 #include "nvcore/StrLib.h"
 
+#if NV_USE_SSE > 1
+#include <emmintrin.h> // SSE2
+#endif
+
 using namespace nv;
 using namespace nvtt;
 
@@ -373,6 +381,25 @@ bool CubeSurface::save(const char * fileName) const
     return false;
 }
 
+// Face and texel coordinates of a cube with the given edge length that are seen in the given direction. Texel centers
+// are at integer coordinates.
+static void cubeTexelCoordinates(const Vector3 & dir, int edgeLength, int * face, float * x, float * y)
+{
+    int f;
+    if (fabsf(dir.x) >= fabsf(dir.y) && fabsf(dir.x) >= fabsf(dir.z)) f = dir.x > 0 ? 0 : 1;
+    else if (fabsf(dir.y) >= fabsf(dir.z)) f = dir.y > 0 ? 2 : 3;
+    else f = dir.z > 0 ? 4 : 5;
+
+    // Project onto the face plane, this is the inverse of texelDirection.
+    const float scale = 1.0f / dot(dir, faceNormals[f]);
+    const float u = dot(dir, faceU[f]) * scale;
+    const float v = dot(dir, faceV[f]) * scale;
+
+    *face = f;
+    *x = (u + 1) * 0.5f * edgeLength - 0.5f;
+    *y = (v + 1) * 0.5f * edgeLength - 0.5f;
+}
+
 struct ivec2 {
     uint x;
     uint y;
@@ -383,6 +410,283 @@ static const ivec2 foldOffsetHorizontalCross[6] = { {2, 1}, {0, 1}, {1, 0}, {1,
 static const ivec2 foldOffsetColumn[6]          = { {0, 0}, {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5} };
 static const ivec2 foldOffsetRow[6]             = { {0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0} };
 
+// The latitude-longitude layout maps x to the longitude, with +Z at the center and +X to its right, and y to the
+// colatitude, from +Y to -Y. The faces have the resolution of the equator, so the layout is 4 faces wide and 2 high.
+
+#if NV_USE_SSE > 1
+
+// atan2 of 4 values, Abramowitz and Stegun 4.4.49, error below 1e-7 radians.
+static __m128 atan2_sse(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 ax = _mm_andnot_ps(signMask, x);
+    const __m128 ay = _mm_andnot_ps(signMask, y);
+
+    const __m128 mx = _mm_max_ps(ax, ay);
+    const __m128 mn = _mm_min_ps(ax, ay);
+    const __m128 a = _mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, _mm_setzero_ps()));
+    const __m128 s = _mm_mul_ps(a, a);
+
+    __m128 r = _mm_set1_ps(0.0028662257f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.0161657367f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.0429096138f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.0752896400f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.1065626393f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.1420889944f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.1999355085f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.3333314528f));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+    // Undo the octant reduction.
+    const __m128 steep = _mm_cmpgt_ps(ay, ax);
+    r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(PI / 2), r)), _mm_andnot_ps(steep, r));
+    const __m128 left = _mm_cmplt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(_mm_set1_ps(PI), r)), _mm_andnot_ps(left, r));
+    return _mm_or_ps(r, _mm_and_ps(signMask, y));
+}
+
+#endif
+
+// Texel coordinates in a latitude-longitude image of size w*h that correspond to the row y of a cube face. Texel
+// centers are at integer coordinates.
+static void latitudeLongitudeCoordinates(uint f, uint y, uint edgeLength, uint w, uint h, float * __restrict sx, float * __restrict sy)
+{
+    const float v = (float(y) + 0.5f) * (2.0f / edgeLength) - 1.0f;
+    const Vector3 base = faceNormals[f] + v * faceV[f];
+    const Vector3 & du = faceU[f];
+
+    const float xScale = w / (2 * PI);
+    const float xOffset = 0.5f * w - 0.5f;
+    const float yScale = h / PI;
+
+    uint x = 0;
+
+#if NV_USE_SSE > 1
+    const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 uScale = _mm_set1_ps(2.0f / edgeLength);
+
+    for (; x + 4 <= edgeLength; x += 4) {
+        const __m128 u = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(x)), lane), uScale), _mm_set1_ps(1.0f));
+
+        const __m128 dx = _mm_add_ps(_mm_set1_ps(base.x), _mm_mul_ps(u, _mm_set1_ps(du.x)));
+        const __m128 dy = _mm_add_ps(_mm_set1_ps(base.y), _mm_mul_ps(u, _mm_set1_ps(du.y)));
+        const __m128 dz = _mm_add_ps(_mm_set1_ps(base.z), _mm_mul_ps(u, _mm_set1_ps(du.z)));
+
+        const __m128 longitude = atan2_sse(dx, dz);
+        const __m128 colatitude = atan2_sse(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz))), dy);
+
+        _mm_storeu_ps(sx + x, _mm_add_ps(_mm_mul_ps(longitude, _mm_set1_ps(xScale)), _mm_set1_ps(xOffset)));
+        _mm_storeu_ps(sy + x, _mm_sub_ps(_mm_mul_ps(colatitude, _mm_set1_ps(yScale)), _mm_set1_ps(0.5f)));
+    }
+#endif
+
+    for (; x < edgeLength; x++) {
+        const float u = (float(x) + 0.5f) * (2.0f / edgeLength) - 1.0f;
+        const Vector3 dir = base + u * du;
+
+        sx[x] = atan2f(dir.x, dir.z) * xScale + xOffset;
+        sy[x] = atan2f(sqrtf(dir.x * dir.x + dir.z * dir.z), dir.y) * yScale - 0.5f;
+    }
+}
+
+// Face and texel coordinates of the cube that correspond to the row y of a latitude-longitude image. The sine and cosine
+// of the longitude of each column are given.
+static void cubeCoordinates(uint y, uint w, uint h, uint edgeLength, const float * sinLongitude, const float * cosLongitude, int * __restrict face, float * __restrict sx, float * __restrict sy)
+{
+    const float colatitude = (float(y) + 0.5f) * PI / h;
+    const float sinColatitude = sinf(colatitude);
+    const float cosColatitude = cosf(colatitude);
+
+    const float scale = 0.5f * edgeLength;
+
+    uint x = 0;
+
+#if NV_USE_SSE > 1
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (; x + 4 <= w; x += 4) {
+        const __m128 dx = _mm_mul_ps(_mm_set1_ps(sinColatitude), _mm_loadu_ps(sinLongitude + x));
+        const __m128 dy = _mm_set1_ps(cosColatitude);
+        const __m128 dz = _mm_mul_ps(_mm_set1_ps(sinColatitude), _mm_loadu_ps(cosLongitude + x));
+
+        const __m128 ax = _mm_andnot_ps(signMask, dx);
+        const __m128 ay = _mm_andnot_ps(signMask, dy);
+        const __m128 az = _mm_andnot_ps(signMask, dz);
+
+        // Same major axis selection as cubeTexelCoordinates.
+        const __m128 isX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+        const __m128 isY = _mm_andnot_ps(isX, _mm_cmpge_ps(ay, az));
+        const __m128 isZ = _mm_andnot_ps(_mm_or_ps(isX, isY), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+        const __m128 major = _mm_or_ps(_mm_or_ps(_mm_and_ps(isX, dx), _mm_and_ps(isY, dy)), _mm_and_ps(isZ, dz));
+        const __m128 negative = _mm_and_ps(signMask, major);
+
+        // Face coordinates before the division by the major axis, see faceU and faceV.
+        const __m128 ux = _mm_xor_ps(_mm_sub_ps(_mm_setzero_ps(), dz), negative);
+        const __m128 uz = _mm_xor_ps(dx, negative);
+        const __m128 vy = _mm_xor_ps(dz, negative);
+        const __m128 u = _mm_or_ps(_mm_and_ps(isX, ux), _mm_andnot_ps(isX, _mm_or_ps(_mm_and_ps(isY, dx), _mm_and_ps(isZ, uz))));
+        const __m128 v = _mm_or_ps(_mm_and_ps(isY, vy), _mm_andnot_ps(isY, _mm_sub_ps(_mm_setzero_ps(), dy)));
+
+        const __m128 rcp = _mm_div_ps(_mm_set1_ps(scale), _mm_andnot_ps(signMask, major));
+        const __m128 offset = _mm_set1_ps(scale - 0.5f);
+        _mm_storeu_ps(sx + x, _mm_add_ps(_mm_mul_ps(u, rcp), offset));
+        _mm_storeu_ps(sy + x, _mm_add_ps(_mm_mul_ps(v, rcp), offset));
+
+        const __m128i axis = _mm_or_si128(_mm_and_si128(_mm_castps_si128(isY), _mm_set1_epi32(2)), _mm_and_si128(_mm_castps_si128(isZ), _mm_set1_epi32(4)));
+        const __m128i sign = _mm_srli_epi32(_mm_castps_si128(negative), 31);
+        _mm_storeu_si128((__m128i *)(face + x), _mm_add_epi32(axis, sign));
+    }
+#endif
+
+    for (; x < w; x++) {
+        const Vector3 dir(sinColatitude * sinLongitude[x], cosColatitude, sinColatitude * cosLongitude[x]);
+
+        float u, v;
+        cubeTexelCoordinates(dir, edgeLength, face + x, &u, &v);
+        sx[x] = u;
+        sy[x] = v;
+    }
+}
+
+// Bilinear sample of all the channels of the image, wrapping or clamping the x coordinate.
+static void sampleLinear(const FloatImage * img, float x, float y, bool wrapX, float * color)
+{
+    const int w = img->width();
+    const int h = img->height();
+
+    const int x0 = ifloor(x);
+    const int y0 = ifloor(y);
+    const float fx = x - x0;
+    const float fy = y - y0;
+
+    int ix0, ix1;
+    if (wrapX) {
+        ix0 = x0 % w; if (ix0 < 0) ix0 += w;
+        ix1 = ix0 + 1; if (ix1 == w) ix1 = 0;
+    }
+    else {
+        ix0 = nv::clamp(x0, 0, w - 1);
+        ix1 = nv::clamp(x0 + 1, 0, w - 1);
+    }
+    const int iy0 = nv::clamp(y0, 0, h - 1);
+    const int iy1 = nv::clamp(y0 + 1, 0, h - 1);
+
+    for (uint c = 0; c < 4; c++) {
+        color[c] = img->bilerp(c, ix0, iy0, ix1, iy1, fx, fy);
+    }
+}
+
+static void foldLatitudeLongitude(const FloatImage * img, CubeSurface::Private * cube)
+{
+    const uint edgeLength = cube->edgeLength;
+    const uint w = img->width();
+    const uint h = img->height();
+
+    parallel_for(6 * edgeLength, [&](int row) {
+        const uint f = row / edgeLength;
+        const uint y = row % edgeLength;
+
+        Array<float> coordinates;
+        coordinates.resize(2 * edgeLength);
+        float * sx = coordinates.buffer();
+        float * sy = sx + edgeLength;
+
+        latitudeLongitudeCoordinates(f, y, edgeLength, w, h, sx, sy);
+
+        FloatImage * faceImage = cube->face[f].m->image;
+        for (uint x = 0; x < edgeLength; x++) {
+            float color[4];
+            sampleLinear(img, sx[x], sy[x], /*wrapX=*/true, color);
+            for (uint c = 0; c < 4; c++) faceImage->pixel(c, x, y, 0) = color[c];
+        }
+    });
+}
+
+static void unfoldLatitudeLongitude(const CubeSurface::Private * cube, FloatImage * img)
+{
+    const uint edgeLength = cube->edgeLength;
+    const uint w = img->width();
+    const uint h = img->height();
+
+    Array<float> longitudeTable;
+    longitudeTable.resize(2 * w);
+    float * sinLongitude = longitudeTable.buffer();
+    float * cosLongitude = sinLongitude + w;
+    for (uint x = 0; x < w; x++) {
+        const float longitude = ((float(x) + 0.5f) / w - 0.5f) * (2 * PI);
+        sinLongitude[x] = sinf(longitude);
+        cosLongitude[x] = cosf(longitude);
+    }
+
+    parallel_for(h, [&](int y) {
+        Array<float> coordinates;
+        coordinates.resize(2 * w);
+        float * sx = coordinates.buffer();
+        float * sy = sx + w;
+
+        Array<int> face;
+        face.resize(w);
+
+        cubeCoordinates(y, w, h, edgeLength, sinLongitude, cosLongitude, face.buffer(), sx, sy);
+
+        for (uint x = 0; x < w; x++) {
+            float color[4];
+            sampleLinear(cube->face[face[x]].m->image, sx[x], sy[x], /*wrapX=*/false, color);
+            for (uint c = 0; c < 4; c++) img->pixel(c, x, y, 0) = color[c];
+        }
+    });
+}
+
+// The back face is rotated 180 degrees in the vertical cross.
+static void foldRows(const FloatImage * img, const ivec2 * offsets, bool rotateBackFace, CubeSurface::Private * cube)
+{
+    const uint edgeLength = cube->edgeLength;
+
+    parallel_for(6 * edgeLength, [&](int row) {
+        const uint f = row / edgeLength;
+        const uint y = row % edgeLength;
+        const uint x0 = offsets[f].x * edgeLength;
+        const uint y0 = offsets[f].y * edgeLength;
+
+        FloatImage * faceImage = cube->face[f].m->image;
+        for (uint c = 0; c < 4; c++) {
+            float * dst = faceImage->scanline(c, y, 0);
+            if (f == 5 && rotateBackFace) {
+                const float * src = img->scanline(c, y0 + edgeLength - 1 - y, 0) + x0;
+                for (uint x = 0; x < edgeLength; x++) dst[x] = src[edgeLength - 1 - x];
+            }
+            else {
+                memcpy(dst, img->scanline(c, y0 + y, 0) + x0, edgeLength * sizeof(float));
+            }
+        }
+    });
+}
+
+static void unfoldRows(const CubeSurface::Private * cube, const ivec2 * offsets, bool rotateBackFace, FloatImage * img)
+{
+    const uint edgeLength = cube->edgeLength;
+
+    parallel_for(6 * edgeLength, [&](int row) {
+        const uint f = row / edgeLength;
+        const uint y = row % edgeLength;
+        const uint x0 = offsets[f].x * edgeLength;
+        const uint y0 = offsets[f].y * edgeLength;
+
+        const FloatImage * faceImage = cube->face[f].m->image;
+        for (uint c = 0; c < 4; c++) {
+            const float * src = faceImage->scanline(c, y, 0);
+            if (f == 5 && rotateBackFace) {
+                float * dst = img->scanline(c, y0 + edgeLength - 1 - y, 0) + x0;
+                for (uint x = 0; x < edgeLength; x++) dst[edgeLength - 1 - x] = src[x];
+            }
+            else {
+                memcpy(img->scanline(c, y0 + y, 0) + x0, src, edgeLength * sizeof(float));
+            }
+        }
+    });
+}
+
 void CubeSurface::fold(const Surface & tex, CubeLayout layout)
 {
     ivec2 const* offsets = 0;
@@ -390,6 +694,8 @@ void CubeSurface::fold(const Surface & tex, CubeLayout layout)
 
     switch(layout) {
         case CubeLayout_LatitudeLongitude:
+            edgeLength = tex.height() / 2;
+            break;
         case CubeLayout_VerticalCross:
             edgeLength = tex.height() / 4;
             offsets = foldOffsetVerticalCross;
@@ -408,22 +714,43 @@ void CubeSurface::fold(const Surface & tex, CubeLayout layout)
             break;
     }
 
-    m->edgeLength = edgeLength;
-    for(uint f = 0; f < 6; f++) {
-        uint x = offsets[f].x * edgeLength;
-        uint y = offsets[f].y * edgeLength;
-        m->face[f] = tex.createSubImage(x, x + edgeLength - 1, y, y + edgeLength - 1, 0, 0);
+    CubeSurface cube;
+    if (tex.isNull() || edgeLength == 0) {
+        *this = cube;
+        return;
     }
 
-    if(layout == CubeLayout_VerticalCross || layout == CubeLayout_LatitudeLongitude) {
-        // Back face needs to be rotated 180 degrees
-        m->face[5].flipX();
-        m->face[5].flipY();
+    // The faces of the layout must be inside the image, they are copied a row at a time.
+    if (offsets != NULL) {
+        uint w = 0, h = 0;
+        for (uint f = 0; f < 6; f++) {
+            w = max(w, (offsets[f].x + 1) * edgeLength);
+            h = max(h, (offsets[f].y + 1) * edgeLength);
+        }
+        if (uint(tex.width()) < w || uint(tex.height()) < h) {
+            *this = cube;
+            return;
+        }
+    }
+
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = tex.m->readImage(4, tmp);
+    cube.m->allocate(edgeLength);
+
+    if (layout == CubeLayout_LatitudeLongitude) {
+        foldLatitudeLongitude(img, cube.m);
+    }
+    else {
+        foldRows(img, offsets, layout == CubeLayout_VerticalCross, cube.m);
     }
+
+    *this = cube;
 }
 
 Surface CubeSurface::unfold(CubeLayout layout) const
 {
+    m->updateEdgeLength();
+
     ivec2 const* offsets = 0;
     uint edgeLength = m->edgeLength;
     uint width;
@@ -431,13 +758,13 @@ Surface CubeSurface::unfold(CubeLayout layout) const
 
     switch(layout) {
         case CubeLayout_LatitudeLongitude:
+            width = 4 * edgeLength;
+            height = 2 * edgeLength;
+            break;
         case CubeLayout_VerticalCross:
             offsets = foldOffsetVerticalCross;
             width = 3 * edgeLength;
             height = 4 * edgeLength;
-            // Back face needs to be rotated 180 degrees
-            m->face[5].flipX();
-            m->face[5].flipY();
             break;
         case CubeLayout_HorizontalCross:
             offsets = foldOffsetHorizontalCross;
@@ -457,18 +784,19 @@ Surface CubeSurface::unfold(CubeLayout layout) const
     }
 
     Surface surface;
+    if (edgeLength == 0) return surface;
+
+    AutoPtr<Private> tmp;
+    Private * cube = m->readableFaces(tmp);
     surface.setImage(width, height, 1);
-    for(uint f = 0; f < 6; f++) {
-        uint x = offsets[f].x * edgeLength;
-        uint y = offsets[f].y * edgeLength;
-        surface.copy(m->face[f], 0, 0, 0, edgeLength, edgeLength, 1, x, y, 0);
-    }
 
-    if(layout == CubeLayout_VerticalCross || layout == CubeLayout_LatitudeLongitude) {
-        // Undo back face rotation
-        m->face[5].flipY();
-        m->face[5].flipX();
+    if (layout == CubeLayout_LatitudeLongitude) {
+        unfoldLatitudeLongitude(cube, surface.m->image);
     }
+    else {
+        unfoldRows(cube, offsets, layout == CubeLayout_VerticalCross, surface.m->image);
+    }
+
     return surface;
 }
 
@@ -481,7 +809,8 @@ float CubeSurface::average(int channel) const
     float sum = 0.0f;
 
     for (int f = 0; f < 6; f++) {
-        float * c = m->face[f].m->image->channel(channel);
+        AutoPtr<FloatImage> tmp;
+        const float * c = m->face[f].m->readImage(channel + 1, tmp)->channel(channel);
 
          for (uint y = 0; y < edgeLength; y++) {
              for (uint x = 0; x < edgeLength; x++) {
@@ -505,7 +834,8 @@ void CubeSurface::range(int channel, float * minimum_ptr, float * maximum_ptr) c
     float maximum = 0.0f;
 
     for (int f = 0; f < 6; f++) {
-        float * c = m->face[f].m->image->channel(channel);
+        AutoPtr<FloatImage> tmp;
+        const float * c = m->face[f].m->readImage(channel + 1, tmp)->channel(channel);
 
          for (uint y = 0; y < edgeLength; y++) {
              for (uint x = 0; x < edgeLength; x++) {
@@ -530,101 +860,287 @@ void CubeSurface::clamp(int channel, float low/*= 0.0f*/, float high/*= 1.0f*/)
 
 #include "nvmath/SphericalHarmonic.h"
 
-CubeSurface CubeSurface::irradianceFilter(int size, EdgeFixup fixupMethod) const
+// Maximum number of functions projected by projectSH3.
+static const uint s_maxProjectionCount = 3;
+
+// Project linear combinations of the channels of the cube to the order 2 SH basis, weighting each texel by its solid
+// angle. The rows of the faces are reduced in parallel and the partial sums are added in order, so that the result does
+// not depend on the number of threads.
+static void projectSH3(CubeSurface::Private * m, const float (*weights)[4], uint count, double (*coef)[9])
 {
-    // Evaluate spherical harmonic for each output texel.
-    CubeSurface output;
-    output.m->allocate(size);
+    nvDebugCheck(count <= s_maxProjectionCount);
 
-    Sh2 shr, shg, shb;
+    AutoPtr<CubeSurface::Private> tmp;
+    m = m->readableFaces(tmp);
+    m->allocateTexelTable();
 
-    computeIrradianceSH3(0, shr.coef);
-    computeIrradianceSH3(1, shg.coef);
-    computeIrradianceSH3(2, shb.coef);
+    const uint edgeLength = m->edgeLength;
+    const TexelTable * texelTable = m->texelTable;
 
-    // @@ Sample spherical harmonic from every direction.
+    const uint rowCount = 6 * edgeLength;
+    const uint chunkRows = max(1U, (16 * 1024) / edgeLength);
+    const uint chunkCount = (rowCount + chunkRows - 1) / chunkRows;
 
-    return CubeSurface();
-}
+    Array<double> partials;
+    partials.resize(chunkCount * count * 9, 0.0);
+    double * partialBuffer = partials.buffer();
 
+    parallel_for(chunkCount, [&](int chunk) {
+        double * partial = partialBuffer + chunk * count * 9;
 
-void CubeSurface::computeLuminanceIrradianceSH3(float coef[9]) const{
+        // Directions and weighted values of a row in SoA layout.
+        Array<float> rowBuffer;
+        rowBuffer.resize((3 + s_maxProjectionCount) * edgeLength);
+        float * dx = rowBuffer.buffer();
+        float * dy = dx + edgeLength;
+        float * dz = dy + edgeLength;
+        float * values[s_maxProjectionCount];
+        for (uint k = 0; k < count; k++) values[k] = dz + (k + 1) * edgeLength;
 
-    m->allocateTexelTable();
+        // Basis of the texels left over by the SIMD loop. Sh allocates its coefficients, so it's reused.
+        Sh2 shDir;
 
-    // Transform this cube to spherical harmonic basis
-    Sh2 sh;
+        const uint end = min(rowCount, (chunk + 1) * chunkRows);
+        for (uint row = chunk * chunkRows; row < end; row++) {
+            const uint f = row / edgeLength;
+            const uint y = row % edgeLength;
+            const FloatImage * inputImage = m->face[f].m->image;
 
-    // For each texel of the input cube.
-    const uint edgeLength = m->edgeLength;
-    for (uint f = 0; f < 6; f++) {
+            for (uint x = 0; x < edgeLength; x++) {
+                const Vector3 & dir = texelTable->direction(f, x, y);
+                dx[x] = dir.x;
+                dy[x] = dir.y;
+                dz[x] = dir.z;
+
+                const float solidAngle = texelTable->solidAngle(f, x, y);
+                for (uint k = 0; k < count; k++) {
+                    float v = 0;
+                    for (uint c = 0; c < 4; c++) {
+                        if (weights[k][c] != 0) v += weights[k][c] * inputImage->pixel(c, x, y, 0);
+                    }
+                    values[k][x] = v * solidAngle;
+                }
+            }
 
-        const Surface & inputFace = m->face[f];
-        const FloatImage * inputImage = inputFace.m->image;
+            float sum[s_maxProjectionCount][9] = {};
+            uint x = 0;
 
-        for (uint y = 0; y < edgeLength; y++) {
-            for (uint x = 0; x < edgeLength; x++) {
+#if NV_USE_SSE > 1
+            __m128 acc[s_maxProjectionCount][9];
+            for (uint k = 0; k < count; k++) {
+                for (uint i = 0; i < 9; i++) acc[k][i] = _mm_setzero_ps();
+            }
 
-                Vector3 dir = m->texelTable->direction(f, x, y);
-                float solidAngle = m->texelTable->solidAngle(f, x, y);
+            // Same as Sh2::eval for 4 directions at a time.
+            for (; x + 4 <= edgeLength; x += 4) {
+                const __m128 X = _mm_loadu_ps(dx + x);
+                const __m128 Y = _mm_loadu_ps(dy + x);
+                const __m128 Z = _mm_loadu_ps(dz + x);
+
+                __m128 basis[9];
+                basis[0] = _mm_set1_ps(0.2820947917738781f);
+                basis[2] = _mm_mul_ps(_mm_set1_ps(0.4886025119029199f), Z);
+                basis[6] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.9461746957575601f), _mm_mul_ps(Z, Z)), _mm_set1_ps(-0.3153915652525201f));
+                basis[3] = _mm_mul_ps(_mm_set1_ps(-0.48860251190292f), X);
+                basis[1] = _mm_mul_ps(_mm_set1_ps(-0.48860251190292f), Y);
+                const __m128 tmpB = _mm_mul_ps(_mm_set1_ps(-1.092548430592079f), Z);
+                basis[7] = _mm_mul_ps(tmpB, X);
+                basis[5] = _mm_mul_ps(tmpB, Y);
+                const __m128 C1 = _mm_sub_ps(_mm_mul_ps(X, X), _mm_mul_ps(Y, Y));
+                const __m128 S1 = _mm_add_ps(_mm_mul_ps(X, Y), _mm_mul_ps(Y, X));
+                basis[8] = _mm_mul_ps(_mm_set1_ps(0.5462742152960395f), C1);
+                basis[4] = _mm_mul_ps(_mm_set1_ps(0.5462742152960395f), S1);
+
+                for (uint k = 0; k < count; k++) {
+                    const __m128 v = _mm_loadu_ps(values[k] + x);
+                    for (uint i = 0; i < 9; i++) acc[k][i] = _mm_add_ps(acc[k][i], _mm_mul_ps(basis[i], v));
+                }
+            }
 
-                Sh2 shDir;
-                shDir.eval(dir);
+            for (uint k = 0; k < count; k++) {
+                for (uint i = 0; i < 9; i++) {
+                    float lanes[4];
+                    _mm_storeu_ps(lanes, acc[k][i]);
+                    sum[k][i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+                }
+            }
+#endif
 
-                float r = inputImage->pixel(0, x, y, 0);
-                float g = inputImage->pixel(1, x, y, 0);
-                float b = inputImage->pixel(2, x, y, 0);
-                float lum = 0.333f * (r + g + b);  // @@ use the proper luminance formula.
+            for (; x < edgeLength; x++) {
+                shDir.eval(Vector3(dx[x], dy[x], dz[x]));
+                for (uint k = 0; k < count; k++) {
+                    for (uint i = 0; i < 9; i++) sum[k][i] += shDir.elemAt(i) * values[k][x];
+                }
+            }
 
-                sh.addScaled(shDir, lum * solidAngle);
+            for (uint k = 0; k < count; k++) {
+                for (uint i = 0; i < 9; i++) partial[k * 9 + i] += sum[k][i];
             }
         }
+    });
+
+    for (uint k = 0; k < count; k++) {
+        for (uint i = 0; i < 9; i++) {
+            coef[k][i] = 0;
+            for (uint chunk = 0; chunk < chunkCount; chunk++) coef[k][i] += partialBuffer[(chunk * count + k) * 9 + i];
+        }
+    }
+}
+
+// Irradiance is band limited, so instead of convolving a cosine lobe against every texel of the input, the output is
+// evaluated from the order 2 SH projection of the input. See Ramamoorthi and Hanrahan, An Efficient Representation for
+// Irradiance Environment Maps.
+CubeSurface CubeSurface::irradianceFilter(int size, EdgeFixup fixupMethod) const
+{
+    const float weights[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+    double coef[3][9];
+    projectSH3(m, weights, 3, coef);
+
+    // Convolve with the clamped cosine lobe. The result is divided by PI like the output of cosinePowerFilter, so that a
+    // constant cube is left unchanged.
+    const double bandScale[9] = { 1.0, 2.0/3.0, 2.0/3.0, 2.0/3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+
+    Sh2 shr, shg, shb;
+    for (int i = 0; i < 9; i++) {
+        shr.elemAt(i) = float(coef[0][i] * bandScale[i]);
+        shg.elemAt(i) = float(coef[1][i] * bandScale[i]);
+        shb.elemAt(i) = float(coef[2][i] * bandScale[i]);
     }
 
+    // Evaluate spherical harmonic for each output texel.
+    CubeSurface output;
+    output.m->allocate(size);
+
+    parallel_for(6 * size, [&](int row) {
+        const int f = row / size;
+        const int y = row % size;
+        FloatImage * outputImage = output.m->face[f].m->image;
+
+        // Sh allocates its coefficients, reuse them for the whole row.
+        Sh2 shDir;
+        for (int x = 0; x < size; x++) {
+            shDir.eval(texelDirection(f, x, y, size, fixupMethod));
+
+            outputImage->pixel(0, x, y, 0) = dot(shr, shDir);
+            outputImage->pixel(1, x, y, 0) = dot(shg, shDir);
+            outputImage->pixel(2, x, y, 0) = dot(shb, shDir);
+        }
+    });
+
+    return output;
+}
+
+
+void CubeSurface::computeLuminanceIrradianceSH3(float coef[9]) const{
+
+    // @@ use the proper luminance formula.
+    const float weights[1][4] = { { 0.333f, 0.333f, 0.333f, 0 } };
+
+    // Transform this cube to spherical harmonic basis
+    double sh[1][9];
+    projectSH3(m, weights, 1, sh);
+
     for (int i = 0; i < 9; i++) {
-        coef[i] = sh.coef[i];
+        coef[i] = float(sh[0][i]);
     }
 }
 
 
 void CubeSurface::computeIrradianceSH3(int channel, float coef[9]) const {
 
-    m->allocateTexelTable();
+    float weights[1][4] = { { 0, 0, 0, 0 } };
+    weights[0][channel] = 1;
 
     // Transform this cube to spherical harmonic basis
-    Sh2 sh;
+    double sh[1][9];
+    projectSH3(m, weights, 1, sh);
 
-    // For each texel of the input cube.
-    const uint edgeLength = m->edgeLength;
-    for (uint f = 0; f < 6; f++) {
+    for (int i = 0; i < 9; i++) {
+        coef[i] = float(sh[0][i]);
+    }
+}
 
-        const Surface & inputFace = m->face[f];
-        const FloatImage * inputImage = inputFace.m->image;
 
-        for (uint y = 0; y < edgeLength; y++) {
-            for (uint x = 0; x < edgeLength; x++) {
+// Input cube convolved by the angular filter, either the input faces or one of their box filtered mipmaps.
+struct AngularFilterLevel {
+    uint edgeLength;
+    const TexelTable * texelTable;
+    const FloatImage * face[6];
+};
 
-                Vector3 dir = m->texelTable->direction(f, x, y);
-                float solidAngle = m->texelTable->solidAngle(f, x, y);
+// Rectangle of texels of each face that may be inside the filter cones of a block of output texels.
+struct AngularFilterBounds {
+    bool skip[6];
+    int x0[6], y0[6];
+    int x1[6], y1[6];
+};
 
-                Sh2 shDir;
-                shDir.eval(dir);
+// Coarse grid of texels on each face, with the angle from their directions to their corners.
+struct AngularFilterGrid {
+    enum { Size = 8 };
 
-                float c = inputImage->pixel(channel, x, y, 0);
+    AngularFilterGrid() {
+        const float step = 2.0f / Size;
 
-                sh.addScaled(shDir, c * solidAngle);
+        for (uint f = 0; f < 6; f++) {
+            for (uint y = 0; y < Size; y++) {
+                for (uint x = 0; x < Size; x++) {
+                    const Vector3 dir = texelDirection(f, x, y, Size, EdgeFixup_None);
+                    float cosineRadius = 1.0f;
+
+                    for (uint i = 0; i < 4; i++) {
+                        float u = (x + (i & 1)) * step - 1.0f;
+                        float v = (y + (i >> 1)) * step - 1.0f;
+                        Vector3 corner = normalizeFast(faceNormals[f] + u * faceU[f] + v * faceV[f]);
+                        cosineRadius = min(cosineRadius, dot(dir, corner));
+                    }
+
+                    direction[f][y][x] = dir;
+                    radius[f][y][x] = acosf(clamp(cosineRadius, -1.0f, 1.0f));
+                }
             }
         }
     }
 
-    for (int i = 0; i < 9; i++) {
-        coef[i] = sh.elemAt(i);
+    // Bound the texels of a level of the given edge length that are within coneAngle of dir.
+    void computeBounds(uint edgeLength, const Vector3 & dir, float coneAngle, AngularFilterBounds * bounds) const {
+        for (uint f = 0; f < 6; f++) {
+            // Test face cone agains filter cone.
+            float faceAngle = acosf(clamp(dot(dir, faceNormals[f]), -1.0f, 1.0f));
+
+            bounds->skip[f] = faceAngle > coneAngle + atanf(sqrtf(2));
+            if (bounds->skip[f]) continue;
+
+            int cx0 = Size, cy0 = Size, cx1 = -1, cy1 = -1;
+            for (int y = 0; y < Size; y++) {
+                for (int x = 0; x < Size; x++) {
+                    float angle = acosf(clamp(dot(dir, direction[f][y][x]), -1.0f, 1.0f));
+                    if (angle <= coneAngle + radius[f][y][x]) {
+                        cx0 = min(cx0, x);
+                        cy0 = min(cy0, y);
+                        cx1 = max(cx1, x);
+                        cy1 = max(cy1, y);
+                    }
+                }
+            }
+
+            bounds->skip[f] = cx1 < 0;
+
+            // Texels of the level that overlap the coarse texels.
+            const int e = int(edgeLength);
+            bounds->x0[f] = cx0 * e / Size;
+            bounds->y0[f] = cy0 * e / Size;
+            bounds->x1[f] = ((cx1 + 1) * e + Size - 1) / Size - 1;
+            bounds->y1[f] = ((cy1 + 1) * e + Size - 1) / Size - 1;
+        }
     }
-}
 
+    Vector3 direction[6][Size][Size];
+    float radius[6][Size][Size];
+};
 
-// Convolve filter against this cube.
-Vector3 CubeSurface::Private::applyAngularFilter(const Vector3 & filterDir, float coneAngle, float * filterTable, int tableSize)
+// Convolve filter against the texels of the cube level inside the given bounds.
+static Vector3 applyAngularFilter(const AngularFilterLevel & level, const AngularFilterBounds & bounds, const Vector3 & filterDir, float coneAngle, const float * filterTable, int tableSize)
 {
     const float cosineConeAngle = cosf(coneAngle);
     nvDebugCheck(cosineConeAngle >= 0);
@@ -640,62 +1156,21 @@ Vector3 CubeSurface::Private::applyAngularFilter(const Vector3 & filterDir, floa
     // What AMD CubeMapGen does:
     // - Compute conservative bounds on the primary face, wrap around the adjacent faces.
 
+    // What we do now:
+    // - Bound the cones of a block of output texels against a coarse grid of each face, see AngularFilterGrid.
 
     // For each texel of the input cube.
     for (uint f = 0; f < 6; f++) {
-
-        // Test face cone agains filter cone.
-        float cosineFaceAngle = dot(filterDir, faceNormals[f]);
-        float faceAngle = acosf(cosineFaceAngle);
-
-        if (faceAngle > coneAngle + atanf(sqrtf(2))) {
-            // Skip face.
-            continue;
-        }
-
-        const int L = I32(edgeLength-1);
-        int x0 = 0, x1 = L;
-        int y0 = 0, y1 = L;
-
-#if 0
-        float u0 = -1;
-        float u1 = 1;
-        float v0 = -1;
-        float v1 = 1;
-
-        // @@ Compute uvs.
-
-        // Expand uv coordinates from [-1,1] to [0, edgeLength)
-        u0 = (u0 + 1) * edgeLength * 0.5f - 0.5f;
-        v0 = (v0 + 1) * edgeLength * 0.5f - 0.5f;
-        u1 = (u1 + 1) * edgeLength * 0.5f - 0.5f;
-        v1 = (v1 + 1) * edgeLength * 0.5f - 0.5f;
-        nvDebugCheck(u0 >= -0.5f && u0 <= edgeLength - 0.5f);
-        nvDebugCheck(v0 >= -0.5f && v0 <= edgeLength - 0.5f);
-        nvDebugCheck(u1 >= -0.5f && u1 <= edgeLength - 0.5f);
-        nvDebugCheck(v1 >= -0.5f && v1 <= edgeLength - 0.5f);
-
-        x0 = clamp(ifloor(u0), 0, L);
-        y0 = clamp(ifloor(v0), 0, L);
-        x1 = clamp(iceil(u1), 0, L);
-        y1 = clamp(iceil(v1), 0, L);
-#endif
-
-        nvDebugCheck(x1 >= x0);
-        nvDebugCheck(y1 >= y0);
-
-        if (x1 == x0 || y1 == y0) {
-            // Skip this face.
+        if (bounds.skip[f]) {
             continue;
         }
 
+        const TexelTable * texelTable = level.texelTable;
+        const FloatImage * inputImage = level.face[f];
 
-        const Surface & inputFace = face[f];
-        const FloatImage * inputImage = inputFace.m->image;
-
-        for (int y = y0; y <= y1; y++) {
+        for (int y = bounds.y0[f]; y <= bounds.y1[f]; y++) {
             bool inside = false;
-            for (int x = x0; x <= x1; x++) {
+            for (int x = bounds.x0[f]; x <= bounds.x1[f]; x++) {
 
                 Vector3 dir = texelTable->direction(f, x, y);
                 float cosineAngle = dot(dir, filterDir);
@@ -730,6 +1205,27 @@ Vector3 CubeSurface::Private::applyAngularFilter(const Vector3 & filterDir, floa
     return color;
 }
 
+// Box filter the color channels of a face to half its size.
+static FloatImage * downSampleFace(const FloatImage * img)
+{
+    const uint edgeLength = img->width() / 2;
+
+    FloatImage * result = new FloatImage;
+    result->allocate(3, edgeLength, edgeLength, 1);
+
+    for (uint c = 0; c < 3; c++) {
+        for (uint y = 0; y < edgeLength; y++) {
+            for (uint x = 0; x < edgeLength; x++) {
+                result->pixel(c, x, y, 0) = 0.25f * (
+                    img->pixel(c, 2*x, 2*y, 0) + img->pixel(c, 2*x+1, 2*y, 0) +
+                    img->pixel(c, 2*x, 2*y+1, 0) + img->pixel(c, 2*x+1, 2*y+1, 0));
+            }
+        }
+    }
+
+    return result;
+}
+
 // We want to find the alpha such that:
 // cos(alpha)^cosinePower = epsilon
 // That's: acos(epsilon^(1/cosinePower))
@@ -849,94 +1345,216 @@ Vector3 CubeSurface::Private::applyCosinePowerFilter(const Vector3 & filterDir,
 
 
 
-#include "nvthread/ParallelFor.h"
+// Minimum number of texels across the radius of the filter cone in CubeFilterMode_Hierarchical.
+static const float s_coneTexelCount = 16.0f;
+
+// Edge length of the blocks of output texels filtered together.
+static const int s_filterBlockSize = 8;
+
+// Number of entries of the filter tables.
+static const int s_filterTableSize = 512;
+
+// Box filtered mipmaps of the input cube and their texel tables, shared by all the levels of a filter chain.
+struct AngularFilterSource {
+    AngularFilterSource(CubeSurface::Private * cube) : cube(cube) {
+        AngularFilterLevel * level = new AngularFilterLevel;
+        level->edgeLength = cube->face[0].width();
+        level->texelTable = NULL;
+        for (uint f = 0; f < 6; f++) {
+            level->face[f] = cube->face[f].m->image;
+        }
+        levels.append(level);
+    }
 
-struct ApplyAngularFilterContext {
-    CubeSurface::Private * inputCube;
-    CubeSurface::Private * filteredCube;
+    ~AngularFilterSource() {
+        deleteAll(levels);
+        deleteAll(faces);
+        deleteAll(texelTables);
+    }
+
+    // Input level that the filter with the given cone angle is convolved against.
+    const AngularFilterLevel * select(float coneAngle, CubeFilterMode mode) {
+        uint i = 0;
+        if (mode == CubeFilterMode_Hierarchical) {
+            // Pick the smallest mipmap that still has enough texels inside the cone. Texels at the center of a face span
+            // an angle of 2/edgeLength.
+            for (;; i++) {
+                const uint edgeLength = levels[i]->edgeLength;
+                if (edgeLength % 2 != 0 || edgeLength < 8 || coneAngle * (edgeLength / 2) / 2 < s_coneTexelCount) break;
+
+                if (i + 1 == levels.count()) {
+                    AngularFilterLevel * mipmap = new AngularFilterLevel;
+                    mipmap->edgeLength = edgeLength / 2;
+                    mipmap->texelTable = NULL;
+                    for (uint f = 0; f < 6; f++) {
+                        FloatImage * face = downSampleFace(levels[i]->face[f]);
+                        mipmap->face[f] = face;
+                        faces.append(face);
+                    }
+                    levels.append(mipmap);
+                }
+            }
+        }
+
+        AngularFilterLevel * level = levels[i];
+        if (level->texelTable == NULL) {
+            if (i == 0) {
+                // Texel table is stored along with the surface so that it's computed only once.
+                cube->allocateTexelTable();
+                level->texelTable = cube->texelTable;
+            }
+            else {
+                TexelTable * texelTable = new TexelTable(level->edgeLength);
+                level->texelTable = texelTable;
+                texelTables.append(texelTable);
+            }
+        }
+        return level;
+    }
+
+    CubeSurface::Private * cube;
+    Array<AngularFilterLevel *> levels;
+    Array<FloatImage *> faces;
+    Array<TexelTable *> texelTables;
+};
+
+// One output cube of a filter chain.
+struct AngularFilterJob {
+    const AngularFilterLevel * source;
+    const float * filterTable;
     float coneAngle;
-    float * filterTable;
-    int tableSize;
-    EdgeFixup fixupMethod;
+    float cost;         // Estimated number of input texels convolved per output texel.
+    int size;
+    int blockCount;     // Number of blocks along each edge.
+    FloatImage * face[6];
 };
 
-void ApplyAngularFilterTask(void * context, int id)
+// Filter a block of output texels of the given job.
+static void applyAngularFilter(const AngularFilterGrid & grid, const AngularFilterJob & job, EdgeFixup fixupMethod, int f, int bx, int by)
 {
-    ApplyAngularFilterContext * ctx = (ApplyAngularFilterContext *)context;
-
-    int size = ctx->filteredCube->edgeLength;
+    const int size = job.size;
+    const int bw = min(s_filterBlockSize, size - bx);
+    const int bh = min(s_filterBlockSize, size - by);
+
+    Vector3 filterDir[s_filterBlockSize * s_filterBlockSize];
+    Vector3 center(0);
+    for (int y = 0; y < bh; y++) {
+        for (int x = 0; x < bw; x++) {
+            filterDir[y * bw + x] = texelDirection(f, bx + x, by + y, size, fixupMethod);
+            center += filterDir[y * bw + x];
+        }
+    }
+    center = normalizeFast(center);
 
-    int f = id / (size * size);
-    int idx = id % (size * size);
-    int y = idx / size;
-    int x = idx % size;
+    float blockAngle = 0;
+    for (int i = 0; i < bw * bh; i++) {
+        blockAngle = max(blockAngle, acosf(clamp(dot(center, filterDir[i]), -1.0f, 1.0f)));
+    }
 
-    nvtt::Surface & filteredFace = ctx->filteredCube->face[f];
-    FloatImage * filteredImage = filteredFace.m->image;
+    // The margin covers the imprecision of acosf near 1.
+    AngularFilterBounds bounds;
+    grid.computeBounds(job.source->edgeLength, center, job.coneAngle + blockAngle + 0.01f, &bounds);
 
-    const Vector3 filterDir = texelDirection(f, x, y, size, ctx->fixupMethod);
+    FloatImage * filteredImage = job.face[f];
 
-    // Convolve filter against cube.
-    Vector3 color = ctx->inputCube->applyAngularFilter(filterDir, ctx->coneAngle, ctx->filterTable, ctx->tableSize);
+    for (int y = 0; y < bh; y++) {
+        for (int x = 0; x < bw; x++) {
+            // Convolve filter against cube.
+            Vector3 color = applyAngularFilter(*job.source, bounds, filterDir[y * bw + x], job.coneAngle, job.filterTable, s_filterTableSize);
 
-    filteredImage->pixel(0, idx) = color.x;
-    filteredImage->pixel(1, idx) = color.y;
-    filteredImage->pixel(2, idx) = color.z;
+            const uint idx = (by + y) * size + bx + x;
+            filteredImage->pixel(0, idx) = color.x;
+            filteredImage->pixel(1, idx) = color.y;
+            filteredImage->pixel(2, idx) = color.z;
+        }
+    }
 }
 
-
-CubeSurface CubeSurface::cosinePowerFilter(int size, float cosinePower, EdgeFixup fixupMethod) const
+void CubeSurface::buildSpecularChain(CubeSurface * chain, int levelCount, int size, const float * cosinePowers, EdgeFixup fixupMethod, CubeFilterMode mode/*= CubeFilterMode_Exact*/) const
 {
-    // Allocate output cube.
-    CubeSurface filteredCube;
-    filteredCube.m->allocate(size);
+    if (levelCount <= 0) return;
 
-    // Texel table is stored along with the surface so that it's computed only once.
-    m->allocateTexelTable();
+    AutoPtr<Private> tmp;
+    AngularFilterSource source(m->readableFaces(tmp));
 
-    const float threshold = 0.001f;
-    const float coneAngle = acosf(powf(threshold, 1.0f/cosinePower));
+    Array<AngularFilterJob> jobs;
+    jobs.resize(levelCount);
 
+    // @@ Instead of looking up table between [0 - 1] we should probably use [cos(coneAngle), 1]
+    Array<float> filterTables;
+    filterTables.resize(levelCount * s_filterTableSize);
+
+    for (int l = 0; l < levelCount; l++) {
+        const float cosinePower = cosinePowers[l];
+        const float threshold = 0.001f;
+
+        AngularFilterJob & job = jobs[l];
+        job.coneAngle = acosf(powf(threshold, 1.0f/cosinePower));
+        job.source = source.select(job.coneAngle, mode);
+        job.size = max(1, size >> l);
+        job.blockCount = (job.size + s_filterBlockSize - 1) / s_filterBlockSize;
+
+        // Texels in the cone, the solid angle of the texels at the center of a face is about 4/edgeLength^2.
+        const float edgeLength = float(job.source->edgeLength);
+        job.cost = min(6 * edgeLength * edgeLength, 2 * PI * (1 - cosf(job.coneAngle)) * edgeLength * edgeLength / 4);
+
+        float * filterTable = filterTables.buffer() + l * s_filterTableSize;
+        for (int i = 0; i < s_filterTableSize; i++) {
+            float f = float(i) / (s_filterTableSize - 1);
+            filterTable[i] = powf(f, cosinePower);
+        }
+        job.filterTable = filterTable;
 
-    // For each texel of the output cube.
-    /*for (uint f = 0; f < 6; f++) {
-        nvtt::Surface filteredFace = filteredCube.m->face[f];
-        FloatImage * filteredImage = filteredFace.m->image;
+        // Allocate output cube.
+        chain[l] = CubeSurface();
+        chain[l].m->allocate(job.size);
+        for (uint f = 0; f < 6; f++) {
+            job.face[f] = chain[l].m->face[f].m->image;
+        }
+    }
 
-        for (uint y = 0; y < uint(size); y++) {
-            for (uint x = 0; x < uint(size); x++) {
+    // Schedule the blocks of the most expensive levels first, so that the threads finish at about the same time.
+    Array<uint> order;
+    uint blockCount = 0;
+    for (int l = 0; l < levelCount; l++) {
+        uint i = order.count();
+        while (i > 0 && jobs[order[i - 1]].cost < jobs[l].cost) i--;
+        order.insertAt(i, l);
+        blockCount += 6 * jobs[l].blockCount * jobs[l].blockCount;
+    }
 
-                const Vector3 filterDir = texelDirection(f, x, y, size, fixupMethod);
+    Array<uint> firstBlock;
+    firstBlock.resize(levelCount);
+    for (uint i = 0, first = 0; i < order.count(); i++) {
+        const AngularFilterJob & job = jobs[order[i]];
+        firstBlock[i] = first;
+        first += 6 * job.blockCount * job.blockCount;
+    }
 
-                // Convolve filter against cube.
-                Vector3 color = m->applyCosinePowerFilter(filterDir, coneAngle, cosinePower);
+    const AngularFilterGrid grid;
 
-                filteredImage->pixel(0, x, y, 0) = color.x;
-                filteredImage->pixel(1, x, y, 0) = color.y;
-                filteredImage->pixel(2, x, y, 0) = color.z;
-            }
-        }
-    }*/
+    // For each block of the output cubes.
+    parallel_for(blockCount, [&](int id) {
+        uint i = 0;
+        while (i + 1 < order.count() && firstBlock[i + 1] <= uint(id)) i++;
 
-    ApplyAngularFilterContext context;
-    context.inputCube = m;
-    context.filteredCube = filteredCube.m;
-    context.coneAngle = coneAngle;
-    context.fixupMethod = fixupMethod;
+        const AngularFilterJob & job = jobs[order[i]];
+        const int block = id - firstBlock[i];
+        const int n = job.blockCount;
 
-    context.tableSize = 512;
-    context.filterTable = new float[context.tableSize];
+        const int f = block / (n * n);
+        const int bx = (block % n) * s_filterBlockSize;
+        const int by = (block / n % n) * s_filterBlockSize;
 
-    // @@ Instead of looking up table between [0 - 1] we should probably use [cos(coneAngle), 1]
+        applyAngularFilter(grid, job, fixupMethod, f, bx, by);
+    });
+}
 
-    for (int i = 0; i < context.tableSize; i++) {
-        float f = float(i) / (context.tableSize - 1);
-        context.filterTable[i] = powf(f, cosinePower);
-    }
-    
 
-    nv::ParallelFor parallelFor(ApplyAngularFilterTask, &context);
-    parallelFor.run(6 * size * size);
+CubeSurface CubeSurface::cosinePowerFilter(int size, float cosinePower, EdgeFixup fixupMethod, CubeFilterMode mode/*= CubeFilterMode_Exact*/) const
+{
+    CubeSurface filteredCube;
+    buildSpecularChain(&filteredCube, 1, size, &cosinePower, fixupMethod, mode);
 
     // @@ Implement edge averaging.
     if (fixupMethod == EdgeFixup_Average) {
@@ -1001,6 +1619,9 @@ CubeSurface CubeSurface::fastResample(int size, EdgeFixup fixupMethod) const
     CubeSurface resampledCube;
     resampledCube.m->allocate(size);
 
+    AutoPtr<Private> tmp;
+    Private * cube = m->readableFaces(tmp);
+
     // For each texel of the output cube.
     for (uint f = 0; f < 6; f++) {
         nvtt::Surface resampledFace = resampledCube.m->face[f];
@@ -1011,7 +1632,7 @@ CubeSurface CubeSurface::fastResample(int size, EdgeFixup fixupMethod) const
 
                 const Vector3 filterDir = texelDirection(f, x, y, size, fixupMethod);
 
-                Vector3 color = m->sample(filterDir);
+                Vector3 color = cube->sample(filterDir);
 
                 resampledImage->pixel(0, x, y, 0) = color.x;
                 resampledImage->pixel(1, x, y, 0) = color.y;
@@ -1027,6 +1648,236 @@ CubeSurface CubeSurface::fastResample(int size, EdgeFixup fixupMethod) const
     return resampledCube;
 }
 
+// Face extended with a border of texels from the adjacent faces, so that the resize filters can read across the seams.
+struct SeamFace {
+    FloatImage data;    // 4 channels of stride * stride texels.
+
+    float * row(int c, int y) { return data.scanline(c, y, 0); }
+    const float * row(int c, int y) const { return data.scanline(c, y, 0); }
+};
+
+static void buildSeamFace(const CubeSurface::Private * m, int f, int border, SeamFace * seamFace)
+{
+    const int edgeLength = int(m->edgeLength);
+    const int stride = edgeLength + 2 * border;
+
+    seamFace->data.allocate(4, stride, stride);
+
+    const FloatImage * img = m->face[f].m->image;
+
+    for (int y = -border; y < edgeLength + border; y++) {
+        const bool interiorRow = (y >= 0 && y < edgeLength);
+
+        for (int x = -border; x < edgeLength + border; x++) {
+            // Copy the interior rows at once.
+            if (interiorRow && x == 0) {
+                for (int c = 0; c < 4; c++) {
+                    memcpy(seamFace->row(c, y + border) + border, img->scanline(c, y, 0), edgeLength * sizeof(float));
+                }
+                x = edgeLength - 1;
+                continue;
+            }
+
+            // Extend the face plane beyond its edges and interpolate the adjacent face in that direction.
+            const float u = (float(x) + 0.5f) * (2.0f / edgeLength) - 1.0f;
+            const float v = (float(y) + 0.5f) * (2.0f / edgeLength) - 1.0f;
+
+            int sf;
+            float sx, sy;
+            cubeTexelCoordinates(faceNormals[f] + u * faceU[f] + v * faceV[f], edgeLength, &sf, &sx, &sy);
+
+            const int x0 = ifloor(sx);
+            const int y0 = ifloor(sy);
+            const float fx = sx - x0;
+            const float fy = sy - y0;
+            const int ix0 = nv::clamp(x0, 0, edgeLength - 1);
+            const int iy0 = nv::clamp(y0, 0, edgeLength - 1);
+            const int ix1 = nv::clamp(x0 + 1, 0, edgeLength - 1);
+            const int iy1 = nv::clamp(y0 + 1, 0, edgeLength - 1);
+
+            const FloatImage * src = m->face[sf].m->image;
+            for (int c = 0; c < 4; c++) {
+                seamFace->row(c, y + border)[x + border] = src->bilerp(c, ix0, iy0, ix1, iy1, fx, fy);
+            }
+        }
+    }
+}
+
+// Faces with AlphaMode_Transparency weight the color of each texel by its alpha, like Surface::buildNextMipmap. Both passes
+// filter the weighted color, and since the kernels are normalized, the filtered alpha is the sum of the weights.
+static void resizeCube(const CubeSurface::Private * m, const Filter & filter, int size, CubeSurface::Private * output)
+{
+    const int edgeLength = int(m->edgeLength);
+    PolyphaseKernel kernel(filter, edgeLength, size);
+
+    const float iscale = float(edgeLength) / float(size);
+    const float width = kernel.width();
+    const int windowSize = kernel.windowSize();
+
+    // First source texel of each output texel. The windows are the same along both axes.
+    Array<int> left;
+    left.resize(size);
+    for (int i = 0; i < size; i++) {
+        const float center = (0.5f + i) * iscale;
+        left[i] = ifloor(center - width);
+    }
+
+    // The border must cover the windows that extend beyond the face edges.
+    const int border = max3(-left[0], left[size - 1] + windowSize - edgeLength, 0);
+    const int stride = edgeLength + 2 * border;
+
+    SeamFace seamFaces[6];
+    parallel_for(6, [&](int f) {
+        buildSeamFace(m, f, border, &seamFaces[f]);
+    });
+
+    const float alphaBias = 1.0f / 256.0f;
+
+    // Horizontal pass over the rows of all the faces, including the border rows. Each channel of each face is a channel
+    // of the intermediate image.
+    FloatImage tmp;
+    tmp.allocate(6 * 4, size, stride);
+
+    parallel_for(6 * stride, [&](int row) {
+        const int f = row / stride;
+        const int y = row % stride;
+        const bool weightAlpha = m->face[f].alphaMode() == AlphaMode_Transparency;
+        const float * alpha = seamFaces[f].row(3, y) + border;
+
+        for (int c = 0; c < 4; c++) {
+            const float * src = seamFaces[f].row(c, y) + border;
+            float * dst = tmp.scanline(f * 4 + c, y, 0);
+
+            for (int i = 0; i < size; i++) {
+                float sum = 0;
+                if (weightAlpha && c < 3) {
+                    for (int j = 0; j < windowSize; j++) {
+                        const int x = left[i] + j;
+                        sum += kernel.valueAt(i, j) * (alpha[x] + alphaBias) * src[x];
+                    }
+                }
+                else {
+                    for (int j = 0; j < windowSize; j++) {
+                        sum += kernel.valueAt(i, j) * src[left[i] + j];
+                    }
+                }
+                dst[i] = sum;
+            }
+        }
+    });
+
+    // Vertical pass, accumulating whole output rows.
+    parallel_for(6 * size, [&](int row) {
+        const int f = row / size;
+        const int y = row % size;
+
+        FloatImage * img = output->face[f].m->image;
+
+        for (int c = 0; c < 4; c++) {
+            float * dst = img->scanline(c, y, 0);
+
+            for (int x = 0; x < size; x++) dst[x] = 0;
+
+            for (int j = 0; j < windowSize; j++) {
+                const float w = kernel.valueAt(y, j);
+                const float * src = tmp.scanline(f * 4 + c, left[y] + border + j, 0);
+                for (int x = 0; x < size; x++) {
+                    dst[x] += w * src[x];
+                }
+            }
+        }
+
+        if (m->face[f].alphaMode() == AlphaMode_Transparency) {
+            const float * alpha = img->scanline(3, y, 0);
+            for (int c = 0; c < 3; c++) {
+                float * dst = img->scanline(c, y, 0);
+                for (int x = 0; x < size; x++) {
+                    dst[x] /= alpha[x] + alphaBias;
+                }
+            }
+        }
+    });
+}
+
+void CubeSurface::resize(int size, ResizeFilter filter)
+{
+    float filterWidth;
+    float params[2];
+    getDefaultFilterWidthAndParams(filter, &filterWidth, params);
+
+    resize(size, filter, filterWidth, params);
+}
+
+void CubeSurface::resize(int size, ResizeFilter filter, float filterWidth, const float * params)
+{
+    m->updateEdgeLength();
+    if (isNull() || size <= 0 || size == edgeLength()) {
+        return;
+    }
+
+    AutoPtr<Private> tmp;
+    Private * cube = m->readableFaces(tmp);
+
+    // Allocate output cube, with the settings of the faces.
+    CubeSurface resizedCube;
+    resizedCube.m->allocate(size);
+    for (int f = 0; f < 6; f++) {
+        const Surface::Private * src = cube->face[f].m;
+        Surface::Private * dst = resizedCube.m->face[f].m;
+        dst->wrapMode = src->wrapMode;
+        dst->alphaMode = src->alphaMode;
+        dst->isNormalMap = src->isNormalMap;
+    }
+
+    if (filter == ResizeFilter_Box)
+    {
+        BoxFilter filter(filterWidth);
+        resizeCube(cube, filter, size, resizedCube.m);
+    }
+    else if (filter == ResizeFilter_Triangle)
+    {
+        TriangleFilter filter(filterWidth);
+        resizeCube(cube, filter, size, resizedCube.m);
+    }
+    else if (filter == ResizeFilter_Kaiser)
+    {
+        KaiserFilter filter(filterWidth);
+        if (params != NULL) filter.setParameters(params[0], params[1]);
+        resizeCube(cube, filter, size, resizedCube.m);
+    }
+    else //if (filter == ResizeFilter_Mitchell)
+    {
+        nvDebugCheck(filter == ResizeFilter_Mitchell);
+        MitchellFilter filter;
+        if (params != NULL) filter.setParameters(params[0], params[1]);
+        resizeCube(cube, filter, size, resizedCube.m);
+    }
+
+    *this = resizedCube;
+}
+
+bool CubeSurface::buildNextMipmap(MipmapFilter filter, int min_size /*= 1*/)
+{
+    float filterWidth;
+    float params[2];
+    getDefaultFilterWidthAndParams(filter, &filterWidth, params);
+
+    return buildNextMipmap(filter, filterWidth, params, min_size);
+}
+
+bool CubeSurface::buildNextMipmap(MipmapFilter filter, float filterWidth, const float * params, int min_size /*= 1*/)
+{
+    m->updateEdgeLength();
+    if (isNull() || !canMakeNextMipmap(edgeLength(), edgeLength(), 1, min_size)) {
+        return false;
+    }
+
+    // The mipmap filters are a subset of the resize filters.
+    resize(max(1, edgeLength() / 2), ResizeFilter(filter), filterWidth, params);
+
+    return true;
+}
+
 void CubeSurface::toLinear(float gamma)
 {
     if (isNull()) return;
@@ -86,18 +86,48 @@ namespace nvtt
             }
         }
 
-        void allocateTexelTable()
+        // Faces with float storage and 4 channels. When some faces are packed or lack channels, they are read through
+        // a copy of the cube, the faces may be shared with other surfaces and are not modified.
+        Private * readableFaces(nv::AutoPtr<Private> & tmp)
+        {
+            bool readable = true;
+            for (uint i = 0; i < 6; i++) {
+                const Surface::Private * f = face[i].m;
+                if (f->image != NULL && (f->packed != NULL || f->image->componentCount() < 4)) readable = false;
+            }
+            if (readable) return this;
+
+            tmp = new Private();
+            tmp->edgeLength = edgeLength;
+            for (uint i = 0; i < 6; i++) {
+                const Surface::Private * f = face[i].m;
+                Surface::Private * copy = tmp->face[i].m;
+                copy->type = f->type;
+                copy->wrapMode = f->wrapMode;
+                copy->alphaMode = f->alphaMode;
+                copy->isNormalMap = f->isNormalMap;
+                copy->image = f->createReadImage(4);
+            }
+            return tmp.ptr();
+        }
+
+        // Faces may have been assigned directly.
+        void updateEdgeLength()
         {
             if (edgeLength == 0) {
                 edgeLength = face[0].width();
             }
+        }
+
+        void allocateTexelTable()
+        {
+            updateEdgeLength();
             if (texelTable == NULL) {
                 texelTable = new TexelTable(edgeLength);
             }
         }
 
         // Filtering helpers:
-        nv::Vector3 applyAngularFilter(const nv::Vector3 & dir, float coneAngle, float * filterTable, int tableSize);
         nv::Vector3 applyCosinePowerFilter(const nv::Vector3 & dir, float coneAngle, float cosinePower);
 
         nv::Vector3 sample(const nv::Vector3 & dir);
@@ -54,6 +54,10 @@ void OutputOptions::reset()
     m.version = 0;
     m.srgb = false;
     m.deleteOutputHandler = false;
+
+    m.position = 0;
+    m.hasLayout = false;
+    m.positioned = 0;
 }
 
 
@@ -69,6 +73,9 @@ void OutputOptions::setFileName(const char * fileName)
     m.fileHandle = NULL;
     m.outputHandler = NULL;
     m.deleteOutputHandler = false;
+    m.position = 0;
+    m.hasLayout = false;
+    m.positioned = 0;
 
     DefaultOutputHandler * oh = new DefaultOutputHandler(fileName);
     if (oh->stream.isError()) {
@@ -91,6 +98,9 @@ void OutputOptions::setFileHandle(void * fp)
     m.fileHandle = (FILE *)fp;
     m.outputHandler = NULL;
     m.deleteOutputHandler = false;
+    m.position = 0;
+    m.hasLayout = false;
+    m.positioned = 0;
 
     DefaultOutputHandler * oh = new DefaultOutputHandler(m.fileHandle);
     if (oh->stream.isError()) {
@@ -114,6 +124,9 @@ void OutputOptions::setOutputHandler(OutputHandler * outputHandler)
     m.fileHandle = NULL;
     m.outputHandler = outputHandler;
     m.deleteOutputHandler = false;
+    m.position = 0;
+    m.hasLayout = false;
+    m.positioned = 0;
 }
 
 /// Set error handler.
@@ -163,6 +176,7 @@ void OutputOptions::Private::beginImage(int size, int width, int height, int dep
 
 bool OutputOptions::Private::writeData(const void * data, int size) const
 {
+    position += size;
     return outputHandler == NULL || outputHandler->writeData(data, size);
 }
 
@@ -29,6 +29,7 @@
 
 #include "nvcore/StrLib.h" // Path
 #include "nvcore/StdStream.h"
+#include "nvcore/FileSystem.h" // writeAt
 
 
 namespace nvtt
@@ -36,8 +37,8 @@ namespace nvtt
 
     struct DefaultOutputHandler : public nvtt::OutputHandler
     {
-        DefaultOutputHandler(const char * fileName) : stream(fileName) {}
-        DefaultOutputHandler(FILE * fp) : stream(fp, false) {}
+        DefaultOutputHandler(const char * fileName) : stream(fileName), base(0) {}
+        DefaultOutputHandler(FILE * fp) : stream(fp, false), base(stream.isError() ? 0 : stream.tell()) {}
 
         virtual ~DefaultOutputHandler() {}
 
@@ -60,7 +61,14 @@ namespace nvtt
             // ignore.
         }
 
+        // Output data at its location in the file.
+        virtual bool writeDataAt(unsigned long long offset, const void * data, int size)
+        {
+            return nv::FileSystem::writeAt(stream.handle(), base + offset, data, size);
+        }
+
         nv::StdOutputStream stream;
+        uint64 base;    // Position of the file when the handler was created.
     };
 
 
@@ -80,6 +88,18 @@ namespace nvtt
 
         void * wrapperProxy;    // For the C/C# wrapper.
 
+        // Number of bytes output with writeData, and the layout of the DDS texture whose header started the output,
+        // which places its images with OutputHandler::writeDataAt. Images that are not part of it are placed after
+        // layoutEnd. Once an image has been placed, the position of the handler no longer follows the output.
+        // The layout is set by outputHeader, layoutEnd and positioned are updated by the threads that compress images.
+        mutable uint64 position;
+        mutable bool hasLayout;
+        mutable uint64 layoutOffset;
+        mutable uint64 layoutEnd;
+        mutable int layoutWidth, layoutHeight, layoutDepth;
+        mutable int layoutFaceCount, layoutMipmapCount;
+        mutable uint32 positioned;
+
         bool hasValidOutputHandler() const;
 
         void beginImage(int size, int width, int height, int depth, int face, int miplevel) const;
@@ -29,6 +29,7 @@
 #include "nvmath/Matrix.inl"
 #include "nvmath/Color.h"
 #include "nvmath/Half.h"
+#include "nvmath/Gamma.h"
 #include "nvmath/ftoi.h"
 #include "nvmath/PackedFloat.h"
 
@@ -42,6 +43,9 @@
 #include "nvimage/DirectDrawSurface.h"
 
 #include "nvthread/ParallelFor.h"
+#include "nvthread/Thread.h"
+#include "nvthread/Atomic.h"
+#include "nvthread/Mutex.h"
 
 #include "nvcore/Array.inl"
 #include "nvcore/StrLib.h"
@@ -54,6 +58,12 @@
 #include <math.h> // exp2f and log2f
 #endif
 
+#if NV_USE_SSE > 1
+#include <emmintrin.h> // SSE2
+#elif NV_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace nv;
 using namespace nvtt;
 
@@ -150,6 +160,15 @@ namespace
         if (input > 0) return 1 << input;
         return ~input;
     }*/
+
+    // Number of floats processed by each task of the parallel loops.
+    static const uint s_chunkSize = 16 * 1024;
+
+    static inline float saturateOrZero(float f)
+    {
+        // NaNs map to 0.
+        return (f > 0.0f) ? ((f < 1.0f) ? f : 1.0f) : 0.0f;
+    }
 }
 
 bool nv::canMakeNextMipmap(uint w, uint h, uint d, uint min_size)
@@ -352,6 +371,13 @@ void Surface::operator=(const Surface & tex)
 }
 
 void Surface::detach()
+{
+    detach(0, 4);
+}
+
+// Copy on write at channel granularity. Surfaces share their private data and, after that's copied, the channels
+// of their images; only the channels in [firstChannel, firstChannel + channelCount) are copied here.
+void Surface::detach(int firstChannel, int channelCount)
 {
     if (m->refCount() > 1)
     {
@@ -360,13 +386,254 @@ void Surface::detach()
         m->addRef();
         nvDebugCheck(m->refCount() == 1);
     }
+
+    // Mutable operations work on floats, add the channels they modify if the surface doesn't have them.
+    m->expand(firstChannel + channelCount);
+
+    // Copy shared and wrapped channels.
+    if (m->image != NULL) {
+        m->image->detach(firstChannel, channelCount);
+    }
+
+    // Pointers returned by data() and channel() are invalidated by modifications.
+    m->releaseView();
+}
+
+// Copy on write of the private data alone, for the operations that don't modify the texels. Packed texels are copied
+// as they are.
+void Surface::detachPrivate()
+{
+    if (m->refCount() > 1)
+    {
+        m->release();
+        m = new Surface::Private(*m);
+        m->addRef();
+    }
+}
+
+// Detach before the image is replaced. Its texels are neither copied nor decoded: a shared surface gets private data
+// without an image, otherwise the packed texels are freed and the image is kept so that its memory can be reused.
+void Surface::discardImage()
+{
+    if (m->refCount() > 1)
+    {
+        Surface::Private * p = new Surface::Private();
+        p->type = m->type;
+        p->wrapMode = m->wrapMode;
+        p->alphaMode = m->alphaMode;
+        p->isNormalMap = m->isNormalMap;
+
+        m->release();
+        m = p;
+        m->addRef();
+    }
+    else
+    {
+        nv::free(m->packed);
+        m->packed = NULL;
+        m->precision = StoragePrecision_Float;
+        m->releaseView();
+    }
+}
+
+size_t Surface::Private::packedSize() const
+{
+    const uint64 count = image->floatCount();
+    if (precision == StoragePrecision_UNorm8) return count;
+    if (precision == StoragePrecision_Half || precision == StoragePrecision_UNorm16) return 2 * count;
+    return 4 * count;
+}
+
+void Surface::Private::pack(StoragePrecision p)
+{
+    if (image == NULL) return;
+
+    unpack();
+    releaseView();
+
+    if (p == StoragePrecision_Float) return;
+
+    precision = p;
+    packed = malloc<uint8>(packedSize());
+
+    image->makeContiguous();
+
+    const float * src = image->channel(0);
+    const uint64 count = image->floatCount();
+
+    if (precision == StoragePrecision_Half) {
+        uint16 * dst = (uint16 *)packed;
+        parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+            half_from_float_array(src + begin, dst + begin, uint(end - begin));
+        });
+    }
+    else if (precision == StoragePrecision_UNorm16) {
+        uint16 * dst = (uint16 *)packed;
+        parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) dst[i] = uint16(saturateOrZero(src[i]) * 65535.0f + 0.5f);
+        });
+    }
+    else if (precision == StoragePrecision_UNorm8) {
+        uint8 * dst = packed;
+        parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) dst[i] = uint8(saturateOrZero(src[i]) * 255.0f + 0.5f);
+        });
+    }
+
+    // Keep the header, release the texels.
+    image->free();
+}
+
+void Surface::Private::unpack()
+{
+    if (packed == NULL) return;
+
+    image->allocate(image->componentCount(), image->width(), image->height(), image->depth());
+    decode(image->channel(0));
+
+    nv::free(packed);
+    packed = NULL;
+    precision = StoragePrecision_Float;
+}
+
+// Decode all the packed channels to dst, one after another.
+void Surface::Private::decode(float * dst) const
+{
+    parallel_for_range(image->floatCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+        decode(begin, uint(end - begin), dst + begin);
+    });
+}
+
+// Decode count packed floats starting at the given index, channels are stored one after another.
+void Surface::Private::decode(uint64 first, uint count, float * dst) const
+{
+    nvDebugCheck(packed != NULL);
+    nvDebugCheck(first + count <= image->floatCount());
+
+    if (precision == StoragePrecision_Half) {
+        half_to_float_array((const uint16 *)packed + first, dst, count);
+    }
+    else if (precision == StoragePrecision_UNorm16) {
+        const uint16 * src = (const uint16 *)packed + first;
+        for (uint i = 0; i < count; i++) dst[i] = float(src[i]) * (1.0f / 65535.0f);
+    }
+    else if (precision == StoragePrecision_UNorm8) {
+        const uint8 * src = packed + first;
+        for (uint i = 0; i < count; i++) dst[i] = float(src[i]) * (1.0f / 255.0f);
+    }
+}
+
+void Surface::Private::expand(uint channelCount)
+{
+    unpack();
+
+    if (image != NULL && image->componentCount() < channelCount) {
+        image->resizeChannelCount(channelCount);
+    }
+}
+
+void Surface::Private::resizeChannelCount(uint channelCount)
+{
+    if (packed != NULL) {
+        // The channels are packed one after another, and zero is packed as zero bits at every precision.
+        const size_t oldSize = packedSize();
+        image->setHeader(channelCount, image->width(), image->height(), image->depth());
+        const size_t size = packedSize();
+
+        packed = nv::realloc<uint8>(packed, size);
+        if (size > oldSize) memset(packed + oldSize, 0, size - oldSize);
+    }
+    else {
+        image->resizeChannelCount(channelCount);
+    }
+}
+
+nv::FloatImage * Surface::Private::createReadImage(uint channelCount) const
+{
+    if (image == NULL) return NULL;
+
+    FloatImage * img = new FloatImage();
+    const uint c = image->componentCount();
+
+    if (packed != NULL) {
+        img->allocate(c, image->width(), image->height(), image->depth());
+        decode(img->channel(0));
+    }
+    else {
+        // Reference the channels without touching their reference counts, they are only read.
+        const float * channels[16];
+        nvDebugCheck(c <= 16);
+        for (uint i = 0; i < c; i++) {
+            channels[i] = image->channel(i);
+        }
+        img->wrap(c, image->width(), image->height(), image->depth(), channels);
+    }
+
+    if (c < channelCount) {
+        img->resizeChannelCount(channelCount);
+    }
+
+    return img;
+}
+
+const nv::FloatImage * Surface::Private::readImage(uint channelCount, AutoPtr<FloatImage> & tmp) const
+{
+    if (image == NULL) return NULL;
+    if (packed == NULL && image->componentCount() >= channelCount) return image;
+
+    tmp = createReadImage(channelCount);
+    return tmp.ptr();
+}
+
+static Mutex & viewMutex()
+{
+    static Mutex mutex("Surface view");
+    return mutex;
+}
+
+const nv::FloatImage * Surface::Private::floatView() const
+{
+    Lock<Mutex> lock(viewMutex());
+
+    if (view == NULL) {
+        FloatImage * img = createReadImage(4);
+        img->makeContiguous();
+        view = img;
+    }
+
+    return view;
+}
+
+void Surface::Private::releaseView()
+{
+    delete view;
+    view = NULL;
+}
+
+void Surface::setStoragePrecision(StoragePrecision precision)
+{
+    if (isNull() || m->precision == precision) return;
+
+    if (m->refCount() > 1) {
+        // Pack a private copy, the packed texels of a shared surface are copied without expanding them.
+        m->release();
+        m = new Surface::Private(*m);
+        m->addRef();
+    }
+
+    m->pack(precision);
+}
+
+StoragePrecision Surface::storagePrecision() const
+{
+    return m->precision;
 }
 
 void Surface::setWrapMode(WrapMode wrapMode)
 {
     if (m->wrapMode != wrapMode)
     {
-        detach();
+        detachPrivate();
         m->wrapMode = wrapMode;
     }
 }
@@ -375,7 +642,7 @@ void Surface::setAlphaMode(AlphaMode alphaMode)
 {
     if (m->alphaMode != alphaMode)
     {
-        detach();
+        detachPrivate();
         m->alphaMode = alphaMode;
     }
 }
@@ -384,7 +651,7 @@ void Surface::setNormalMap(bool isNormalMap)
 {
     if (m->isNormalMap != isNormalMap)
     {
-        detach();
+        detachPrivate();
         m->isNormalMap = isNormalMap;
     }
 }
@@ -412,6 +679,23 @@ int Surface::depth() const
     return 0;
 }
 
+int Surface::channelCount() const
+{
+    if (m->image != NULL) return m->image->componentCount();
+    return 0;
+}
+
+void Surface::setChannelCount(int count)
+{
+    nvCheck(count >= 1 && count <= 4);
+    if (isNull() || channelCount() == count) return;
+
+    detachPrivate();
+
+    m->resizeChannelCount(count);
+    m->releaseView();
+}
+
 WrapMode Surface::wrapMode() const
 {
     return m->wrapMode;
@@ -447,25 +731,29 @@ int Surface::countMipmaps(int min_size) const
 float Surface::alphaTestCoverage(float alphaRef/*= 0.5*/, int alpha_channel/*=3*/) const
 {
     if (m->image == NULL) return 0.0f;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(alpha_channel + 1, tmp);
 
     alphaRef = nv::clamp(alphaRef, 1.0f/256, 255.0f/256);
 
-    return m->image->alphaTestCoverage(alphaRef, alpha_channel);
+    return img->alphaTestCoverage(alphaRef, alpha_channel);
 }
 
 float Surface::average(int channel, int alpha_channel/*= -1*/, float gamma /*= 2.2f*/) const
 {
     if (m->image == NULL) return 0.0f;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(max(channel, alpha_channel) + 1, tmp);
 
-    const uint count = m->image->width() * m->image->height();
+    const uint64 count = uint64(img->width()) * img->height();
 
     float sum = 0.0f;
-    const float * c = m->image->channel(channel);
+    const float * c = img->channel(channel);
 
     float denom;
 
     if (alpha_channel == -1) {
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             sum += powf(c[i], gamma);
         }
 
@@ -473,9 +761,9 @@ float Surface::average(int channel, int alpha_channel/*= -1*/, float gamma /*= 2
     }
     else {
         float alpha_sum = 0.0f;
-        const float * a = m->image->channel(alpha_channel);
+        const float * a = img->channel(alpha_channel);
         
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             sum += powf(c[i], gamma) * a[i];
             alpha_sum += a[i];
         }
@@ -491,13 +779,26 @@ float Surface::average(int channel, int alpha_channel/*= -1*/, float gamma /*= 2
 
 const float * Surface::data() const
 {
-    return m->image->channel(0);
+    const FloatImage * img = m->image;
+    if (img == NULL) return NULL;
+
+    if (m->packed == NULL && img->componentCount() == 4 && img->isContiguous()) {
+        return img->channel(0);
+    }
+    return m->floatView()->channel(0);
 }
 
 const float * Surface::channel(int i) const
 {
     if (i < 0 || i > 3) return NULL;
-    return m->image->channel(i);
+
+    const FloatImage * img = m->image;
+    if (img == NULL) return NULL;
+
+    if (m->packed == NULL && uint(i) < img->componentCount()) {
+        return img->channel(i);
+    }
+    return m->floatView()->channel(i);
 }
 
 
@@ -507,14 +808,16 @@ void Surface::histogram(int channel, float rangeMin, float rangeMax, int binCoun
     //memset(bins, 0, sizeof(int)*count);
 
     if (m->image == NULL) return;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(channel + 1, tmp);
 
-    const float * c = m->image->channel(channel);
+    const float * c = img->channel(channel);
 
     float scale = float(binCount) / rangeMax;
     float bias = - scale * rangeMin;
 
-    const uint count = m->image->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float f = c[i] * scale + bias;
         int idx = ftoi_floor(f);
         if (idx < 0) idx = 0;
@@ -527,15 +830,16 @@ void Surface::range(int channel, float * rangeMin, float * rangeMax, int alpha_c
 {
     Vector2 range(FLT_MAX, -FLT_MAX);
 
-    FloatImage * img = m->image;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(max(channel, alpha_channel) + 1, tmp);
 
     if (alpha_channel == -1) { // no alpha channel; just like the original range function
 
-        if (m->image != NULL) {
-            float * c = img->channel(channel);
+        if (img != NULL) {
+            const float * c = img->channel(channel);
 
-            const uint count = img->pixelCount();
-            for (uint p = 0; p < count; p++) {
+            const uint64 count = img->pixelCount();
+            for (uint64 p = 0; p < count; p++) {
                 float f = c[p];
                 if (f < range.x) range.x = f;
                 if (f > range.y) range.y = f;
@@ -545,13 +849,13 @@ void Surface::range(int channel, float * rangeMin, float * rangeMax, int alpha_c
     else { // use alpha test to ignore some pixels
         //note, it's quite possible to get FLT_MAX,-FLT_MAX back if all pixels fail the test
 
-        if (m->image != NULL)
+        if (img != NULL)
         {
             const float * c = img->channel(channel);
             const float * a = img->channel(alpha_channel);
 
-            const uint count = img->pixelCount();
-            for (uint p = 0; p < count; p++) {
+            const uint64 count = img->pixelCount();
+            for (uint64 p = 0; p < count; p++) {
                 if(a[p]>alpha_ref) {
                     float f = c[p];
                     if (f < range.x) range.x = f;
@@ -565,6 +869,297 @@ void Surface::range(int channel, float * rangeMin, float * rangeMax, int alpha_c
     if (rangeMax) *rangeMax = range.y;
 }
 
+StatsRequest::StatsRequest()
+{
+    alphaChannel = 3;
+    alphaRefCount = 0;
+    for (int i = 0; i < MaxAlphaRefCount; i++) alphaRefs[i] = 0.5f;
+    histogramChannel = -1;
+    histogramMin = 0.0f;
+    histogramMax = 1.0f;
+    histogramBinCount = 0;
+    histogramBins = NULL;
+}
+
+namespace
+{
+    // Partial results of one analyze task, reduced in task order so that the results do not depend on scheduling.
+    struct StatsPartial
+    {
+        float minimum[4];
+        float maximum[4];
+        double sum[4];
+        double sumSquares[4];
+        uint64 coverage[StatsRequest::MaxAlphaRefCount];
+        Array<int> bins;
+    };
+
+    static void accumulateRow(const float * c, uint w, float * minimum, float * maximum, double * sum, double * sumSquares)
+    {
+        uint x = 0;
+        float mn = *minimum, mx = *maximum;
+        double s = 0.0, ss = 0.0;
+
+#if NV_USE_SSE > 1
+        __m128 vmin = _mm_set1_ps(mn);
+        __m128 vmax = _mm_set1_ps(mx);
+        __m128d vsum = _mm_setzero_pd();
+        __m128d vsumSquares = _mm_setzero_pd();
+
+        for (; x + 4 <= w; x += 4) {
+            const __m128 v = _mm_loadu_ps(c + x);
+
+            // The second operand is returned when either is a NaN, so NaNs are ignored like in Surface::range.
+            vmin = _mm_min_ps(v, vmin);
+            vmax = _mm_max_ps(v, vmax);
+
+            const __m128d lo = _mm_cvtps_pd(v);
+            const __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+            vsum = _mm_add_pd(vsum, _mm_add_pd(lo, hi));
+            vsumSquares = _mm_add_pd(vsumSquares, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+
+        NV_ALIGN_16 float tmp[4];
+        _mm_store_ps(tmp, vmin);
+        for (int i = 0; i < 4; i++) if (tmp[i] < mn) mn = tmp[i];
+        _mm_store_ps(tmp, vmax);
+        for (int i = 0; i < 4; i++) if (tmp[i] > mx) mx = tmp[i];
+
+        NV_ALIGN_16 double tmpd[2];
+        _mm_store_pd(tmpd, vsum);
+        s = tmpd[0] + tmpd[1];
+        _mm_store_pd(tmpd, vsumSquares);
+        ss = tmpd[0] + tmpd[1];
+#endif
+
+        for (; x < w; x++) {
+            const float f = c[x];
+            if (f < mn) mn = f;
+            if (f > mx) mx = f;
+            s += f;
+            ss += double(f) * f;
+        }
+
+        *minimum = mn;
+        *maximum = mx;
+        *sum += s;
+        *sumSquares += ss;
+    }
+
+    // Same bilinear 4x4 subsampling as FloatImage::alphaTestCoverage, between the rows a0 and a1, for several reference
+    // values at once. Returns the number of covered samples in coverage.
+    static void accumulateCoverageRow(const float * a0, const float * a1, uint w, const float * alphaRefs, int alphaRefCount, uint64 * coverage)
+    {
+        const uint n = 4;
+
+        uint x = 0;
+
+#if NV_USE_SSE > 1
+        static const uint8 s_bitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 fx = _mm_setr_ps(0.5f / n, 1.5f / n, 2.5f / n, 3.5f / n);
+        const __m128 ofx = _mm_sub_ps(one, fx);
+
+        for (; x + 1 < w; x++) {
+            const __m128 alpha00 = _mm_min_ps(_mm_max_ps(_mm_set1_ps(a0[x + 0]), zero), one);
+            const __m128 alpha10 = _mm_min_ps(_mm_max_ps(_mm_set1_ps(a0[x + 1]), zero), one);
+            const __m128 alpha01 = _mm_min_ps(_mm_max_ps(_mm_set1_ps(a1[x + 0]), zero), one);
+            const __m128 alpha11 = _mm_min_ps(_mm_max_ps(_mm_set1_ps(a1[x + 1]), zero), one);
+
+            // Rows of the 4x4 samples, lanes are the horizontal sample positions.
+            __m128 alpha[n];
+            for (uint sy = 0; sy < n; sy++) {
+                const __m128 fy = _mm_set1_ps((sy + 0.5f) / n);
+                const __m128 ofy = _mm_sub_ps(one, fy);
+                alpha[sy] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(_mm_mul_ps(alpha00, ofx), ofy),
+                    _mm_mul_ps(_mm_mul_ps(alpha10, fx), ofy)),
+                    _mm_mul_ps(_mm_mul_ps(alpha01, ofx), fy)),
+                    _mm_mul_ps(_mm_mul_ps(alpha11, fx), fy));
+            }
+
+            for (int r = 0; r < alphaRefCount; r++) {
+                const __m128 ref = _mm_set1_ps(alphaRefs[r]);
+                uint count = 0;
+                for (uint sy = 0; sy < n; sy++) {
+                    count += s_bitCount[_mm_movemask_ps(_mm_cmpgt_ps(alpha[sy], ref))];
+                }
+                coverage[r] += count;
+            }
+        }
+#endif
+
+        for (; x + 1 < w; x++) {
+            const float alpha00 = saturate(a0[x + 0]);
+            const float alpha10 = saturate(a0[x + 1]);
+            const float alpha01 = saturate(a1[x + 0]);
+            const float alpha11 = saturate(a1[x + 1]);
+
+            for (uint sy = 0; sy < n; sy++) {
+                const float fy = (sy + 0.5f) / n;
+                for (uint sx = 0; sx < n; sx++) {
+                    const float fx = (sx + 0.5f) / n;
+                    const float alpha = alpha00 * (1 - fx) * (1 - fy) + alpha10 * fx * (1 - fy) + alpha01 * (1 - fx) * fy + alpha11 * fx * fy;
+                    for (int r = 0; r < alphaRefCount; r++) {
+                        if (alpha > alphaRefs[r]) coverage[r]++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Computes all the requested statistics in a single pass over the rows of the surface.
+SurfaceStats Surface::analyze(const StatsRequest & request) const
+{
+    SurfaceStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (m->image == NULL) return stats;
+
+    // Packed surfaces are decoded one row at a time, the texels of the surface are not modified.
+    const FloatImage * img = m->image;
+    const bool packed = (m->packed != NULL);
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint rowCount = h * img->depth();
+    const uint channelCount = img->componentCount();
+    const uint64 texelCount = img->pixelCount();
+
+    const int alphaRefCount = nv::clamp(request.alphaRefCount, 0, int(StatsRequest::MaxAlphaRefCount));
+    const bool hasAlpha = request.alphaChannel >= 0 && request.alphaChannel < int(channelCount);
+    float alphaRefs[StatsRequest::MaxAlphaRefCount];
+    for (int r = 0; r < alphaRefCount; r++) {
+        alphaRefs[r] = nv::clamp(request.alphaRefs[r], 1.0f/256, 255.0f/256);
+    }
+
+    const int binCount = request.histogramBins != NULL ? request.histogramBinCount : 0;
+    const bool hasHistogram = binCount > 0 && request.histogramChannel >= 0 && request.histogramChannel < 4;
+    const float histogramScale = float(binCount) / (request.histogramMax - request.histogramMin);
+    const float histogramBias = -histogramScale * request.histogramMin;
+
+    // Split the rows in enough tasks to keep the threads busy, but not so many that the partials get expensive.
+    const uint rowsPerTask = max(1U, min(rowCount, uint(s_chunkSize / max(1U, w))));
+    const uint taskCount = min((rowCount + rowsPerTask - 1) / rowsPerTask, 64U);
+    const uint taskRows = (rowCount + taskCount - 1) / taskCount;
+
+    Array<StatsPartial> partials;
+    partials.resize(taskCount);
+
+    auto task = [&](int t) {
+        StatsPartial & p = partials[t];
+        for (uint c = 0; c < 4; c++) {
+            p.minimum[c] = FLT_MAX;
+            p.maximum[c] = -FLT_MAX;
+            p.sum[c] = 0.0;
+            p.sumSquares[c] = 0.0;
+        }
+        for (int r = 0; r < alphaRefCount; r++) p.coverage[r] = 0;
+        if (hasHistogram) {
+            p.bins.resize(binCount);
+            memset(p.bins.buffer(), 0, sizeof(int) * binCount);
+        }
+
+        const uint rowBegin = t * taskRows;
+        const uint rowEnd = min(rowBegin + taskRows, rowCount);
+
+        // Rows of all the channels, plus the next row of alpha.
+        Array<float> scratch;
+        if (packed) scratch.resize((channelCount + 1) * w);
+
+        auto rowPointer = [&](uint c, uint64 offset, uint slot) -> const float * {
+            if (!packed) return img->channel(c) + offset;
+            float * dst = scratch.buffer() + slot * w;
+            m->decode(c * texelCount + offset, w, dst);
+            return dst;
+        };
+
+        for (uint row = rowBegin; row < rowEnd; row++) {
+            const uint64 offset = uint64(row) * w;
+
+            const float * rows[4];
+            for (uint c = 0; c < channelCount; c++) {
+                rows[c] = rowPointer(c, offset, c);
+                accumulateRow(rows[c], w, &p.minimum[c], &p.maximum[c], &p.sum[c], &p.sumSquares[c]);
+            }
+
+            // Alpha coverage only looks at the first slice, like FloatImage::alphaTestCoverage.
+            if (hasAlpha && alphaRefCount > 0 && row + 1 < h) {
+                const float * a = rows[request.alphaChannel];
+                accumulateCoverageRow(a, rowPointer(request.alphaChannel, offset + w, channelCount), w, alphaRefs, alphaRefCount, p.coverage);
+            }
+
+            if (hasHistogram && request.histogramChannel < int(channelCount)) {
+                const float * c = rows[request.histogramChannel];
+                for (uint x = 0; x < w; x++) {
+                    int idx = ftoi_floor(c[x] * histogramScale + histogramBias);
+                    if (idx < 0) idx = 0;
+                    if (idx > binCount - 1) idx = binCount - 1;
+                    p.bins[idx]++;
+                }
+            }
+        }
+    };
+
+    if (taskCount > 1) nv::parallel_for(taskCount, 1, task);
+    else task(0);
+
+    double sum[4] = { 0, 0, 0, 0 };
+    double sumSquares[4] = { 0, 0, 0, 0 };
+    uint64 coverage[StatsRequest::MaxAlphaRefCount] = { 0 };
+
+    for (uint c = 0; c < 4; c++) {
+        stats.minimum[c] = FLT_MAX;
+        stats.maximum[c] = -FLT_MAX;
+    }
+
+    for (uint t = 0; t < taskCount; t++) {
+        const StatsPartial & p = partials[t];
+        for (uint c = 0; c < channelCount; c++) {
+            stats.minimum[c] = min(stats.minimum[c], p.minimum[c]);
+            stats.maximum[c] = max(stats.maximum[c], p.maximum[c]);
+            sum[c] += p.sum[c];
+            sumSquares[c] += p.sumSquares[c];
+        }
+        for (int r = 0; r < alphaRefCount; r++) coverage[r] += p.coverage[r];
+        if (hasHistogram) {
+            for (int i = 0; i < binCount; i++) request.histogramBins[i] += p.bins[i];
+        }
+    }
+
+    // Missing channels read as zero.
+    if (hasHistogram && request.histogramChannel >= int(channelCount)) {
+        int idx = ftoi_floor(histogramBias);
+        if (idx < 0) idx = 0;
+        if (idx > binCount - 1) idx = binCount - 1;
+        request.histogramBins[idx] += int(texelCount);
+    }
+
+    for (uint c = 0; c < 4; c++) {
+        if (c < channelCount) {
+            const double mean = sum[c] / double(texelCount);
+            stats.mean[c] = float(mean);
+            stats.variance[c] = float(max(sumSquares[c] / double(texelCount) - mean * mean, 0.0));
+        }
+        else {
+            stats.minimum[c] = 0.0f;
+            stats.maximum[c] = 0.0f;
+        }
+        stats.isConstant[c] = stats.minimum[c] == stats.maximum[c];
+    }
+
+    if (hasAlpha && w > 1 && h > 1) {
+        const double sampleCount = double(w - 1) * double(h - 1) * 16;
+        for (int r = 0; r < alphaRefCount; r++) {
+            stats.alphaCoverage[r] = float(double(coverage[r]) / sampleCount);
+        }
+    }
+
+    return stats;
+}
+
 bool Surface::load(const char * fileName, bool * hasAlpha/*= NULL*/)
 {
     AutoPtr<FloatImage> img(ImageIO::loadFloat(fileName));
@@ -584,8 +1179,14 @@ bool Surface::load(const char * fileName, bool * hasAlpha/*= NULL*/)
             int h = dds.surfaceHeight(0);
             uint size = dds.surfaceSize(0);
 
-            void * data = malloc(size);
-            dds.readSurface(0, 0, data, size);
+            // Decode straight from the mapped file when possible.
+            const void * data = dds.surfaceData(0, 0);
+            void * buffer = NULL;
+            if (data == NULL) {
+                buffer = malloc(size);
+                dds.readSurface(0, 0, buffer, size);
+                data = buffer;
+            }
 
             // @@ Handle all formats! @@ Get nvtt format from dds.surfaceFormat() ?
 
@@ -627,7 +1228,7 @@ bool Surface::load(const char * fileName, bool * hasAlpha/*= NULL*/)
                 }
             }
 
-            free(data);
+            free(buffer);
         }
         else {
             // @@ Separate image decoder from dds reader.
@@ -646,14 +1247,16 @@ bool Surface::load(const char * fileName, bool * hasAlpha/*= NULL*/)
         return true;
     }
 
-    detach();
+    discardImage();
 
     if (hasAlpha != NULL) {
         *hasAlpha = (img->componentCount() == 4);
     }
 
-    // @@ Have loadFloat allocate the image with the desired number of channels.
-    img->resizeChannelCount(4); // Block compressors expect a 4 channel texture.
+    // Keep the channels of the file, missing ones are implicitly zero.
+    if (img->componentCount() > 4) {
+        img->resizeChannelCount(4);
+    }
 
     delete m->image;
     m->image = img.release();
@@ -666,13 +1269,15 @@ bool Surface::save(const char * fileName, bool hasAlpha/*=0*/, bool hdr/*=0*/) c
     if (m->image == NULL) {
         return false;
     }
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(4, tmp);
 
     if (hdr) {
-        return ImageIO::saveFloat(fileName, m->image, 0, 4);
+        return ImageIO::saveFloat(fileName, img, 0, 4);
     }
     else {
-        uint c = min<uint>(m->image->componentCount(), 4);
-        AutoPtr<Image> image(m->image->createImage(0, c));
+        uint c = min<uint>(img->componentCount(), 4);
+        AutoPtr<Image> image(img->createImage(0, c));
         nvCheck(image != NULL);
 
         if (hasAlpha) {
@@ -686,7 +1291,7 @@ bool Surface::save(const char * fileName, bool hasAlpha/*=0*/, bool hdr/*=0*/) c
 
 bool Surface::setImage(int w, int h, int d)
 {
-    detach();
+    discardImage();
 
     if (m->image == NULL) {
         m->image = new FloatImage();
@@ -725,35 +1330,133 @@ static int filter(unsigned int code, struct _EXCEPTION_POINTERS *ep) {
 
 #endif
 
+// Input conversion kernels. Each of them converts the texels in [begin, end) to planar floats.
+
+// Bytes are divided by 255 like in the scalar path, so that the results are identical.
+static void convertBGRA8(const Color32 * src, float * r, float * g, float * b, float * a, uint64 begin, uint64 end)
+{
+    uint64 i = begin;
+
+#if NV_USE_SSE > 1
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128i mask = _mm_set1_epi32(0xFF);
+
+    for (; i + 4 <= end; i += 4) {
+        // Color32 stores the bytes in b, g, r, a order.
+        const __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(b + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), scale));
+        _mm_storeu_ps(g + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask)), scale));
+        _mm_storeu_ps(r + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask)), scale));
+        _mm_storeu_ps(a + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_srli_epi32(p, 24)), scale));
+    }
+#endif
+
+    for (; i < end; i++) {
+        r[i] = float(src[i].r) / 255.0f;
+        g[i] = float(src[i].g) / 255.0f;
+        b[i] = float(src[i].b) / 255.0f;
+        a[i] = float(src[i].a) / 255.0f;
+    }
+}
+
+static void convertRGBA32F(const float * src, float * r, float * g, float * b, float * a, uint64 begin, uint64 end)
+{
+    uint64 i = begin;
+
+#if NV_USE_SSE
+    for (; i + 4 <= end; i += 4) {
+        __m128 p0 = _mm_loadu_ps(src + 4 * i + 0);
+        __m128 p1 = _mm_loadu_ps(src + 4 * i + 4);
+        __m128 p2 = _mm_loadu_ps(src + 4 * i + 8);
+        __m128 p3 = _mm_loadu_ps(src + 4 * i + 12);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _mm_storeu_ps(r + i, p0);
+        _mm_storeu_ps(g + i, p1);
+        _mm_storeu_ps(b + i, p2);
+        _mm_storeu_ps(a + i, p3);
+    }
+#endif
+
+    for (; i < end; i++) {
+        r[i] = src[4 * i + 0];
+        g[i] = src[4 * i + 1];
+        b[i] = src[4 * i + 2];
+        a[i] = src[4 * i + 3];
+    }
+}
+
+static void convertRGBA16F(const uint16 * src, float * r, float * g, float * b, float * a, uint64 begin, uint64 end)
+{
+    // Expand a few texels at a time and deinterleave them like RGBA32F.
+    float tmp[4 * 256];
+    for (uint64 i = begin; i < end; i += 256) {
+        const uint n = uint(min<uint64>(end - i, 256));
+        half_to_float_array(src + 4 * i, tmp, 4 * n);
+        convertRGBA32F(tmp, r + i, g + i, b + i, a + i, 0, n);
+    }
+}
+
+static void convertUNorm8(const uint8 * src, float * dst, uint64 begin, uint64 end)
+{
+    uint64 i = begin;
+
+#if NV_USE_SSE > 1
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= end; i += 16) {
+        const __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i lo = _mm_unpacklo_epi8(p, zero);
+        const __m128i hi = _mm_unpackhi_epi8(p, zero);
+        _mm_storeu_ps(dst + i + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+#endif
+
+    for (; i < end; i++) {
+        dst[i] = float(src[i]) / 255.0f;
+    }
+}
+
+static void convertHalf(const uint16 * src, float * dst, uint64 begin, uint64 end)
+{
+    half_to_float_array(src + begin, dst + begin, uint(end - begin));
+}
+
 bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void * data)
 {
-    detach();
+    discardImage();
 
     if (m->image == NULL) {
         m->image = new FloatImage();
     }
-    m->image->allocate(4, w, h, d);
+    // Single channel inputs don't allocate the channels they don't have.
+    const uint channelCount = (format == InputFormat_R_32F) ? 1 : 4;
+    m->image->allocate(channelCount, w, h, d);
     m->type = (d == 1) ? TextureType_2D : TextureType_3D;
 
-    const int count = m->image->pixelCount();
+    const uint64 count = m->image->pixelCount();
 
     float * rdst = m->image->channel(0);
-    float * gdst = m->image->channel(1);
-    float * bdst = m->image->channel(2);
-    float * adst = m->image->channel(3);
+    float * gdst = NULL;
+    float * bdst = NULL;
+    float * adst = NULL;
+    if (channelCount == 4) {
+        gdst = m->image->channel(1);
+        bdst = m->image->channel(2);
+        adst = m->image->channel(3);
+    }
 
     if (format == InputFormat_BGRA_8UB)
     {
         const Color32 * src = (const Color32 *)data;
 
         TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = float(src[i].r) / 255.0f;
-                gdst[i] = float(src[i].g) / 255.0f;
-                bdst[i] = float(src[i].b) / 255.0f;
-                adst[i] = float(src[i].a) / 255.0f;
-            }
+            parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+                convertBGRA8(src, rdst, gdst, bdst, adst, begin, end);
+            });
         }
         CATCH {
             return false;
@@ -764,13 +1467,9 @@ bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void
         const uint16 * src = (const uint16 *)data;
 
         TRY {
-            for (int i = 0; i < count; i++)
-            {
-                ((uint32 *)rdst)[i] = half_to_float(src[4*i+0]);
-                ((uint32 *)gdst)[i] = half_to_float(src[4*i+1]);
-                ((uint32 *)bdst)[i] = half_to_float(src[4*i+2]);
-                ((uint32 *)adst)[i] = half_to_float(src[4*i+3]);
-            }
+            parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+                convertRGBA16F(src, rdst, gdst, bdst, adst, begin, end);
+            });
         }
         CATCH {
             return false;
@@ -781,13 +1480,9 @@ bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void
         const float * src = (const float *)data;
 
         TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = src[4 * i + 0];
-                gdst[i] = src[4 * i + 1];
-                bdst[i] = src[4 * i + 2];
-                adst[i] = src[4 * i + 3];
-            }
+            parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+                convertRGBA32F(src, rdst, gdst, bdst, adst, begin, end);
+            });
         }
         CATCH {
             return false;
@@ -798,13 +1493,7 @@ bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void
         const float * src = (const float *)data;
 
         TRY {
-            for (int i = 0; i < count; i++)
-            {
-                rdst[i] = src[i];
-                gdst[i] = 0;
-                bdst[i] = 0;
-                adst[i] = 0;
-            }
+            memcpy(rdst, src, count * sizeof(float));
         }
         CATCH {
             return false;
@@ -816,20 +1505,26 @@ bool Surface::setImage(nvtt::InputFormat format, int w, int h, int d, const void
 
 bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r, const void * g, const void * b, const void * a)
 {
-    detach();
+    discardImage();
 
     if (m->image == NULL) {
         m->image = new FloatImage();
     }
-    m->image->allocate(4, w, h, d);
+    const uint channelCount = (format == InputFormat_R_32F) ? 1 : 4;
+    m->image->allocate(channelCount, w, h, d);
     m->type = (d == 1) ? TextureType_2D : TextureType_3D;
 
-    const int count = m->image->pixelCount();
+    const uint64 count = m->image->pixelCount();
 
     float * rdst = m->image->channel(0);
-    float * gdst = m->image->channel(1);
-    float * bdst = m->image->channel(2);
-    float * adst = m->image->channel(3);
+    float * gdst = NULL;
+    float * bdst = NULL;
+    float * adst = NULL;
+    if (channelCount == 4) {
+        gdst = m->image->channel(1);
+        bdst = m->image->channel(2);
+        adst = m->image->channel(3);
+    }
 
     if (format == InputFormat_BGRA_8UB)
     {
@@ -839,10 +1534,12 @@ bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r,
         const uint8 * asrc = (const uint8 *)a;
 
         TRY {
-            for (int i = 0; i < count; i++) rdst[i] = float(rsrc[i]) / 255.0f;
-            for (int i = 0; i < count; i++) gdst[i] = float(gsrc[i]) / 255.0f;
-            for (int i = 0; i < count; i++) bdst[i] = float(bsrc[i]) / 255.0f;
-            for (int i = 0; i < count; i++) adst[i] = float(asrc[i]) / 255.0f;
+            parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+                convertUNorm8(rsrc, rdst, begin, end);
+                convertUNorm8(gsrc, gdst, begin, end);
+                convertUNorm8(bsrc, bdst, begin, end);
+                convertUNorm8(asrc, adst, begin, end);
+            });
         }
         CATCH {
             return false;
@@ -856,10 +1553,12 @@ bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r,
         const uint16 * asrc = (const uint16 *)a;
 
         TRY {
-            for (int i = 0; i < count; i++) ((uint32 *)rdst)[i] = half_to_float(rsrc[i]);
-            for (int i = 0; i < count; i++) ((uint32 *)gdst)[i] = half_to_float(gsrc[i]);
-            for (int i = 0; i < count; i++) ((uint32 *)bdst)[i] = half_to_float(bsrc[i]);
-            for (int i = 0; i < count; i++) ((uint32 *)adst)[i] = half_to_float(asrc[i]);
+            parallel_for_range(count, s_chunkSize, [=](uint64 begin, uint64 end) {
+                convertHalf(rsrc, rdst, begin, end);
+                convertHalf(gsrc, gdst, begin, end);
+                convertHalf(bsrc, bdst, begin, end);
+                convertHalf(asrc, adst, begin, end);
+            });
         }
         CATCH {
             return false;
@@ -888,9 +1587,6 @@ bool Surface::setImage(InputFormat format, int w, int h, int d, const void * r,
 
         TRY {
             memcpy(rdst, rsrc, count * sizeof(float));
-            memset(gdst, 0, count * sizeof(float));
-            memset(bdst, 0, count * sizeof(float));
-            memset(adst, 0, count * sizeof(float));
         }
         CATCH {
             return false;
@@ -933,7 +1629,7 @@ bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const voi
         return false;
     }
 
-    detach();
+    discardImage();
 
     if (m->image == NULL) {
         m->image = new FloatImage();
@@ -1117,8 +1813,25 @@ bool Surface::setImage2D(Format format, Decoder decoder, int w, int h, const voi
     return true;
 }
 
+bool Surface::wrap(int w, int h, int d, const float * r, const float * g, const float * b, const float * a, ReleaseFunction * release/*= 0*/, void * context/*= 0*/)
+{
+    if (w <= 0 || h <= 0 || d <= 0 || r == NULL || g == NULL || b == NULL) return false;
+
+    discardImage();
+
+    if (m->image == NULL) {
+        m->image = new FloatImage();
+    }
+
+    const float * channels[4] = { r, g, b, a };
+    m->image->wrap(a != NULL ? 4 : 3, w, h, d, channels, release, context);
+    m->type = (d == 1) ? TextureType_2D : TextureType_3D;
+
+    return true;
+}
+
 
-static void getDefaultFilterWidthAndParams(int filter, float * filterWidth, float params[2])
+void nv::getDefaultFilterWidthAndParams(int filter, float * filterWidth, float params[2])
 {
     if (filter == ResizeFilter_Box) {
         *filterWidth = 0.5f;
@@ -1155,7 +1868,10 @@ void Surface::resize(int w, int h, int d, ResizeFilter filter, float filterWidth
         return;
     }
 
-    detach();
+    detach(0, 0);
+
+    // Alpha weighted filters read the alpha channel even if the surface doesn't store it.
+    if (m->alphaMode == AlphaMode_Transparency) m->expand(4);
 
     FloatImage * img = m->image;
 
@@ -1269,14 +1985,20 @@ void Surface::resize(int maxExtent, RoundMode roundMode, ResizeFilter filter, fl
 
 
 float rmsBilinearError(nvtt::Surface original, nvtt::Surface resized) {
-    return nv::rmsBilinearColorError(original.m->image, resized.m->image, (FloatImage::WrapMode)original.wrapMode(), original.alphaMode() == AlphaMode_Transparency);
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * img0 = original.m->readImage(4, tmp0);
+    const FloatImage * img1 = resized.m->readImage(4, tmp1);
+    return nv::rmsBilinearColorError(img0, img1, (FloatImage::WrapMode)original.wrapMode(), original.alphaMode() == AlphaMode_Transparency);
 }
 
 
 void Surface::autoResize(float errorTolerance, RoundMode mode, ResizeFilter filter)
 {
-    Surface original = *this;
-    Surface resized = original;
+    const Surface original = *this;
+
+    // Cache the chain of half size candidates. Each level is resized from the previous one.
+    Array<Surface> pyramid;
+    pyramid.append(original);
 
     int w = width();
     int h = height();
@@ -1287,40 +2009,37 @@ void Surface::autoResize(float errorTolerance, RoundMode mode, ResizeFilter filt
     d = (d + 1) / 2;
 
     while (w >= 4 && h >= 4 && d >= 1) {
-
-        // Resize always from original? This is more expensive, but should produce higher quality.
-        //resized = original;
-        
+        Surface resized = pyramid.back();
         resized.resize(w, h, d, filter);
+        pyramid.append(resized);
 
-#if 0
-        // Scale back up to original size. @@ Upscaling not implemented!
-        Surface restored = resized;
-        restored.resize(original.width(), original.height(), original.depth(), ResizeFilter_Triangle);
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        d = (d + 1) / 2;
+    }
+
+    // The error grows as the candidates get smaller, bisect for the smallest one within tolerance.
+    uint best = 0;
+    uint lo = 1, hi = pyramid.count();
+    while (lo < hi) {
+        const uint mid = (lo + hi) / 2;
+        const Surface & resized = pyramid[mid];
 
-        float error;
-        if (isNormalMap()) {
-            error = nvtt::angularError(original, restored);
-        }
-        else {
-            error = nvtt::rmsError(original, restored);
-        }
-#else
         float error = rmsBilinearError(original, resized);
-#endif
 
         if (error < errorTolerance) {
-            *this = resized;
-            nvDebug("image resized %dx%d -> %dx%d (error=%f)\n", original.width(), original.height(), w, h, error);
+            best = mid;
+            lo = mid + 1;
+            nvDebug("image can be resized %dx%d -> %dx%d (error=%f)\n", original.width(), original.height(), resized.width(), resized.height(), error);
         }
         else {
-            nvDebug("image can't be resized further (error=%f)\n", error);
-            break;
+            hi = mid;
+            nvDebug("image can't be resized to %dx%d (error=%f)\n", resized.width(), resized.height(), error);
         }
+    }
 
-        w = (w + 1) / 2;
-        h = (h + 1) / 2;
-        d = (d + 1) / 2;
+    if (best != 0) {
+        *this = pyramid[best];
     }
 }
 
@@ -1347,7 +2066,9 @@ bool Surface::buildNextMipmap(MipmapFilter filter, float filterWidth, const floa
         return false;
     }
 
-    detach();
+    detach(0, 0);
+
+    if (m->alphaMode == AlphaMode_Transparency) m->expand(4);
 
     FloatImage * img = m->image;
 
@@ -1411,11 +2132,9 @@ bool Surface::buildNextMipmapSolidColor(const float * const color_components)
         return false;
     }
 
-    detach();
-
     FloatImage * img = new FloatImage();
-    const uint w = max(1, m->image->m_width / 2);
-    const uint h = max(1, m->image->m_height / 2);
+    const uint w = max(1U, m->image->m_width / 2);
+    const uint h = max(1U, m->image->m_height / 2);
     img->allocate(m->image->m_componentCount, w, h);
 
     for(uint c = 0; c < img->m_componentCount; c++)
@@ -1423,6 +2142,8 @@ bool Surface::buildNextMipmapSolidColor(const float * const color_components)
         img->clear(c, color_components[c]);
     }
 
+    discardImage();
+
     delete m->image;
     m->image = img;
 
@@ -1437,29 +2158,30 @@ void Surface::canvasSize(int w, int h, int d)
         return;
     }
 
-    detach();
-
-    FloatImage * img = m->image;
+    // Packed texels are decoded to a copy, the image is replaced.
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * img = m->readImage(m->image->componentCount(), tmp);
 
     FloatImage * new_img = new FloatImage;
-    new_img->allocate(4, w, h, d);
+    new_img->allocate(img->componentCount(), w, h, d);
     new_img->clear();
 
     w = min(uint(w), img->width());
     h = min(uint(h), img->height());
     d = min(uint(d), img->depth());
 
-    for (int z = 0; z < d; z++) {
-        for (int y = 0; y < h; y++) {
-            for (int x = 0; x < w; x++) {
-                new_img->pixel(0, x, y, z) = img->pixel(0, x, y, z);
-                new_img->pixel(1, x, y, z) = img->pixel(1, x, y, z);
-                new_img->pixel(2, x, y, z) = img->pixel(2, x, y, z);
-                new_img->pixel(3, x, y, z) = img->pixel(3, x, y, z);
+    for (uint c = 0; c < img->componentCount(); c++) {
+        for (int z = 0; z < d; z++) {
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    new_img->pixel(c, x, y, z) = img->pixel(c, x, y, z);
+                }
             }
         }
     }
 
+    discardImage();
+
     delete m->image;
     m->image = new_img;
     m->type = (d == 1) ? TextureType_2D : TextureType_3D;
@@ -1472,9 +2194,11 @@ void Surface::toLinear(float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
-    detach();
+    // Missing color channels are zero and stay zero.
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    m->image->toLinear(0, 3, gamma);
+    m->image->toLinear(0, count, gamma);
 }
 
 void Surface::toGamma(float gamma)
@@ -1482,9 +2206,10 @@ void Surface::toGamma(float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
-    detach();
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    m->image->toGamma(0, 3, gamma);
+    m->image->toGamma(0, count, gamma);
 }
 
 void Surface::toLinear(int channel, float gamma)
@@ -1492,7 +2217,7 @@ void Surface::toLinear(int channel, float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
-    detach();
+    detach(channel, 1);
 
     m->image->toLinear(channel, 1, gamma);
 }
@@ -1502,22 +2227,13 @@ void Surface::toGamma(int channel, float gamma)
     if (isNull()) return;
     if (equal(gamma, 1.0f)) return;
 
-    detach();
+    detach(channel, 1);
 
     m->image->toGamma(channel, 1, gamma);
 }
 
 
 
-static float toSrgb(float f) {
-    if (isNan(f))               f = 0.0f;
-    else if (f <= 0.0f)         f = 0.0f;
-    else if (f <= 0.0031308f)   f = 12.92f * f;
-    else if (f <= 1.0f)         f = (powf(f, 0.41666f) * 1.055f) - 0.055f;
-    else                        f = 1.0f;
-    return f;
-}
-
 // sRGB approximation from: http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
 static float toSrgbFast(float f) {
     f = saturate(f);
@@ -1527,112 +2243,96 @@ static float toSrgbFast(float f) {
     return 0.662002687f * s1 + 0.684122060f * s2 - 0.323583601f * s3 - 0.0225411470f * f;
 }
 
+// sRGB approximation from: http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
+static float fromSrgbFast(float f) {
+    f = saturate(f);
+    return f * (f * (f * 0.305306011f + 0.682171111f) + 0.012522878f);
+}
+
+static float toXenonSrgb(float f) {
+    if (f < 0)                  f = 0;
+    else if (f < (1.0f/16.0f))  f = 4.0f * f;
+    else if (f < (1.0f/8.0f))   f = 0.25f  + 2.0f * (f - 0.0625f);
+    else if (f < 0.5f)          f = 0.375f + 1.0f * (f - 0.125f);
+    else if (f < 1.0f)          f = 0.75f  + 0.5f * (f - 0.50f);
+    else                        f = 1.0f;
+    return f;
+}
+
 void Surface::toSrgb() {
     if (isNull()) return;
 
-    detach();
-
-    FloatImage * img = m->image;
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    const uint count = 3 * img->pixelCount();
-    float * channel = img->channel(0);
-    for (uint i = 0; i < count; i++) {
-        channel[i] = ::toSrgb(channel[i]);
+    for (int c = 0; c < count; c++) {
+        float * channel = m->image->channel(c);
+        parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+            nv::linear_to_srgb_array(channel + begin, channel + begin, int(end - begin));
+        });
     }
 }
 
 void Surface::toSrgbFast() {
     if (isNull()) return;
 
-    detach();
-
-    FloatImage * img = m->image;
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    const uint count = 3 * img->pixelCount();
-    float * channel = img->channel(0);
-    for (uint i = 0; i < count; i++) {
-        channel[i] = ::toSrgbFast(channel[i]);
+    for (int c = 0; c < count; c++) {
+        float * channel = m->image->channel(c);
+        parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                channel[i] = ::toSrgbFast(channel[i]);
+            }
+        });
     }
-    //parallel_for(count, 128, [=](int i) {
-    //    channel[i] = toSrgbFast(channel[i]);
-    //});
-}
-
-
-static float fromSrgb(float f) {
-    if (f < 0.0f)           f = 0.0f;
-    else if (f < 0.04045f)  f = f / 12.92f;
-    else if (f <= 1.0f)     f = powf((f + 0.055f) / 1.055f, 2.4f);
-    else                    f = 1.0f;
-    return f;
-}
-
-// sRGB approximation from: http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-static float fromSrgbFast(float f) {
-    f = saturate(f);
-    return f * (f * (f * 0.305306011f + 0.682171111f) + 0.012522878f);
 }
 
-
 void Surface::toLinearFromSrgb() {
     if (isNull()) return;
 
-    detach();
-
-    FloatImage * img = m->image;
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    const uint count = 3  *img->pixelCount();
-    float * channel = img->channel(0);
-    for (uint i = 0; i < count; i++) {
-        channel[i] = ::fromSrgb(channel[i]);
+    for (int c = 0; c < count; c++) {
+        float * channel = m->image->channel(c);
+        parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+            nv::srgb_to_linear_array(channel + begin, channel + begin, int(end - begin));
+        });
     }
-    //parallel_for(count, 128, [=](int i) {
-    //    channel[i] = ::fromSrgb(channel[i]);
-    //});
 }
 
 void Surface::toLinearFromSrgbFast() {
     if (isNull()) return;
 
-    detach();
-
-    FloatImage * img = m->image;
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    const uint count = 3 * img->pixelCount();
-    float * channel = img->channel(0);
-    for (uint i = 0; i < count; i++) {
-        channel[i] = ::fromSrgbFast(channel[i]);
+    for (int c = 0; c < count; c++) {
+        float * channel = m->image->channel(c);
+        parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                channel[i] = ::fromSrgbFast(channel[i]);
+            }
+        });
     }
-    //parallel_for(count, 128, [=](int i) {
-    //    channel[i] = ::fromSrgbFast(channel[i]);
-    //});
-}
-
-
-static float toXenonSrgb(float f) {
-    if (f < 0)                  f = 0;
-    else if (f < (1.0f/16.0f))  f = 4.0f * f;
-    else if (f < (1.0f/8.0f))   f = 0.25f  + 2.0f * (f - 0.0625f);
-    else if (f < 0.5f)          f = 0.375f + 1.0f * (f - 0.125f);
-    else if (f < 1.0f)          f = 0.75f  + 0.5f * (f - 0.50f);
-    else                        f = 1.0f;
-    return f;
 }
 
 void Surface::toXenonSrgb()
 {
     if (isNull()) return;
 
-    detach();
-
-    FloatImage * img = m->image;
+    const int count = min(3, channelCount());
+    detach(0, count);
 
-    const uint count = img->pixelCount();
-    for (uint c = 0; c < 3; c++) {
-        float * channel = img->channel(c);
-        for (uint i = 0; i < count; i++) {
-            channel[i] = ::toXenonSrgb(channel[i]);
-        }
+    for (int c = 0; c < count; c++) {
+        float * channel = m->image->channel(c);
+        parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+            for (uint64 i = begin; i < end; i++) {
+                channel[i] = ::toXenonSrgb(channel[i]);
+            }
+        });
     }
 }
 
@@ -1671,7 +2371,7 @@ void Surface::scaleBias(int channel, float scale, float bias)
     if (isNull()) return;
     if (equal(scale, 1.0f) && equal(bias, 0.0f)) return;
 
-    detach();
+    detach(channel, 1);
 
     m->image->scaleBias(channel, 1, scale, bias);
 }
@@ -1680,7 +2380,7 @@ void Surface::clamp(int channel, float low, float high)
 {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
     m->image->clamp(channel, 1, low, high);
 }
@@ -1697,8 +2397,8 @@ void Surface::blend(float red, float green, float blue, float alpha, float t)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++)
     {
         r[i] = lerp(r[i], red, t);
         g[i] = lerp(g[i], green, t);
@@ -1711,7 +2411,8 @@ void Surface::premultiplyAlpha()
 {
     if (isNull()) return;
 
-    detach();
+    detach(0, 3);
+    m->expand(4);
 
     FloatImage * img = m->image;
     float * r = img->channel(0);
@@ -1719,8 +2420,8 @@ void Surface::premultiplyAlpha()
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++)
     {
         r[i] *= a[i];
         g[i] *= a[i];
@@ -1747,8 +2448,8 @@ void Surface::toGreyScale(float redScale, float greenScale, float blueScale, flo
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++)
     {
         float grey = r[i] * redScale + g[i] * greenScale + b[i] * blueScale + a[i] * alphaScale;
         a[i] = b[i] = g[i] = r[i] = grey;
@@ -1810,11 +2511,11 @@ void Surface::fill(float red, float green, float blue, float alpha)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) r[i] = red;
-    for (uint i = 0; i < count; i++) g[i] = green;
-    for (uint i = 0; i < count; i++) b[i] = blue;
-    for (uint i = 0; i < count; i++) a[i] = alpha;
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) r[i] = red;
+    for (uint64 i = 0; i < count; i++) g[i] = green;
+    for (uint64 i = 0; i < count; i++) b[i] = blue;
+    for (uint64 i = 0; i < count; i++) a[i] = alpha;
 }
 
 
@@ -1822,7 +2523,7 @@ void Surface::scaleAlphaToCoverage(float coverage, float alphaRef/*= 0.5f*/, int
 {
     if (isNull()) return;
 
-    detach();
+    detach(alpha_channel, 1);
 
     alphaRef = nv::clamp(alphaRef, 1.0f/256, 255.0f/256);
 
@@ -1873,8 +2574,8 @@ void Surface::toRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float R = nv::clamp(r[i], 0.0f, 1.0f);
         float G = nv::clamp(g[i], 0.0f, 1.0f);
         float B = nv::clamp(b[i], 0.0f, 1.0f);
@@ -1960,8 +2661,8 @@ void Surface::fromRGBM(float range/*= 1*/, float threshold/*= 0.25*/)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float M = a[i] * (range - threshold) + threshold;
 
         r[i] *= M;
@@ -1986,8 +2687,8 @@ void Surface::toLM(float range/*= 1*/, float threshold/*= 0.25*/)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float R = nv::clamp(r[i], 0.0f, 1.0f);
         float G = nv::clamp(g[i], 0.0f, 1.0f);
         float B = nv::clamp(b[i], 0.0f, 1.0f);
@@ -2151,8 +2852,8 @@ void Surface::toRGBE(int mantissaBits, int exponentBits)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         // Clamp components:
         float R = ::clamp(r[i], 0.0f, maxValue);
         float G = ::clamp(g[i], 0.0f, maxValue);
@@ -2233,8 +2934,8 @@ void Surface::fromRGBE(int mantissaBits, int exponentBits)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         // Expand normalized float to to 9995
         int R = ftoi_round(r[i] * ((1 << mantissaBits) - 1));
         int G = ftoi_round(g[i] * ((1 << mantissaBits) - 1));
@@ -2264,8 +2965,8 @@ void Surface::toYCoCg()
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float R = r[i];
         float G = g[i];
         float B = b[i];
@@ -2359,8 +3060,8 @@ void Surface::fromYCoCg()
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float Co = r[i];
         float Cg = g[i];
         float scale = b[i] * 0.5f;
@@ -2394,8 +3095,8 @@ void Surface::toLUVW(float range/*= 1.0f*/)
     float * b = img->channel(2);
     float * a = img->channel(3);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float R = nv::clamp(r[i] * irange, 0.0f, 1.0f);
         float G = nv::clamp(g[i] * irange, 0.0f, 1.0f);
         float B = nv::clamp(b[i] * irange, 0.0f, 1.0f);
@@ -2419,13 +3120,13 @@ void Surface::abs(int channel)
 {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
     FloatImage * img = m->image;
     float * c = img->channel(channel);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         c[i] = fabsf(c[i]);
     }
 }
@@ -2434,7 +3135,7 @@ void Surface::convolve(int channel, int kernelSize, float * kernelData)
 {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
     Kernel2 k(kernelSize, kernelData);
     m->image->convolve(k, channel, (FloatImage::WrapMode)m->wrapMode);
@@ -2451,11 +3152,11 @@ void Surface::toneMap(ToneMapper tm, float * parameters)
     float * r = img->channel(0);
     float * g = img->channel(1);
     float * b = img->channel(2);
-    const uint count = img->pixelCount();
+    const uint64 count = img->pixelCount();
 
     if (tm == ToneMapper_Linear) {
         // Clamp preserving the hue.
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             float m = max3(r[i], g[i], b[i]);
             if (m > 1.0f) {
                 r[i] *= 1.0f / m;
@@ -2465,14 +3166,14 @@ void Surface::toneMap(ToneMapper tm, float * parameters)
         }
     }
     else if (tm == ToneMapper_Reindhart) {
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             r[i] /= r[i] + 1;
             g[i] /= g[i] + 1;
             b[i] /= b[i] + 1;
         }
     }
     else if (tm == ToneMapper_Halo) {
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             r[i] = 1 - exp2f(-r[i]);
             g[i] = 1 - exp2f(-g[i]);
             b[i] = 1 - exp2f(-b[i]);
@@ -2483,7 +3184,7 @@ void Surface::toneMap(ToneMapper tm, float * parameters)
         // Preserve hue.
         // Avoid clamping abrubtly.
         // Minimize color difference along most of the color range. [0, alpha)
-        for (uint i = 0; i < count; i++) {
+        for (uint64 i = 0; i < count; i++) {
             float m = max3(r[i], g[i], b[i]);
             if (m > 1.0f) {
                 r[i] *= 1.0f / m;
@@ -2497,33 +3198,35 @@ void Surface::toneMap(ToneMapper tm, float * parameters)
 void Surface::toLogScale(int channel, float base) {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
-    FloatImage * img = m->image;
-    float * c = img->channel(channel);
+    float * c = m->image->channel(channel);
 
-    float scale = 1.0f / log2f(base);
+    const float scale = 1.0f / log2f(base);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        c[i] = log2f(c[i]) * scale;
-    }
+    parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+        nv::log2_array(c + begin, c + begin, int(end - begin));
+        for (uint64 i = begin; i < end; i++) {
+            c[i] *= scale;
+        }
+    });
 }
 
 void Surface::fromLogScale(int channel, float base) {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
-    FloatImage * img = m->image;
-    float * c = img->channel(channel);
+    float * c = m->image->channel(channel);
 
-    float scale = log2f(base);
+    const float scale = log2f(base);
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
-        c[i] = exp2f(c[i] * scale);
-    }
+    parallel_for_range(m->image->pixelCount(), s_chunkSize, [=](uint64 begin, uint64 end) {
+        for (uint64 i = begin; i < end; i++) {
+            c[i] *= scale;
+        }
+        nv::exp2_array(c + begin, c + begin, int(end - begin));
+    });
 }
 
 
@@ -2615,8 +3318,8 @@ void Surface::toJPEGLS()
     float * g = img->channel(1);
     float * b = img->channel(2);
 
-    const uint count = img->width() * img->height();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = uint64(img->width()) * img->height();
+    for (uint64 i = 0; i < count; i++) {
         float R = nv::clamp(r[i], 0.0f, 1.0f);
         float G = nv::clamp(g[i], 0.0f, 1.0f);
         float B = nv::clamp(b[i], 0.0f, 1.0f);
@@ -2638,8 +3341,8 @@ void Surface::fromJPEGLS()
     float * g = img->channel(1);
     float * b = img->channel(2);
 
-    const uint count = img->width() * img->height();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = uint64(img->width()) * img->height();
+    for (uint64 i = 0; i < count; i++) {
         float R = nv::clamp(r[i], -1.0f, 1.0f);
         float G = nv::clamp(g[i], 0.0f, 1.0f);
         float B = nv::clamp(b[i], -1.0f, 1.0f);
@@ -2652,75 +3355,290 @@ void Surface::fromJPEGLS()
 */
 
 
-// If dither is true, this uses Floyd-Steinberg dithering method.
-void Surface::binarize(int channel, float threshold, bool dither)
-{
-    if (isNull()) return;
+// Size of the threshold matrices of the ordered and blue noise dithering modes.
+static const uint s_bayerSize = 8;
+static const uint s_blueNoiseSize = 64;
 
-    detach();
+namespace {
 
-    FloatImage * img = m->image;
+    // Recursive Bayer matrix, thresholds in (0, 1).
+    struct BayerMatrix {
+        BayerMatrix() {
+            for (uint y = 0; y < s_bayerSize; y++) {
+                for (uint x = 0; x < s_bayerSize; x++) {
+                    // Interleave the bits of x^y and y, in reverse order.
+                    uint rank = 0;
+                    for (uint bit = 1, shift = 4; bit < s_bayerSize; bit <<= 1, shift -= 2) {
+                        rank |= (((x ^ y) & bit) ? 2 : 0) << shift;
+                        rank |= ((y & bit) ? 1 : 0) << shift;
+                    }
+                    threshold[y * s_bayerSize + x] = (rank + 0.5f) / (s_bayerSize * s_bayerSize);
+                }
+            }
+        }
 
-    if (!dither) {
-        float * c = img->channel(channel);
-        const uint count = img->pixelCount();
-        for (uint i = 0; i < count; i++) {
-            c[i] = float(c[i] > threshold);
+        float threshold[s_bayerSize * s_bayerSize];
+    };
+
+    // Tileable blue noise thresholds in (0, 1), generated with Ulichney's void-and-cluster method.
+    struct BlueNoiseMatrix {
+        BlueNoiseMatrix() {
+            const int n = s_blueNoiseSize;
+            const int count = n * n;
+
+            // Gaussian energy filter that wraps around, sigma = 1.5
+            kernel.resize(count);
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    const int dx = min(x, n - x);
+                    const int dy = min(y, n - y);
+                    kernel[y * n + x] = expf(-float(dx * dx + dy * dy) / (2.0f * 1.5f * 1.5f));
+                }
+            }
+
+            pattern.resize(count, 0);
+            energy.resize(count, 0.0f);
+
+            // Initial pattern from a fixed random sequence.
+            const int initialCount = count / 10;
+            uint32 seed = 1;
+            for (int ones = 0; ones < initialCount; ) {
+                seed = seed * 1664525u + 1013904223u;
+                const int i = int((seed >> 8) % uint32(count));
+                if (!pattern[i]) {
+                    toggle(i);
+                    ones++;
+                }
+            }
+
+            // Move the tightest cluster to the largest void until that does not change the pattern.
+            while (true) {
+                const int cluster = find(1, /*tightest=*/true);
+                toggle(cluster);
+                const int hole = find(0, /*tightest=*/false);
+                toggle(hole);
+                if (hole == cluster) break;
+            }
+
+            Array<uint8> prototype = pattern;
+            Array<float> prototypeEnergy = energy;
+            Array<int> rank;
+            rank.resize(count);
+
+            // Rank the initial pattern by removing its tightest clusters.
+            for (int r = initialCount - 1; r >= 0; r--) {
+                const int i = find(1, /*tightest=*/true);
+                toggle(i);
+                rank[i] = r;
+            }
+
+            // Fill the largest voids up to half of the pixels.
+            pattern = prototype;
+            energy = prototypeEnergy;
+            int r = initialCount;
+            for (; r < count / 2; r++) {
+                const int i = find(0, /*tightest=*/false);
+                toggle(i);
+                rank[i] = r;
+            }
+
+            // The remaining pixels are the minority now. Rank them by removing their tightest clusters.
+            Array<uint8> filled = pattern;
+            for (int i = 0; i < count; i++) {
+                pattern[i] = 0;
+                energy[i] = 0.0f;
+            }
+            for (int i = 0; i < count; i++) {
+                if (!filled[i]) toggle(i);
+            }
+            for (; r < count; r++) {
+                const int i = find(1, /*tightest=*/true);
+                toggle(i);
+                rank[i] = r;
+            }
+
+            for (int i = 0; i < count; i++) {
+                threshold[i] = (rank[i] + 0.5f) / count;
+            }
+        }
+
+        // Flip a pixel of the pattern and update the energy of all pixels.
+        void toggle(int i) {
+            const int n = s_blueNoiseSize;
+            const float sign = pattern[i] ? -1.0f : 1.0f;
+            pattern[i] ^= 1;
+
+            const int px = i % n;
+            const int py = i / n;
+            for (int y = 0; y < n; y++) {
+                const float * k = kernel.buffer() + ((y - py + n) % n) * n;
+                float * e = energy.buffer() + y * n;
+                for (int x = 0; x < px; x++) e[x] += sign * k[x - px + n];
+                for (int x = px; x < n; x++) e[x] += sign * k[x - px];
+            }
+        }
+
+        // Pixel with the given value and the highest energy (tightest cluster) or the lowest energy (largest void).
+        int find(uint8 value, bool tightest) const {
+            int best = -1;
+            for (uint i = 0; i < pattern.count(); i++) {
+                if (pattern[i] != value) continue;
+                if (best < 0 || (tightest ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+            }
+            return best;
         }
+
+        Array<float> kernel;
+        Array<uint8> pattern;
+        Array<float> energy;
+
+        float threshold[s_blueNoiseSize * s_blueNoiseSize];
+    };
+
+} // namespace
+
+// The matrices are built on first use.
+static const float * thresholdMatrix(DitherMode mode, uint * size)
+{
+    if (mode == DitherMode_Ordered) {
+        static const BayerMatrix bayer;
+        *size = s_bayerSize;
+        return bayer.threshold;
     }
     else {
-        const uint w = img->width();
-        const uint h = img->height();
-        const uint d = img->depth();
+        nvDebugCheck(mode == DitherMode_BlueNoise);
+        static const BlueNoiseMatrix blueNoise;
+        *size = s_blueNoiseSize;
+        return blueNoise.threshold;
+    }
+}
 
-        float * row0 = new float[(w+2)];
-        float * row1 = new float[(w+2)];
+// Offset each texel by a threshold in [-0.5, 0.5) of a quantization step before quantizing it. The rows are independent.
+template <typename Q>
+static void thresholdDither(FloatImage * img, uint channel, DitherMode mode, float step, Q quantize)
+{
+    uint n;
+    const float * matrix = thresholdMatrix(mode, &n);
+
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint d = img->depth();
 
-        // @@ Extend Floyd-Steinberg dithering to 3D properly.
-        for (uint z = 0; z < d; z++) {
-            memset(row0, 0, sizeof(float)*(w+2));
-            memset(row1, 0, sizeof(float)*(w+2));
+    parallel_for(h * d, [&](int row) {
+        const uint y = row % h;
+        const uint z = row / h;
 
-            for (uint y = 0; y < h; y++) {
-                for (uint x = 0; x < w; x++) {
+        float * c = img->scanline(channel, y, z);
+        const float * t = matrix + ((y + z * 3) % n) * n;
+        for (uint x = 0; x < w; x++) {
+            c[x] = quantize(c[x] + (t[x % n] - 0.5f) * step);
+        }
+    });
+}
 
-                    float & f = img->pixel(channel, x, y, 0);
+// Floyd-Steinberg error diffusion. The rows are processed in parallel as a wavefront: each row trails the previous one by
+// the two texels whose error it needs. Rows are claimed in order by the parallel_for, so the row a thread waits for is
+// always in progress, and every texel adds its error terms in the same order, so the result does not depend on the number
+// of threads. Row y + 2 writes its error to the row of row y only once row y + 1 has published texels past the ones it
+// still reads, so two rows of errors are enough.
+template <typename Q>
+static void diffuseError(FloatImage * img, uint channel, Q quantize)
+{
+    const uint w = img->width();
+    const uint h = img->height();
+    const uint d = img->depth();
 
-                    // Add error and quantize.
-                    float qf = float(f + row0[1+x] > threshold);
+    // Publish the progress of a row every few texels.
+    const uint progressStep = 32;
 
-                    // Compute new error:
-                    float diff = f - qf;
+    Array<float> diffs;
+    diffs.resize(2 * w);
+    Array<uint32> progress;
+    progress.resize(h);
 
-                    // Store color.
-                    f = qf;
+    for (uint z = 0; z < d; z++) {
+        float * plane = img->plane(channel, z);
+        for (uint y = 0; y < h; y++) progress[y] = 0;
+
+        parallel_for(h, [&](int y) {
+            float * c = plane + uint64(y) * w;
+            float * diff = diffs.buffer() + (y % 2) * w;
+            const float * above = diffs.buffer() + ((y + 1) % 2) * w;
+
+            uint available = 0;
+            for (uint x = 0; x < w; x++) {
+                float error = 0.0f;
+
+                if (y > 0) {
+                    const uint needed = min(x + 2, w);
+                    while (available < needed) {
+                        available = loadAcquire(&progress[y - 1]);
+                        if (available < needed) Thread::yield();
+                    }
 
-                    // Propagate new error.
-                    row0[1+x+1] += (7.0f / 16.0f) * diff;
-                    row1[1+x-1] += (3.0f / 16.0f) * diff;
-                    row1[1+x+0] += (5.0f / 16.0f) * diff;
-                    row1[1+x+1] += (1.0f / 16.0f) * diff;
+                    if (x > 0) error += (1.0f / 16.0f) * above[x - 1];
+                    error += (5.0f / 16.0f) * above[x];
+                    if (x + 1 < w) error += (3.0f / 16.0f) * above[x + 1];
                 }
+                if (x > 0) error += (7.0f / 16.0f) * diff[x - 1];
 
-                swap(row0, row1);
-                memset(row1, 0, sizeof(float)*(w+2));
+                // Quantize and compute the new error.
+                const float f = c[x] + error;
+                const float qf = quantize(f);
+                diff[x] = f - qf;
+                c[x] = qf;
+
+                if ((x + 1) % progressStep == 0 || x + 1 == w) {
+                    storeRelease(&progress[y], x + 1);
+                }
             }
-        }
+        });
+    }
+}
+
+void Surface::binarize(int channel, float threshold, bool dither)
+{
+    binarize(channel, threshold, dither ? DitherMode_FloydSteinberg : DitherMode_None);
+}
+
+void Surface::binarize(int channel, float threshold, DitherMode mode)
+{
+    if (isNull()) return;
+
+    detach(channel, 1);
+
+    FloatImage * img = m->image;
+
+    auto binarizer = [=](float f) { return float(f > threshold); };
 
-        delete [] row0;
-        delete [] row1;
+    if (mode == DitherMode_None) {
+        float * c = img->channel(channel);
+        const uint64 count = img->pixelCount();
+        for (uint64 i = 0; i < count; i++) {
+            c[i] = binarizer(c[i]);
+        }
+    }
+    else if (mode == DitherMode_FloydSteinberg) {
+        diffuseError(img, channel, binarizer);
+    }
+    else {
+        thresholdDither(img, channel, mode, 1.0f, binarizer);
     }
 }
 
 // Uniform quantizer.
 // Assumes input is in [0, 1] range. Output is in the [0, 1] range, but rounded to the middle of each bin.
 // If exactEndPoints is true, [0, 1] are represented exactly, and the correponding bins are half the size, so quantization is not truly uniform.
-// When dither is true, this uses Floyd-Steinberg dithering.
 void Surface::quantize(int channel, int bits, bool exactEndPoints, bool dither)
+{
+    quantize(channel, bits, exactEndPoints, dither ? DitherMode_FloydSteinberg : DitherMode_None);
+}
+
+void Surface::quantize(int channel, int bits, bool exactEndPoints, DitherMode mode)
 {
     if (isNull()) return;
 
-    detach();
+    detach(channel, 1);
 
     FloatImage * img = m->image;
 
@@ -2738,53 +3656,20 @@ void Surface::quantize(int channel, int bits, bool exactEndPoints, bool dither)
         offset1 = 0.5f;
     }
 
-    if (!dither) {
+    auto quantizer = [=](float f) { return saturate((floorf(f * scale + offset0) + offset1) / scale); };
+
+    if (mode == DitherMode_None) {
         float * c = img->channel(channel);
-        const uint count = img->pixelCount();
-        for (uint i = 0; i < count; i++) {
-            c[i] = saturate((floorf(c[i] * scale + offset0) + offset1) / scale);
+        const uint64 count = img->pixelCount();
+        for (uint64 i = 0; i < count; i++) {
+            c[i] = quantizer(c[i]);
         }
     }
+    else if (mode == DitherMode_FloydSteinberg) {
+        diffuseError(img, channel, quantizer);
+    }
     else {
-        const uint w = img->width();
-        const uint h = img->height();
-        const uint d = img->depth();
-
-        float * row0 = new float[(w+2)];
-        float * row1 = new float[(w+2)];
-
-        for (uint z = 0; z < d; z++) {
-            memset(row0, 0, sizeof(float)*(w+2));
-            memset(row1, 0, sizeof(float)*(w+2));
-
-            for (uint y = 0; y < h; y++) {
-                for (uint x = 0; x < w; x++) {
-
-                    float & f = img->pixel(channel, x, y, 0);
-
-                    // Add error and quantize.
-                    float qf = saturate((floorf((f + row0[1+x]) * scale + offset0) + offset1) / scale);
-
-                    // Compute new error:
-                    float diff = f - qf;
-
-                    // Store color.
-                    f = qf;
-
-                    // Propagate new error.
-                    row0[1+x+1] += (7.0f / 16.0f) * diff;
-                    row1[1+x-1] += (3.0f / 16.0f) * diff;
-                    row1[1+x+0] += (5.0f / 16.0f) * diff;
-                    row1[1+x+1] += (1.0f / 16.0f) * diff;
-                }
-
-                swap(row0, row1);
-                memset(row1, 0, sizeof(float)*(w+2));
-            }
-        }
-
-        delete [] row0;
-        delete [] row1;
+        thresholdDither(img, channel, mode, 1.0f / scale, quantizer);
     }
 }
 
@@ -2825,8 +3710,8 @@ void Surface::transformNormals(NormalTransform xform)
 
     FloatImage * img = m->image;
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float & x = img->pixel(0, i);
         float & y = img->pixel(1, i);
         float & z = img->pixel(2, i);
@@ -2895,8 +3780,8 @@ void Surface::reconstructNormals(NormalTransform xform)
 
     FloatImage * img = m->image;
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float & x = img->pixel(0, i);
         float & y = img->pixel(1, i);
         float & z = img->pixel(2, i);
@@ -2939,8 +3824,8 @@ void Surface::toCleanNormalMap()
 
     detach();
 
-    const uint count = m->image->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = m->image->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         float x = m->image->pixel(0, i);
         float y = m->image->pixel(1, i);
 
@@ -3027,6 +3912,8 @@ Surface Surface::createSubImage(int x0, int x1, int y0, int y1, int z0, int z1)
     if (y0 < 0 || y1 > height() || y0 > y1) return s;
     if (z0 < 0 || z1 > depth() || z0 > z1) return s;
     if (x1 >= width() || y1 >= height() || z1 >= depth()) return s;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * src = m->readImage(4, tmp);
 
     FloatImage * img = s.m->image = new FloatImage;
 
@@ -3034,13 +3921,13 @@ Surface Surface::createSubImage(int x0, int x1, int y0, int y1, int z0, int z1)
     int h = y1 - y0 + 1;
     int d = z1 - z0 + 1;
 
-    img->allocate(4, w, h, d);
+    img->allocate(src->componentCount(), w, h, d);
 
-    for (int c = 0; c < 4; c++) {
+    for (uint c = 0; c < img->componentCount(); c++) {
         for (int z = 0; z < d; z++) {
             for (int y = 0; y < h; y++) {
                 for (int x = 0; x < w; x++) {
-                    img->pixel(c, x, y, z) = m->image->pixel(c, x0+x, y0+y, z0+z);
+                    img->pixel(c, x, y, z) = src->pixel(c, x0+x, y0+y, z0+z);
                 }
             }
         }
@@ -3053,10 +3940,12 @@ Surface Surface::createSubImage(int x0, int x1, int y0, int y1, int z0, int z1)
 Surface Surface::warp(int w, int h, WarpFunction * warp_function) const
 {
     Surface s;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * src = m->readImage(4, tmp);
 
     FloatImage * img = s.m->image = new FloatImage;
 
-    const int C = m->image->componentCount();
+    const int C = src->componentCount();
     img->allocate(C, w, h, 1);
 
 #define USE_PARALLEL_FOR 0
@@ -3073,7 +3962,7 @@ Surface Surface::warp(int w, int h, WarpFunction * warp_function) const
             warp_function(fx, fy, fz);
 
             for (int c = 0; c < C; c++) {
-                img->pixel(c, x, y, 0) = m->image->sampleLinearClamp(c, fx, fy);
+                img->pixel(c, x, y, 0) = src->sampleLinearClamp(c, fx, fy);
             }
         }
     }
@@ -3087,10 +3976,12 @@ Surface Surface::warp(int w, int h, WarpFunction * warp_function) const
 Surface Surface::warp(int w, int h, int d, WarpFunction * warp_function) const
 {
     Surface s;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * src = m->readImage(4, tmp);
 
     FloatImage * img = s.m->image = new FloatImage;
 
-    const int C = m->image->componentCount();
+    const int C = src->componentCount();
     img->allocate(C, w, h, d);
 
     for (int z = 0; z < d; z++) {
@@ -3108,7 +3999,7 @@ Surface Surface::warp(int w, int h, int d, WarpFunction * warp_function) const
                 warp_function(fx, fy, fz);
 
                 for (int c = 0; c < C; c++) {
-                    img->pixel(c, x, y, z) = m->image->sampleLinearClamp(c, fx, fy, fz);    // @@ 2D only.
+                    img->pixel(c, x, y, z) = src->sampleLinearClamp(c, fx, fy, fz);    // @@ 2D only.
                 }
             }
         }
@@ -3130,17 +4021,14 @@ bool Surface::copyChannel(const Surface & srcImage, int srcChannel, int dstChann
 {
     if (srcChannel < 0 || srcChannel > 3 || dstChannel < 0 || dstChannel > 3) return false;
 
-    FloatImage * dst = m->image;
-    const FloatImage * src = srcImage.m->image;
-
-    if (!sameLayout(dst, src)) {
+    if (!sameLayout(m->image, srcImage.m->image)) {
         return false;
     }
-    nvDebugCheck(dst->componentCount() == 4 && src->componentCount() == 4);
+    detach(dstChannel, 1);
 
-    detach();
-
-    dst = m->image;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * src = srcImage.m->readImage(srcChannel + 1, tmp);
+    FloatImage * dst = m->image;
 
     memcpy(dst->channel(dstChannel), src->channel(srcChannel), dst->pixelCount()*sizeof(float));
 
@@ -3151,23 +4039,20 @@ bool Surface::addChannel(const Surface & srcImage, int srcChannel, int dstChanne
 {
     if (srcChannel < 0 || srcChannel > 3 || dstChannel < 0 || dstChannel > 3) return false;
 
-    FloatImage * dst = m->image;
-    const FloatImage * src = srcImage.m->image;
-
-    if (!sameLayout(dst, src)) {
+    if (!sameLayout(m->image, srcImage.m->image)) {
         return false;
     }
-    nvDebugCheck(dst->componentCount() == 4 && src->componentCount() == 4);
-
-    detach();
+    detach(dstChannel, 1);
 
-    dst = m->image;
+    AutoPtr<FloatImage> tmp;
+    const FloatImage * src = srcImage.m->readImage(srcChannel + 1, tmp);
+    FloatImage * dst = m->image;
 
     float * d = dst->channel(dstChannel);
     const float * s = src->channel(srcChannel);
 
-    const uint count = src->pixelCount();
-    for (uint i = 0; i < count; i++) {
+    const uint64 count = src->pixelCount();
+    for (uint64 i = 0; i < count; i++) {
         d[i] += s[i] * scale;
     }
 
@@ -3188,6 +4073,11 @@ bool Surface::copy(const Surface & srcImage, int xsrc, int ysrc, int zsrc, int x
 
     detach();
 
+    // Packed sources are decoded to a temporary, the source surface is not modified.
+    AutoPtr<FloatImage> tmp;
+    src = srcImage.m->readImage(4, tmp);
+    dst = m->image;
+
     // For each channel.
     for(int i = 0; i < 4; i++) {
         float * d = dst->channel(i);
@@ -3269,32 +4159,45 @@ void Surface::setAtlasBorder(int aw, int ah, float r, float g, float b, float a)
 
 float nvtt::rmsError(const Surface & reference, const Surface & image)
 {
-    return nv::rmsColorError(reference.m->image, image.m->image, reference.alphaMode() == nvtt::AlphaMode_Transparency);
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * img = image.m->readImage(4, tmp1);
+    return nv::rmsColorError(ref, img, reference.alphaMode() == nvtt::AlphaMode_Transparency);
 }
 
 
 float nvtt::rmsAlphaError(const Surface & reference, const Surface & image)
 {
-    return nv::rmsAlphaError(reference.m->image, image.m->image);
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * img = image.m->readImage(4, tmp1);
+    return nv::rmsAlphaError(ref, img);
 }
 
 
 float nvtt::cieLabError(const Surface & reference, const Surface & image)
 {
-    return nv::cieLabError(reference.m->image, image.m->image);
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * img = image.m->readImage(4, tmp1);
+    return nv::cieLabError(ref, img);
 }
 
 float nvtt::angularError(const Surface & reference, const Surface & image)
 {
-    //return nv::averageAngularError(reference.m->image, image.m->image);
-    return nv::rmsAngularError(reference.m->image, image.m->image);
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * img = image.m->readImage(4, tmp1);
+    //return nv::averageAngularError(ref, img);
+    return nv::rmsAngularError(ref, img);
 }
 
 
 Surface nvtt::diff(const Surface & reference, const Surface & image, float scale)
 {
-    const FloatImage * ref = reference.m->image;
-    const FloatImage * img = image.m->image;
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * img = image.m->readImage(4, tmp1);
 
     if (!sameLayout(img, ref)) {
         return Surface();
@@ -3307,8 +4210,8 @@ Surface nvtt::diff(const Surface & reference, const Surface & image, float scale
     FloatImage * diff = diffImage.m->image = new FloatImage;
     diff->allocate(4, img->width(), img->height(), img->depth());
 
-    const uint count = img->pixelCount();
-    for (uint i = 0; i < count; i++)
+    const uint64 count = img->pixelCount();
+    for (uint64 i = 0; i < count; i++)
     {
         float r0 = img->pixel(0, i);
         float g0 = img->pixel(1, i);
@@ -3342,23 +4245,28 @@ Surface nvtt::diff(const Surface & reference, const Surface & image, float scale
 
 float nvtt::rmsToneMappedError(const Surface & reference, const Surface & img, float exposure)
 {
-    // @@ We could do this in the rms function without having to create image copies.
-    Surface r = reference;
-    Surface i = img;
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * image = img.m->readImage(4, tmp1);
 
     // @@ Ideally we should use our Reindhart operator. Add Reindhart_L & Reindhart_M ?
+    return nv::rmsToneMappedError(ref, image, exposure, reference.alphaMode() == nvtt::AlphaMode_Transparency);
+}
 
-    float scale = 1.0f / exposure;
-
-    r.scaleBias(0, scale, 0); r.scaleBias(1, scale, 0); r.scaleBias(2, scale, 0);
-    r.toneMap(ToneMapper_Reindhart, NULL);
-    r.toSrgb();
-
-    i.scaleBias(0, scale, 0); i.scaleBias(1, scale, 0); i.scaleBias(2, scale, 0);
-    i.toneMap(ToneMapper_Reindhart, NULL);
-    i.toSrgb();
+float nvtt::ssim(const Surface & reference, const Surface & img, int windowSize)
+{
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * image = img.m->readImage(4, tmp1);
+    return nv::ssim(ref, image, uint(max(windowSize, 1)));
+}
 
-    return nv::rmsColorError(r.m->image, i.m->image, reference.alphaMode() == nvtt::AlphaMode_Transparency);
+float nvtt::multiScaleSsim(const Surface & reference, const Surface & img, int windowSize)
+{
+    AutoPtr<FloatImage> tmp0, tmp1;
+    const FloatImage * ref = reference.m->readImage(4, tmp0);
+    const FloatImage * image = img.m->readImage(4, tmp1);
+    return nv::multiScaleSsim(ref, image, uint(max(windowSize, 1)));
 }
 
 
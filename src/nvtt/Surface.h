@@ -29,10 +29,13 @@
 
 #include "nvcore/RefCounted.h"
 #include "nvcore/Ptr.h"
+#include "nvcore/Memory.h"
 
 #include "nvimage/Image.h"
 #include "nvimage/FloatImage.h"
 
+#include <string.h> // memcpy
+
 namespace nvtt
 {
 
@@ -50,6 +53,10 @@ namespace nvtt
             isNormalMap = false;
             
             image = NULL;
+
+            precision = StoragePrecision_Float;
+            packed = NULL;
+            view = NULL;
         }
         Private(const Private & p) : RefCounted() // Copy ctor. inits refcount to 0.
         {
@@ -60,19 +67,67 @@ namespace nvtt
             alphaMode = p.alphaMode;
             isNormalMap = p.isNormalMap;
 
-            image = p.image->clone();
+            precision = p.precision;
+            packed = NULL;
+            view = NULL;
+
+            if (p.packed != NULL) {
+                image = new nv::FloatImage();
+                image->setHeader(p.image->componentCount(), p.image->width(), p.image->height(), p.image->depth());
+
+                const size_t size = packedSize();
+                packed = nv::malloc<uint8>(size);
+                memcpy(packed, p.packed, size);
+            }
+            else if (p.image != NULL) {
+                // Channels are copied when they are modified, see Surface::detach.
+                image = p.image->share();
+            }
+            else {
+                image = NULL;
+            }
         }
         ~Private()
         {
             delete image;
+            delete view;
+            nv::free(packed);
         }
 
+        // Compact storage. When the image is packed, its header is valid, but its texels live in the packed buffer.
+        void pack(StoragePrecision precision);
+        void unpack();
+        size_t packedSize() const;
+        void decode(float * dst) const;
+        void decode(uint64 first, uint count, float * dst) const;
+
+        // Add the missing channels up to the given count, zeroed.
+        void expand(uint channelCount);
+
+        // Add zeroed channels or remove the last ones, packed texels stay packed.
+        void resizeChannelCount(uint channelCount);
+
+        // Const methods read the texels through these and never modify the private data, it may be shared by surfaces
+        // used in other threads. The copies have the packed texels decoded and the missing channels zeroed.
+        nv::FloatImage * createReadImage(uint channelCount) const;
+        const nv::FloatImage * readImage(uint channelCount, nv::AutoPtr<nv::FloatImage> & tmp) const;
+
+        // Float copy with 4 contiguous channels that backs data() and channel() when the image can't be returned as
+        // is. It's kept until the surface is modified.
+        const nv::FloatImage * floatView() const;
+        void releaseView();
+
         TextureType type;
         WrapMode wrapMode;
         AlphaMode alphaMode;
         bool isNormalMap;
 
         nv::FloatImage * image;
+
+        StoragePrecision precision;
+        uint8 * packed;
+
+        mutable nv::FloatImage * view;
     };
 
 } // nvtt namespace
@@ -83,6 +138,7 @@ namespace nv {
     uint countMipmaps(uint w, uint h, uint d);
     uint countMipmapsWithMinSize(uint w, uint h, uint d, uint min_size);
     uint computeImageSize(uint w, uint h, uint d, uint bitCount, uint alignmentInBytes, nvtt::Format format);
+    void getDefaultFilterWidthAndParams(int filter, float * filterWidth, float params[2]);
     void getTargetExtent(int * w, int * h, int * d, int maxExtent, nvtt::RoundMode roundMode, nvtt::TextureType textureType, nvtt::ShapeRestriction shapeRestriction = nvtt::ShapeRestriction_None);
 }
 
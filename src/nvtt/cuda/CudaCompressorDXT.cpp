@@ -125,7 +125,7 @@ CudaCompressor::CudaCompressor(CudaContext & ctx) : m_ctx(ctx)
 
 }
 
-void CudaCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * data, nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
+void CudaCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d, const float * const channels[4], nvtt::TaskDispatcher * dispatcher, const nvtt::CompressionOptions::Private & compressionOptions, const nvtt::OutputOptions::Private & outputOptions)
 {
     nvDebugCheck(d == 1);
     nvDebugCheck(cuda::isHardwarePresent());
@@ -136,10 +136,10 @@ void CudaCompressor::compress(nvtt::AlphaMode alphaMode, uint w, uint h, uint d,
     const uint count = w * h;
     Color32 * tmp = malloc<Color32>(count);
     for (uint i = 0; i < count; i++) {
-        tmp[i].r = uint8(clamp(data[i + count*0], 0.0f, 1.0f) * 255);
-        tmp[i].g = uint8(clamp(data[i + count*1], 0.0f, 1.0f) * 255);
-        tmp[i].b = uint8(clamp(data[i + count*2], 0.0f, 1.0f) * 255);
-        tmp[i].a = uint8(clamp(data[i + count*3], 0.0f, 1.0f) * 255);
+        tmp[i].r = uint8(clamp(channels[0][i], 0.0f, 1.0f) * 255);
+        tmp[i].g = uint8(clamp(channels[1][i], 0.0f, 1.0f) * 255);
+        tmp[i].b = uint8(clamp(channels[2][i], 0.0f, 1.0f) * 255);
+        tmp[i].a = uint8(clamp(channels[3][i], 0.0f, 1.0f) * 255);
     }
 
     cudaArray * d_image;
@@ -24,6 +24,8 @@
 
 #include "nvtt.h"
 #include "nvcore/nvcore.h"
+#include "nvcore/Memory.h"
+#include "nvimage/FloatImage.h"
 
 using namespace nvtt;
 
@@ -57,3 +59,26 @@ unsigned int nvtt::version()
 {
     return NVTT_VERSION;
 }
+
+// Set the size above which surfaces are allocated in memory mapped scratch files.
+void nvtt::setScratchFileThreshold(unsigned long long byteCount, const char * directory/*= 0*/)
+{
+    nv::FloatImage::setScratchFileThreshold(byteCount, directory);
+}
+
+void nvtt::setMemoryPoolLimit(unsigned long long byteCount)
+{
+    nv::pool_set_cache_limit(size_t(byteCount));
+}
+
+nvtt::MemoryPoolStats nvtt::memoryPoolStats()
+{
+    const nv::PoolStats pool = nv::pool_stats();
+
+    MemoryPoolStats stats;
+    stats.allocationCount = pool.allocationCount;
+    stats.reuseCount = pool.reuseCount;
+    stats.peakSize = pool.peakSize;
+    stats.cachedSize = pool.cachedSize;
+    return stats;
+}
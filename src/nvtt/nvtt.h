@@ -154,6 +154,15 @@ namespace nvtt
         //Decoder_RSX, // To take advantage of DXT5 bug.
     };
 
+    // Dithering methods used when quantizing colors. (New in NVTT 2.1)
+    enum DitherMode
+    {
+        DitherMode_None,
+        DitherMode_FloydSteinberg,  // Error diffusion. Rows are processed in parallel as a wavefront.
+        DitherMode_Ordered,         // 8x8 Bayer threshold matrix.
+        DitherMode_BlueNoise,       // 64x64 blue noise threshold matrix, less structured than ordered dithering.
+    };
+
 
     // Compression options. This class describes the desired compression format and other compression settings.
     struct CompressionOptions
@@ -184,6 +193,7 @@ namespace nvtt
         // @@ I wish this wasn't part of the compression options. Quantization is applied before compression. We don't have compressors with error diffusion. 
         // @@ These options are only taken into account when using the InputOptions API.
         NVTT_API void setQuantization(bool colorDithering, bool alphaDithering, bool binaryAlpha, int alphaThreshold = 127);
+        NVTT_API void setDitherMode(DitherMode mode);
 
         NVTT_API void setTargetDecoder(Decoder decoder);
 
@@ -232,6 +242,15 @@ namespace nvtt
         InputFormat_R_32F,      // Single channel 32 bit floating point.
     };
 
+    // Surface storage precision. (New in NVTT 2.1)
+    enum StoragePrecision
+    {
+        StoragePrecision_Float,     // 32 bit floating point.
+        StoragePrecision_Half,      // 16 bit floating point.
+        StoragePrecision_UNorm16,   // Normalized [0, 1] 16 bit fixed point, values are clamped.
+        StoragePrecision_UNorm8,    // Normalized [0, 1] 8 bit fixed point, values are clamped.
+    };
+
     // Mipmap downsampling filters.
     enum MipmapFilter
     {
@@ -339,6 +358,11 @@ namespace nvtt
 
         // Indicate the end of the compressed image. (New in NVTT 2.1)
         virtual void endImage() = 0;
+
+        // Output data at the given offset from the first byte output through the handler. When the DDS header is the
+        // first output, the images that follow it are written at their final location with this method, so they can be
+        // compressed in any order. Return false to receive them through writeData, in the order they are compressed.
+        virtual bool writeDataAt(unsigned long long /*offset*/, const void * /*data*/, int /*size*/) { return false; }
     };
 
     // Error codes.
@@ -465,6 +489,37 @@ namespace nvtt
 
     // Transform the given x,y,z coordinates.
     typedef void WarpFunction(float & x, float & y, float & z);
+    typedef void ReleaseFunction(void * context);
+
+    // Statistics to gather with Surface::analyze. (New in NVTT 2.1)
+    struct StatsRequest
+    {
+        NVTT_API StatsRequest();
+
+        enum { MaxAlphaRefCount = 8 };
+
+        // Alpha test coverage at each of the reference values, computed like Surface::alphaTestCoverage.
+        int alphaChannel;
+        int alphaRefCount;
+        float alphaRefs[MaxAlphaRefCount];
+
+        // Histogram of one channel, -1 to skip it. Counts are added to the caller's bins, like Surface::histogram.
+        int histogramChannel;
+        float histogramMin;
+        float histogramMax;
+        int histogramBinCount;
+        int * histogramBins;
+    };
+
+    struct SurfaceStats
+    {
+        float minimum[4];
+        float maximum[4];
+        float mean[4];
+        float variance[4];
+        bool isConstant[4];     // All the texels of the channel have the same value.
+        float alphaCoverage[StatsRequest::MaxAlphaRefCount];
+    };
 
 
     // A surface is one level of a 2D or 3D texture. (New in NVTT 2.1)
@@ -482,6 +537,14 @@ namespace nvtt
         NVTT_API void setAlphaMode(AlphaMode alphaMode);
         NVTT_API void setNormalMap(bool isNormalMap);
 
+        // Compact storage. Texels are expanded to 32 bit floats on demand by the operations that need them.
+        NVTT_API void setStoragePrecision(StoragePrecision precision);
+        NVTT_API StoragePrecision storagePrecision() const;
+
+        // Channel count. Surfaces only store the channels they use, missing channels read as zero.
+        NVTT_API void setChannelCount(int count);
+        NVTT_API int channelCount() const;
+
         // Queries.
         NVTT_API bool isNull() const;
         NVTT_API int width() const;
@@ -499,6 +562,7 @@ namespace nvtt
         NVTT_API const float * channel(int i) const;
         NVTT_API void histogram(int channel, float rangeMin, float rangeMax, int binCount, int * binPtr) const;
         NVTT_API void range(int channel, float * rangeMin, float * rangeMax, int alpha_channel = -1, float alpha_ref = 0.f) const;
+        NVTT_API SurfaceStats analyze(const StatsRequest & request) const;
 
         // Texture data.
         NVTT_API bool load(const char * fileName, bool * hasAlpha = 0);
@@ -508,6 +572,11 @@ namespace nvtt
         NVTT_API bool setImage(InputFormat format, int w, int h, int d, const void * r, const void * g, const void * b, const void * a);
         NVTT_API bool setImage2D(Format format, Decoder decoder, int w, int h, const void * data);
 
+        // Reference caller owned float channels without copying them. The channels are never modified, mutable operations
+        // work on a copy. release(context) is called once the surface and its copies no longer reference them. Without
+        // alpha the surface has three channels. Returns false if the extents are not positive or r, g or b is NULL.
+        NVTT_API bool wrap(int w, int h, int d, const float * r, const float * g, const float * b, const float * a, ReleaseFunction * release = 0, void * context = 0);
+
         // Resizing methods.
         NVTT_API void resize(int w, int h, int d, ResizeFilter filter);
         NVTT_API void resize(int w, int h, int d, ResizeFilter filter, float filterWidth, const float * params = 0);
@@ -565,7 +634,9 @@ namespace nvtt
 
         // Color quantization.
         NVTT_API void binarize(int channel, float threshold, bool dither);
+        NVTT_API void binarize(int channel, float threshold, DitherMode mode);
         NVTT_API void quantize(int channel, int bits, bool exactEndPoints, bool dither);
+        NVTT_API void quantize(int channel, int bits, bool exactEndPoints, DitherMode mode);
 
         // Normal map transforms.
         NVTT_API void toNormalMap(float sm, float medium, float big, float large);
@@ -599,6 +670,9 @@ namespace nvtt
 
     //private:
         void detach();
+        void detach(int firstChannel, int channelCount);
+        void detachPrivate();
+        void discardImage();
 
         struct Private;
         Private * m;
@@ -611,7 +685,7 @@ namespace nvtt
         CubeLayout_HorizontalCross,
         CubeLayout_Column,
         CubeLayout_Row,
-        CubeLayout_LatitudeLongitude
+        CubeLayout_LatitudeLongitude    // Equirectangular, 2:1 aspect with +Z at the center and +Y at the top.
     };
 
     // (New in NVTT 2.1)
@@ -622,6 +696,12 @@ namespace nvtt
         EdgeFixup_Average,
     };
 
+    // Cube map filtering modes. (New in NVTT 2.1)
+    enum CubeFilterMode {
+        CubeFilterMode_Exact,           // Convolve the filter against every texel of the input.
+        CubeFilterMode_Hierarchical,    // Convolve the filter against the smallest input mipmap that resolves the filter cone.
+    };
+
     // A CubeSurface is one level of a cube map texture. (New in NVTT 2.1)
     struct CubeSurface
     {
@@ -660,7 +740,11 @@ namespace nvtt
 
         // Filtering.
         NVTT_API CubeSurface irradianceFilter(int size, EdgeFixup fixupMethod) const;
-        NVTT_API CubeSurface cosinePowerFilter(int size, float cosinePower, EdgeFixup fixupMethod) const;
+        NVTT_API CubeSurface cosinePowerFilter(int size, float cosinePower, EdgeFixup fixupMethod, CubeFilterMode mode = CubeFilterMode_Exact) const;
+
+        // Filter the levels of a prefiltered specular chain in a single parallel job. Level i of the chain is filtered with
+        // cosinePowers[i] into a cube of max(1, size >> i) texels.
+        NVTT_API void buildSpecularChain(CubeSurface * chain, int levelCount, int size, const float * cosinePowers, EdgeFixup fixupMethod, CubeFilterMode mode = CubeFilterMode_Exact) const;
 
         NVTT_API CubeSurface fastResample(int size, EdgeFixup fixupMethod) const;
 
@@ -668,14 +752,11 @@ namespace nvtt
         NVTT_API void computeLuminanceIrradianceSH3(float sh[9]) const;
         NVTT_API void computeIrradianceSH3(int channel, float sh[9]) const;
 
-        /*
-        NVTT_API void resize(int w, int h, ResizeFilter filter);
-        NVTT_API void resize(int w, int h, ResizeFilter filter, float filterWidth, const float * params = 0);
-        NVTT_API void resize(int maxExtent, RoundMode mode, ResizeFilter filter);
-        NVTT_API void resize(int maxExtent, RoundMode mode, ResizeFilter filter, float filterWidth, const float * params = 0);
-        NVTT_API bool buildNextMipmap(MipmapFilter filter);
-        NVTT_API bool buildNextMipmap(MipmapFilter filter, float filterWidth, const float * params = 0);
-        */
+        // Resizing filters across the face edges, so that the faces of the result match at the seams.
+        NVTT_API void resize(int size, ResizeFilter filter);
+        NVTT_API void resize(int size, ResizeFilter filter, float filterWidth, const float * params = 0);
+        NVTT_API bool buildNextMipmap(MipmapFilter filter, int min_size = 1);
+        NVTT_API bool buildNextMipmap(MipmapFilter filter, float filterWidth, const float * params = 0, int min_size = 1);
 
         // Color transforms.
         NVTT_API void toLinear(float gamma);
@@ -695,6 +776,22 @@ namespace nvtt
     // Return NVTT version.
     NVTT_API unsigned int version();
 
+    // Store the texels of surfaces larger than the given number of bytes in memory mapped scratch files, so that huge
+    // textures are paged to disk instead of exhausting memory. A threshold of 0 disables it. (New in NVTT 2.1)
+    NVTT_API void setScratchFileThreshold(unsigned long long byteCount, const char * directory = 0);
+
+    // Texel storage and temporary buffers are recycled by a memory pool that keeps up to the given number of bytes of
+    // released memory around. A limit of 0 releases the cached buffers. (New in NVTT 2.1)
+    NVTT_API void setMemoryPoolLimit(unsigned long long byteCount);
+
+    struct MemoryPoolStats {
+        unsigned long long allocationCount;
+        unsigned long long reuseCount;      // Allocations served from released memory.
+        unsigned long long peakSize;        // Peak number of bytes allocated.
+        unsigned long long cachedSize;      // Number of bytes released and kept for reuse.
+    };
+    NVTT_API MemoryPoolStats memoryPoolStats();
+
     // Image comparison and error measurement functions. (New in NVTT 2.1)
     NVTT_API float rmsError(const Surface & reference, const Surface & img);
     NVTT_API float rmsAlphaError(const Surface & reference, const Surface & img);
@@ -704,6 +801,10 @@ namespace nvtt
 
     NVTT_API float rmsToneMappedError(const Surface & reference, const Surface & img, float exposure);
 
+    // Structural similarity of the color channels over windowSize*windowSize box windows, 1 for identical images. (New in NVTT 2.1)
+    NVTT_API float ssim(const Surface & reference, const Surface & img, int windowSize = 8);
+    NVTT_API float multiScaleSsim(const Surface & reference, const Surface & img, int windowSize = 8);
+
 
     NVTT_API Surface histogram(const Surface & img, int width, int height);
     NVTT_API Surface histogram(const Surface & img, float minRange, float maxRange, int width, int height);
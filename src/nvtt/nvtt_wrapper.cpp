@@ -215,6 +215,11 @@ void nvttSetCompressionOptionsQuantization(NvttCompressionOptions * compressionO
     compressionOptions->setQuantization(colorDithering != NVTT_False, alphaDithering != NVTT_False, binaryAlpha != NVTT_False, alphaThreshold);
 }
 
+void nvttSetCompressionOptionsDitherMode(NvttCompressionOptions * compressionOptions, NvttDitherMode mode)
+{
+    compressionOptions->setDitherMode((nvtt::DitherMode)mode);
+}
+
 
 // OutputOptions class.
 NvttOutputOptions * nvttCreateOutputOptions()
@@ -197,6 +197,15 @@ typedef enum
 	NVTT_True,
 } NvttBoolean;
 
+/// Dithering methods.
+typedef enum
+{
+	NVTT_DitherMode_None,
+	NVTT_DitherMode_FloydSteinberg,
+	NVTT_DitherMode_Ordered,
+	NVTT_DitherMode_BlueNoise,
+} NvttDitherMode;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -241,6 +250,7 @@ NVTT_API void nvttSetCompressionOptionsQuality(NvttCompressionOptions * compress
 NVTT_API void nvttSetCompressionOptionsColorWeights(NvttCompressionOptions * compressionOptions, float red, float green, float blue, float alpha);
 NVTT_API void nvttSetCompressionOptionsPixelFormat(NvttCompressionOptions * compressionOptions, unsigned int bitcount, unsigned int rmask, unsigned int gmask, unsigned int bmask, unsigned int amask);
 NVTT_API void nvttSetCompressionOptionsQuantization(NvttCompressionOptions * compressionOptions, NvttBoolean colorDithering, NvttBoolean alphaDithering, NvttBoolean binaryAlpha, int alphaThreshold);
+NVTT_API void nvttSetCompressionOptionsDitherMode(NvttCompressionOptions * compressionOptions, NvttDitherMode mode);
 
 
 // OutputOptions class.
@@ -82,18 +82,18 @@ int main(int argc, char *argv[])
     timer.start();
 
     nvtt::CubeSurface filteredEnvmap[mipmapCount];
+    float cosinePowers[mipmapCount];
 
     // Output filtered mipmaps.
     for (int m = firstMipmap; m < mipmapCount; m++) {
-        int size = topSize >> m;                            // 64, 32, 16, 8
         float cosine_power = topPower / (1 << (2 * m));     // 64, 16,  4, 1
-        cosine_power = nv::max(1.0f, cosine_power);
+        cosinePowers[m] = nv::max(1.0f, cosine_power);
+    }
 
-        printf("filtering step: %d/%d\n", m+1, mipmapCount);
+    printf("filtering %d mipmaps\n", mipmapCount - firstMipmap);
 
-        filteredEnvmap[m] = envmap.cosinePowerFilter(size, cosine_power, nvtt::EdgeFixup_Warp);
-        //filteredEnvmap[m].toGamma(2.2f);
-    }
+    // Sizes: 64, 32, 16, 8
+    envmap.buildSpecularChain(filteredEnvmap + firstMipmap, mipmapCount - firstMipmap, topSize >> firstMipmap, cosinePowers + firstMipmap, nvtt::EdgeFixup_Warp);
 
     for (int f = 0; f < 6; f++) {
         for (int m = firstMipmap; m < mipmapCount; m++) {
@@ -0,0 +1,1396 @@
+// Copyright (c) 2009-2011 Ignacio Castano <castano@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Checks the optimized Surface operations against straightforward scalar references.
+
+#include <nvtt/nvtt.h>
+#include <nvmath/Half.h>
+#include <nvthread/Thread.h>
+
+#include <stdio.h>
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcpy, memcmp
+#include <math.h>
+#include <float.h> // FLT_MAX
+
+using namespace nvtt;
+
+
+// Scalar reference implementations.
+
+static float toSrgb(float f) {
+    if (f != f)                 f = 0.0f;
+    else if (f <= 0.0f)         f = 0.0f;
+    else if (f <= 0.0031308f)   f = 12.92f * f;
+    else if (f <= 1.0f)         f = (powf(f, 0.41666f) * 1.055f) - 0.055f;
+    else                        f = 1.0f;
+    return f;
+}
+
+static float fromSrgb(float f) {
+    if (f < 0.0f)           f = 0.0f;
+    else if (f < 0.04045f)  f = f / 12.92f;
+    else if (f <= 1.0f)     f = powf((f + 0.055f) / 1.055f, 2.4f);
+    else                    f = 1.0f;
+    return f;
+}
+
+
+static int s_failures = 0;
+
+static void check(const char * name, float error, float tolerance)
+{
+    bool pass = error <= tolerance;
+    printf("%-24s max error = %g (tolerance %g) %s\n", name, error, tolerance, pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+// Build a 4 channel surface whose texels sweep the [minValue, maxValue] range.
+static Surface createRamp(int w, int h, float minValue, float maxValue)
+{
+    const int count = w * h * 4;
+    float * data = new float[count];
+    for (int i = 0; i < count; i++) {
+        data[i] = minValue + (maxValue - minValue) * float(i) / float(count - 1);
+    }
+
+    Surface img;
+    img.setImage(InputFormat_RGBA_32F, w, h, 1, data);
+    delete [] data;
+
+    return img;
+}
+
+// Cube whose texels store the direction of their centers, with the face orientations of CubeSurface.
+static CubeSurface createDirectionCube(int size)
+{
+    float * data = new float[size * size * 4];
+
+    CubeSurface cube;
+    for (int f = 0; f < 6; f++) {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                const float u = (x + 0.5f) * 2.0f / size - 1.0f;
+                const float v = (y + 0.5f) * 2.0f / size - 1.0f;
+                const float dirs[6][3] = { { 1, -v, -u }, { -1, -v, u }, { u, 1, v }, { u, -1, -v }, { u, -v, 1 }, { -u, -v, -1 } };
+                const float * d = dirs[f];
+                const float l = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+                float * texel = data + (y * size + x) * 4;
+                texel[0] = d[0] / l;
+                texel[1] = d[1] / l;
+                texel[2] = d[2] / l;
+                texel[3] = 1.0f;
+            }
+        }
+        cube.face(f).setImage(InputFormat_RGBA_32F, size, size, 1, data);
+    }
+
+    delete [] data;
+    return cube;
+}
+
+// Max absolute (or relative to max(1,|ref|)) difference between the channels of img and f(ref).
+template <typename F>
+static float maxError(const Surface & ref, const Surface & img, int firstChannel, int channelCount, F f, bool relative)
+{
+    const int count = ref.width() * ref.height() * ref.depth();
+
+    float error = 0.0f;
+    for (int c = firstChannel; c < firstChannel + channelCount; c++) {
+        const float * r = ref.channel(c);
+        const float * p = img.channel(c);
+        for (int i = 0; i < count; i++) {
+            float expected = f(r[i]);
+            float e = fabsf(p[i] - expected);
+            if (relative && fabsf(expected) > 1.0f) e /= fabsf(expected);
+            if (e > error) error = e;
+        }
+    }
+    return error;
+}
+
+static void testTransferFunctions()
+{
+    // Odd extents so that the SIMD loops have remainders, large enough to be split between threads.
+    Surface ref = createRamp(317, 251, -0.1f, 1.1f);
+
+    {
+        Surface img = ref;
+        img.toSrgb();
+        check("toSrgb", maxError(ref, img, 0, 3, toSrgb, false), 2e-6f);
+        check("toSrgb (alpha)", maxError(ref, img, 3, 1, [](float f) { return f; }, false), 0.0f);
+    }
+    {
+        Surface img = ref;
+        img.toLinearFromSrgb();
+        check("toLinearFromSrgb", maxError(ref, img, 0, 3, fromSrgb, false), 2e-6f);
+    }
+    {
+        Surface img = ref;
+        img.toGamma(2.2f);
+        check("toGamma(2.2)", maxError(ref, img, 0, 3, [](float f) { return f > 0.0f ? powf(f, 1.0f / 2.2f) : 0.0f; }, true), 2e-5f);
+    }
+    {
+        Surface img = ref;
+        img.toLinear(2.2f);
+        check("toLinear(2.2)", maxError(ref, img, 0, 3, [](float f) { return f > 0.0f ? powf(f, 2.2f) : 0.0f; }, true), 2e-5f);
+    }
+    {
+        Surface img = ref;
+        img.toGamma(1.8f);
+        check("toGamma(1.8)", maxError(ref, img, 0, 3, [](float f) { return powf(f > 0.0f ? f : 0.0f, 1.0f / 1.8f); }, true), 2e-6f);
+    }
+    {
+        Surface img = ref;
+        img.toLinear(1, 2.4f);
+        check("toLinear(1, 2.4)", maxError(ref, img, 1, 1, [](float f) { return powf(f > 0.0f ? f : 0.0f, 2.4f); }, true), 2e-6f);
+    }
+
+    // Log scale needs positive values.
+    Surface hdr = createRamp(317, 251, 1e-3f, 64.0f);
+    {
+        Surface img = hdr;
+        img.toLogScale(0, 10.0f);
+        check("toLogScale(10)", maxError(hdr, img, 0, 1, [](float f) { return log2f(f) / log2f(10.0f); }, true), 1e-6f);
+        img.fromLogScale(0, 10.0f);
+        check("fromLogScale(10)", maxError(hdr, img, 0, 1, [](float f) { return f; }, true), 1e-5f);
+    }
+}
+
+static void testStoragePrecision()
+{
+    Surface ref = createRamp(317, 251, 0.0f, 1.0f);
+
+    struct { StoragePrecision precision; const char * name; float tolerance; } tests[] = {
+        { StoragePrecision_Half, "Half", 1.0f / 2048 },
+        { StoragePrecision_UNorm16, "UNorm16", 0.5f / 65535 + 1e-7f },
+        { StoragePrecision_UNorm8, "UNorm8", 0.5f / 255 + 1e-7f },
+    };
+
+    for (int t = 0; t < 3; t++) {
+        Surface img = ref;
+        img.setStoragePrecision(tests[t].precision);
+
+        // Packing a shared surface must not modify the other references.
+        if (img.storagePrecision() != tests[t].precision || ref.storagePrecision() != StoragePrecision_Float ||
+            img.width() != ref.width() || img.height() != ref.height()) {
+            printf("%-24s FAILED\n", tests[t].name);
+            s_failures++;
+            continue;
+        }
+
+        // Copies of packed surfaces stay packed until accessed.
+        Surface copy = img;
+        copy.scaleBias(0, 2.0f, 0.0f);
+        if (copy.storagePrecision() != StoragePrecision_Float || img.storagePrecision() != tests[t].precision) {
+            printf("%-24s copy FAILED\n", tests[t].name);
+            s_failures++;
+        }
+
+        check(tests[t].name, maxError(ref, img, 0, 4, [](float f) { return f; }, false), tests[t].tolerance);
+
+        // Const queries decode to temporaries, the surface stays packed.
+        img.analyze(StatsRequest());
+        img.average(0);
+        nvtt::rmsError(ref, img);
+        if (img.storagePrecision() != tests[t].precision) {
+            printf("%-24s const FAILED\n", tests[t].name);
+            s_failures++;
+        }
+
+        // Settings and the channel count change without decoding, replacing the image doesn't affect the copies.
+        Surface settings = img;
+        settings.setWrapMode(WrapMode_Clamp);
+        settings.setAlphaMode(AlphaMode_Transparency);
+        settings.setChannelCount(2);
+        settings.setChannelCount(3);
+        Surface replaced = img;
+        replaced.setImage(8, 8, 1);
+        if (settings.storagePrecision() != tests[t].precision || settings.channelCount() != 3 || img.channelCount() != 4 ||
+            replaced.width() != 8 || img.width() != ref.width() || img.storagePrecision() != tests[t].precision) {
+            printf("%-24s settings FAILED\n", tests[t].name);
+            s_failures++;
+        }
+
+        check(tests[t].name, maxError(ref, settings, 0, 2, [](float f) { return f; }, false), tests[t].tolerance);
+        check(tests[t].name, maxError(ref, settings, 2, 2, [](float) { return 0.0f; }, false), 0.0f);
+    }
+}
+
+// Append compressed data to a memory buffer.
+struct MemoryOutputHandler : public OutputHandler
+{
+    MemoryOutputHandler() : data(NULL), size(0) {}
+    ~MemoryOutputHandler() { free(data); }
+
+    virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel) {}
+    virtual void endImage() {}
+
+    virtual bool writeData(const void * ptr, int count)
+    {
+        data = (unsigned char *)realloc(data, size + count);
+        memcpy(data + size, ptr, count);
+        size += count;
+        return true;
+    }
+
+    unsigned char * data;
+    int size;
+};
+
+static void testLargeSurfaces()
+{
+    Surface ref = createRamp(317, 251, 0.0f, 1.0f);
+    ref.toLinear(2.2f);
+    Surface refMip = ref;
+    refMip.buildNextMipmap(MipmapFilter_Box);
+
+    // Allocate every surface in a scratch file.
+    setScratchFileThreshold(1);
+    Surface img = createRamp(317, 251, 0.0f, 1.0f);
+    img.toLinear(2.2f);
+    Surface mip = img;
+    mip.buildNextMipmap(MipmapFilter_Box);
+    setScratchFileThreshold(0);
+
+    check("Scratch file storage", maxError(ref, img, 0, 4, [](float f) { return f; }, false), 0.0f);
+    check("Scratch file mipmap", maxError(refMip, mip, 0, 4, [](float f) { return f; }, false), 0.0f);
+
+    // Compressing an image that is output in several bands must produce the same blocks as compressing its halves.
+    const int w = 4096, h = 1024;
+    float * data = new float[w * h * 4];
+    unsigned int seed = 1;
+    for (int i = 0; i < w * h * 4; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = float((seed >> 16) & 0xFF) / 255.0f;
+    }
+    Surface large;
+    large.setImage(InputFormat_RGBA_32F, w, h, 1, data);
+    delete [] data;
+
+    Context context;
+    CompressionOptions compressionOptions;
+    compressionOptions.setFormat(Format_BC1);
+    compressionOptions.setQuality(Quality_Fastest);
+
+    MemoryOutputHandler full, top, bottom;
+    OutputOptions outputOptions;
+    outputOptions.setOutputHeader(false);
+
+    outputOptions.setOutputHandler(&full);
+    context.compress(large, 0, 0, compressionOptions, outputOptions);
+    outputOptions.setOutputHandler(&top);
+    context.compress(large.createSubImage(0, w - 1, 0, h / 2 - 1, 0, 0), 0, 0, compressionOptions, outputOptions);
+    outputOptions.setOutputHandler(&bottom);
+    context.compress(large.createSubImage(0, w - 1, h / 2, h - 1, 0, 0), 0, 0, compressionOptions, outputOptions);
+
+    bool pass = full.size == w * h / 2 && top.size + bottom.size == full.size &&
+        memcmp(full.data, top.data, top.size) == 0 && memcmp(full.data + top.size, bottom.data, bottom.size) == 0;
+    printf("%-24s %s\n", "Banded compression", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static int s_releaseCount = 0;
+
+static void testWrap()
+{
+    const int w = 317, h = 251, count = w * h;
+    Surface ref = createRamp(w, h, 0.0f, 1.0f);
+
+    float * data = new float[4 * count];
+    memcpy(data, ref.data(), 4 * count * sizeof(float));
+
+    bool pass = true;
+    {
+        Surface img;
+        img.wrap(w, h, 1, data, data + count, data + 2 * count, data + 3 * count, [](void *) { s_releaseCount++; });
+
+        // Read only operations work on the caller's memory.
+        Surface copy = img;
+        float refMin, refMax, imgMin, imgMax;
+        ref.range(1, &refMin, &refMax);
+        img.range(1, &imgMin, &imgMax);
+        pass &= img.data() == data && copy.data() == data && refMin == imgMin && refMax == imgMax;
+
+        // Mutable operations work on a copy.
+        copy.scaleBias(0, 2.0f, 0.0f);
+        pass &= copy.data() != data && img.data() == data && s_releaseCount == 0;
+        pass &= memcmp(data, ref.data(), 4 * count * sizeof(float)) == 0;
+
+        check("Wrap (copy)", maxError(ref, copy, 0, 1, [](float f) { return 2.0f * f; }, false), 0.0f);
+    }
+    pass &= s_releaseCount == 1;
+
+    // Without alpha the surface has three channels, invalid arguments leave it unchanged.
+    {
+        Surface img;
+        pass &= img.wrap(w, h, 1, data, data + count, data + 2 * count, NULL);
+        pass &= img.channelCount() == 3 && img.channel(2) == data + 2 * count;
+        pass &= !img.wrap(0, h, 1, data, data + count, data + 2 * count, NULL);
+        pass &= !img.wrap(w, h, 1, data, NULL, data + 2 * count, data + 3 * count);
+        pass &= img.width() == w && img.channelCount() == 3;
+
+        check("Wrap (no alpha)", maxError(ref, img, 0, 3, [](float f) { return f; }, false), 0.0f);
+        check("Wrap (no alpha)", maxError(ref, img, 3, 1, [](float) { return 0.0f; }, false), 0.0f);
+    }
+
+    printf("%-24s %s\n", "Wrap", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    delete [] data;
+}
+
+static void testChannelCopyOnWrite()
+{
+    const int w = 317, h = 251;
+    Surface ref = createRamp(w, h, 0.0f, 1.0f);
+    Surface img = ref;
+
+    // Only the modified channels are copied.
+    img.scaleBias(0, 2.0f, 0.0f);
+    bool pass = img.channel(0) != ref.channel(0) && img.channel(1) == ref.channel(1) && img.channel(2) == ref.channel(2) && img.channel(3) == ref.channel(3);
+
+    img.toGamma(2.2f);
+    pass &= img.channel(1) != ref.channel(1) && img.channel(2) != ref.channel(2) && img.channel(3) == ref.channel(3);
+
+    // Modifying the original copies its channel too.
+    Surface copy = ref;
+    ref.clamp(3, 0.0f, 0.5f);
+    pass &= ref.channel(3) != img.channel(3) && copy.channel(3) == img.channel(3);
+
+    printf("%-24s %s\n", "Channel copy on write", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    check("Shared channel", maxError(copy, img, 3, 1, [](float f) { return f; }, false), 0.0f);
+    check("Detached channel", maxError(copy, ref, 3, 1, [](float f) { return f < 0.5f ? f : 0.5f; }, false), 0.0f);
+
+    // Compressing surfaces whose channels are not contiguous.
+    Context context;
+    CompressionOptions compressionOptions;
+    compressionOptions.setFormat(Format_BC3);
+    compressionOptions.setQuality(Quality_Fastest);
+
+    MemoryOutputHandler shared, contiguous;
+    OutputOptions outputOptions;
+    outputOptions.setOutputHeader(false);
+
+    outputOptions.setOutputHandler(&shared);
+    context.compress(img, 0, 0, compressionOptions, outputOptions);
+    outputOptions.setOutputHandler(&contiguous);
+    context.compress(img.createSubImage(0, w - 1, 0, h - 1, 0, 0), 0, 0, compressionOptions, outputOptions);
+
+    pass = shared.size == contiguous.size && memcmp(shared.data, contiguous.data, shared.size) == 0;
+    printf("%-24s %s\n", "Shared channel compress", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+
+static void testChannelCount()
+{
+    const int w = 131, h = 67;
+    float * data = (float *)malloc(w * h * sizeof(float));
+    for (int i = 0; i < w * h; i++) data[i] = float(i % 97) / 96.0f;
+
+    Surface img;
+    img.setImage(InputFormat_R_32F, w, h, 1, data);
+    free(data);
+
+    // Color transforms only touch the channels that are stored.
+    img.toGamma(2.2f);
+    img.buildNextMipmap(MipmapFilter_Box);
+    bool pass = img.channelCount() == 1;
+
+    Surface full = img;
+    full.setChannelCount(4);
+    pass &= full.channelCount() == 4 && img.channelCount() == 1;
+
+    // Single and two channel formats compress surfaces without the channels they don't read.
+    const Format formats[] = { Format_BC4, Format_BC5 };
+    for (int i = 0; i < 2; i++) {
+        Context context;
+        CompressionOptions compressionOptions;
+        compressionOptions.setFormat(formats[i]);
+
+        MemoryOutputHandler partial, expanded;
+        OutputOptions outputOptions;
+        outputOptions.setOutputHeader(false);
+
+        Surface tmp = img;
+        outputOptions.setOutputHandler(&partial);
+        context.compress(tmp, 0, 0, compressionOptions, outputOptions);
+        bool ok = tmp.channelCount() == 1;
+
+        outputOptions.setOutputHandler(&expanded);
+        context.compress(full, 0, 0, compressionOptions, outputOptions);
+
+        ok &= partial.size == expanded.size && memcmp(partial.data, expanded.data, partial.size) == 0;
+        printf("%-24s %s\n", i == 0 ? "Single channel BC4" : "Single channel BC5", ok ? "OK" : "FAILED");
+        if (!ok) s_failures++;
+    }
+
+    // Missing channels read as zero, const queries don't add them to the surface.
+    pass &= full.channel(0) == img.channel(0);
+    check("Missing channel", maxError(full, img, 1, 3, [](float) { return 0.0f; }, false), 0.0f);
+    check("Missing channel error", nvtt::rmsError(full, img), 0.0f);
+    pass &= img.channelCount() == 1;
+
+    printf("%-24s %s\n", "Channel count", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testMemoryPool()
+{
+    Surface img = createRamp(512, 512, 0.0f, 1.0f);
+
+    // The temporaries of a second mipmap chain reuse the memory released by the first one.
+    for (int pass = 0; pass < 2; pass++) {
+        Surface mip = img;
+        while (mip.buildNextMipmap(MipmapFilter_Kaiser)) {}
+    }
+    const MemoryPoolStats stats = memoryPoolStats();
+    bool pass = stats.reuseCount > 0 && stats.cachedSize > 0 && stats.peakSize > 0;
+
+    setMemoryPoolLimit(0);
+    pass &= memoryPoolStats().cachedSize == 0;
+    setMemoryPoolLimit(256 * 1024 * 1024);
+
+    printf("%-24s %s\n", "Memory pool", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static unsigned int unorm16(float f)
+{
+    f = f * 65535.0f;
+    f = f < 0.0f ? 0.0f : (f > 65535.0f ? 65535.0f : f);
+    return (unsigned int)floorf(f + 0.5f);
+}
+
+static void testPixelFormats()
+{
+    // Odd sizes exercise the scalar tails of the vectorized kernels.
+    const int w = 37, h = 19;
+    Surface img = createRamp(w, h, -0.1f, 1.1f);
+
+    Context context;
+    OutputOptions outputOptions;
+    outputOptions.setOutputHeader(false);
+
+    CompressionOptions compressionOptions;
+    compressionOptions.setFormat(Format_RGBA);
+    compressionOptions.setPixelType(PixelType_UnsignedNorm);
+
+    // RGBA8 and RGB565 against the reference quantization.
+    MemoryOutputHandler rgba8, rgb565;
+    compressionOptions.setPixelFormat(32, 0xFF, 0xFF00, 0xFF0000, 0xFF000000);
+    outputOptions.setOutputHandler(&rgba8);
+    context.compress(img, 0, 0, compressionOptions, outputOptions);
+
+    compressionOptions.setPixelFormat(16, 0xF800, 0x07E0, 0x001F, 0);
+    outputOptions.setOutputHandler(&rgb565);
+    context.compress(img, 0, 0, compressionOptions, outputOptions);
+
+    bool pass = rgba8.size == size_t(w * h * 4) && rgb565.size == size_t(w * h * 2);
+    for (int i = 0; pass && i < w * h; i++) {
+        const unsigned int r = unorm16(img.channel(0)[i]), g = unorm16(img.channel(1)[i]), b = unorm16(img.channel(2)[i]), a = unorm16(img.channel(3)[i]);
+
+        const unsigned char * p8 = (const unsigned char *)rgba8.data + 4 * i;
+        pass &= p8[0] == (r >> 8) && p8[1] == (g >> 8) && p8[2] == (b >> 8) && p8[3] == (a >> 8);
+
+        const unsigned char * p16 = (const unsigned char *)rgb565.data + 2 * i;
+        const unsigned int p = ((r >> 11) << 11) | ((g >> 10) << 5) | (b >> 11);
+        pass &= p16[0] == (p & 0xFF) && p16[1] == (p >> 8);
+    }
+
+    printf("%-24s %s\n", "UNorm pixel formats", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    // R11G11B10F stores red in the least significant bits.
+    Surface color;
+    color.setImage(w, h, 1);
+    color.fill(1.0f, 2.0f, 0.5f, 0.0f);
+
+    MemoryOutputHandler r11g11b10;
+    compressionOptions.setPixelType(PixelType_Float);
+    compressionOptions.setPixelFormat(11, 11, 10, 0);
+    outputOptions.setOutputHandler(&r11g11b10);
+    context.compress(color, 0, 0, compressionOptions, outputOptions);
+
+    const unsigned int expected = (15 << 6) | ((16 << 6) << 11) | ((14 << 5) << 22);
+    pass = r11g11b10.size == size_t(w * h * 4);
+    for (int i = 0; pass && i < w * h; i++) {
+        unsigned int p;
+        memcpy(&p, (const unsigned char *)r11g11b10.data + 4 * i, 4);
+        pass &= p == expected;
+    }
+
+    printf("%-24s %s\n", "R11G11B10F", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testInputConversion()
+{
+    const int w = 37, h = 19, count = w * h;
+
+    unsigned char * bgra = new unsigned char[count * 4];
+    unsigned char * planes = new unsigned char[count * 4];
+    float * rgba = new float[count * 4];
+    for (int i = 0; i < count * 4; i++) {
+        bgra[i] = (unsigned char)(i * 7 + i / 5);
+        rgba[i] = float(i) / 3.0f - 100.0f;
+    }
+    for (int i = 0; i < count; i++) {
+        planes[0 * count + i] = bgra[4 * i + 2];
+        planes[1 * count + i] = bgra[4 * i + 1];
+        planes[2 * count + i] = bgra[4 * i + 0];
+        planes[3 * count + i] = bgra[4 * i + 3];
+    }
+
+    Surface interleaved, planar, floats;
+    interleaved.setImage(InputFormat_BGRA_8UB, w, h, 1, bgra);
+    planar.setImage(InputFormat_BGRA_8UB, w, h, 1, planes, planes + count, planes + 2 * count, planes + 3 * count);
+    floats.setImage(InputFormat_RGBA_32F, w, h, 1, rgba);
+
+    // The vectorized kernels must match the scalar conversion exactly.
+    const int order[4] = { 2, 1, 0, 3 };
+    bool pass = true;
+    for (int c = 0; c < 4; c++) {
+        for (int i = 0; i < count; i++) {
+            const float f = float(bgra[4 * i + order[c]]) / 255.0f;
+            pass &= interleaved.channel(c)[i] == f && planar.channel(c)[i] == f;
+            pass &= floats.channel(c)[i] == rgba[4 * i + c];
+        }
+    }
+
+    delete [] bgra;
+    delete [] planes;
+    delete [] rgba;
+
+    printf("%-24s %s\n", "Input conversion", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testHalfConversion()
+{
+    // Sample the whole float range, including denormals, infinities and NaNs. The odd count exercises the scalar tails.
+    const unsigned int count = 65536 + 3;
+
+    unsigned int * bits = new unsigned int[count];
+    unsigned short * halves = new unsigned short[count];
+    float * floats = new float[count];
+    for (unsigned int i = 0; i < count; i++) bits[i] = i * 65521u;
+
+    nv::half_from_float_array((const float *)bits, halves, count);
+    bool pass = true;
+    for (unsigned int i = 0; i < count; i++) {
+        pass &= halves[i] == nv::half_from_float(bits[i]);
+    }
+
+    for (unsigned int i = 0; i < count; i++) halves[i] = (unsigned short)i;
+    nv::half_to_float_array(halves, floats, count);
+    for (unsigned int i = 0; i < count; i++) {
+        pass &= ((const unsigned int *)floats)[i] == nv::half_to_float(halves[i]);
+    }
+
+    delete [] bits;
+    delete [] halves;
+    delete [] floats;
+
+    printf("%-24s %s\n", "Half conversion", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testAnalyze()
+{
+    Surface img = createRamp(301, 157, -0.2f, 1.3f);
+    const int count = img.width() * img.height();
+
+    StatsRequest request;
+    request.alphaRefCount = 3;
+    request.alphaRefs[0] = 0.25f;
+    request.alphaRefs[1] = 0.5f;
+    request.alphaRefs[2] = 0.75f;
+
+    int bins[16] = { 0 }, refBins[16] = { 0 };
+    request.histogramChannel = 1;
+    request.histogramMin = 0.0f;
+    request.histogramMax = 1.0f;
+    request.histogramBinCount = 16;
+    request.histogramBins = bins;
+
+    const SurfaceStats stats = img.analyze(request);
+
+    float error = 0.0f;
+    bool pass = true;
+    for (int c = 0; c < 4; c++) {
+        float rangeMin, rangeMax;
+        img.range(c, &rangeMin, &rangeMax);
+        pass &= stats.minimum[c] == rangeMin && stats.maximum[c] == rangeMax && !stats.isConstant[c];
+
+        double mean = 0.0, variance = 0.0;
+        const float * p = img.channel(c);
+        for (int i = 0; i < count; i++) mean += p[i];
+        mean /= count;
+        for (int i = 0; i < count; i++) variance += (p[i] - mean) * (p[i] - mean);
+        variance /= count;
+
+        error = fmaxf(error, fabsf(stats.mean[c] - float(mean)));
+        error = fmaxf(error, fabsf(stats.variance[c] - float(variance)));
+    }
+    for (int r = 0; r < request.alphaRefCount; r++) {
+        error = fmaxf(error, fabsf(stats.alphaCoverage[r] - img.alphaTestCoverage(request.alphaRefs[r])));
+    }
+
+    img.histogram(1, 0.0f, 1.0f, 16, refBins);
+    pass &= memcmp(bins, refBins, sizeof(bins)) == 0;
+
+    // Missing channels read as zero.
+    Surface flat;
+    flat.setImage(7, 5, 1);
+    flat.setChannelCount(1);
+    const SurfaceStats flatStats = flat.analyze(StatsRequest());
+    for (int c = 0; c < 4; c++) {
+        pass &= flatStats.isConstant[c] && flatStats.minimum[c] == 0.0f && flatStats.variance[c] == 0.0f;
+    }
+
+    // Packed surfaces are decoded one row at a time, they stay packed.
+    Surface packed = img;
+    packed.setStoragePrecision(StoragePrecision_UNorm16);
+    Surface unpacked = packed;
+    unpacked.setStoragePrecision(StoragePrecision_Float);
+    const SurfaceStats packedStats = packed.analyze(StatsRequest());
+    const SurfaceStats unpackedStats = unpacked.analyze(StatsRequest());
+    pass &= packed.storagePrecision() == StoragePrecision_UNorm16;
+    for (int c = 0; c < 4; c++) {
+        pass &= packedStats.minimum[c] == unpackedStats.minimum[c] && packedStats.maximum[c] == unpackedStats.maximum[c];
+        pass &= packedStats.mean[c] == unpackedStats.mean[c] && packedStats.variance[c] == unpackedStats.variance[c];
+    }
+
+    check("Analyze", error, 1e-5f);
+    printf("%-24s %s\n", "Analyze ranges", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testAlphaToCoverage()
+{
+    // Blobs of alpha with soft edges, like foliage.
+    const int w = 67, h = 45;
+    float * data = new float[w * h * 4];
+    unsigned int seed = 1;
+    for (int i = 0; i < w * h; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const int x = i % w, y = i / w;
+        data[4 * i + 0] = data[4 * i + 1] = data[4 * i + 2] = 0.5f;
+        data[4 * i + 3] = 0.5f + 0.4f * sinf(x * 0.3f) * cosf(y * 0.2f) + float(seed >> 24) / 2560.0f;
+    }
+
+    Surface img;
+    img.setImage(InputFormat_RGBA_32F, w, h, 1, data);
+    delete [] data;
+
+    bool pass = true;
+    const float coverages[] = { 0.2f, 0.45f, 0.7f, 0.95f };
+    for (int c = 0; c < 4; c++) {
+        const float alphaRef = 0.5f;
+
+        // Reference: binary search with full coverage passes.
+        float minAlphaScale = 0.0f, maxAlphaScale = 4.0f, alphaScale = 1.0f;
+        float bestAlphaScale = 1.0f, bestError = FLT_MAX;
+        for (int i = 0; i < 10; i++) {
+            Surface tmp = img;
+            tmp.scaleBias(3, alphaScale, 0.0f);
+            const float currentCoverage = tmp.alphaTestCoverage(alphaRef);
+
+            const float error = fabsf(currentCoverage - coverages[c]);
+            if (error < bestError) {
+                bestError = error;
+                bestAlphaScale = alphaScale;
+            }
+            if (currentCoverage < coverages[c]) minAlphaScale = alphaScale;
+            else if (currentCoverage > coverages[c]) maxAlphaScale = alphaScale;
+            else break;
+            alphaScale = (minAlphaScale + maxAlphaScale) * 0.5f;
+        }
+
+        Surface ref = img;
+        ref.scaleBias(3, bestAlphaScale, 0.0f);
+        ref.clamp(3, 0.0f, 1.0f);
+
+        Surface scaled = img;
+        scaled.scaleAlphaToCoverage(coverages[c], alphaRef);
+
+        pass &= memcmp(ref.channel(3), scaled.channel(3), sizeof(float) * w * h) == 0;
+    }
+
+    printf("%-24s %s\n", "Alpha to coverage", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testAutoResize()
+{
+    Surface img = createRamp(96, 80, 0.0f, 1.0f);
+
+    // The candidates are the chain of half size resizes of the original.
+    Surface chain = img;
+    while (chain.width() > 4 && chain.height() > 4 && (chain.width() + 1) / 2 >= 4 && (chain.height() + 1) / 2 >= 4) {
+        chain.resize((chain.width() + 1) / 2, (chain.height() + 1) / 2, 1, ResizeFilter_Box);
+    }
+
+    Surface smallest = img;
+    smallest.autoResize(FLT_MAX, RoundMode_None, ResizeFilter_Box);
+
+    Surface unchanged = img;
+    unchanged.autoResize(0.0f, RoundMode_None, ResizeFilter_Box);
+
+    bool pass = smallest.width() == chain.width() && smallest.height() == chain.height();
+    pass &= memcmp(smallest.data(), chain.data(), sizeof(float) * 4 * chain.width() * chain.height()) == 0;
+    pass &= unchanged.width() == img.width() && unchanged.height() == img.height();
+
+    printf("%-24s %s\n", "Auto resize", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testDithering()
+{
+    // Large enough to be split between threads.
+    const int w = 317, h = 251;
+
+    Surface ref;
+    ref.setImage(w, h, 1);
+    float * r = const_cast<float *>(ref.channel(0));
+    float * a = const_cast<float *>(ref.channel(3));
+    for (int i = 0; i < w * h; i++) {
+        r[i] = 0.2f + 0.6f * float(i % w) / w;
+        a[i] = 0.3f;
+    }
+
+    double refMean = 0.0;
+    for (int i = 0; i < w * h; i++) refMean += r[i];
+    refMean /= w * h;
+
+    const char * names[3] = { "Floyd-Steinberg", "Ordered dither", "Blue noise dither" };
+    const DitherMode modes[3] = { DitherMode_FloydSteinberg, DitherMode_Ordered, DitherMode_BlueNoise };
+
+    for (int m = 0; m < 3; m++) {
+        Surface img = ref;
+        img.quantize(0, 2, true, modes[m]);
+        img.binarize(3, 0.5f, modes[m]);
+
+        // Dithering preserves the average, values are quantized to 2 bits and binarized.
+        bool quantized = true;
+        double mean = 0.0, alphaMean = 0.0;
+        for (int i = 0; i < w * h; i++) {
+            const float q = img.channel(0)[i] * 3.0f;
+            quantized &= q == floorf(q);
+            quantized &= img.channel(3)[i] == 0.0f || img.channel(3)[i] == 1.0f;
+            mean += img.channel(0)[i];
+            alphaMean += img.channel(3)[i];
+        }
+        mean /= w * h;
+        alphaMean /= w * h;
+
+        const float error = float(fmax(fabs(mean - refMean), fabs(alphaMean - 0.3)));
+
+        // The result does not depend on the thread schedule.
+        Surface again = ref;
+        again.quantize(0, 2, true, modes[m]);
+        again.binarize(3, 0.5f, modes[m]);
+        const bool deterministic = maxError(img, again, 0, 4, [](float x) { return x; }, false) == 0.0f;
+
+        const bool pass = quantized && deterministic && error < 5e-3f;
+        printf("%-24s mean error = %g (tolerance %g) %s\n", names[m], error, 5e-3f, pass ? "OK" : "FAILED");
+        if (!pass) s_failures++;
+    }
+}
+
+static void testNormalMap()
+{
+    // Odd width, so that rows end with partial SSE groups.
+    const int w = 133, h = 71;
+
+    // Height ramp along x in the alpha channel.
+    Surface img;
+    img.setImage(w, h, 1);
+    img.setWrapMode(WrapMode_Mirror);
+    float * a = const_cast<float *>(img.channel(3));
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            a[y * w + x] = 0.25f * float(x) / w;
+        }
+    }
+
+    img.toNormalMap(1.0f, 0.5f, 0.25f, 0.125f);
+
+    // Away from the borders the gradient is constant, so all normals must be the same unit vector.
+    const float rx = img.channel(0)[4 * w + 4];
+    const float ry = img.channel(1)[4 * w + 4];
+    const float rz = img.channel(2)[4 * w + 4];
+    float error = fabsf(sqrtf(rx * rx + ry * ry + rz * rz) - 1.0f);
+    for (int y = 4; y < h - 4; y++) {
+        for (int x = 4; x < w - 4; x++) {
+            const int i = y * w + x;
+            error = fmaxf(error, fabsf(img.channel(0)[i] - rx));
+            error = fmaxf(error, fabsf(img.channel(1)[i] - ry));
+            error = fmaxf(error, fabsf(img.channel(2)[i] - rz));
+        }
+    }
+
+    // The normal points away from the slope.
+    const bool pass = error < 1e-5f && rx != 0.0f && fabsf(ry) < 1e-5f && rz > 0.0f;
+    printf("%-24s error = %g (tolerance %g) %s\n", "Normal map", error, 1e-5f, pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static int clampInt(int x, int a, int b)
+{
+    return x < a ? a : (x > b ? b : x);
+}
+
+static void testConvolve()
+{
+    const int w = 131, h = 67;
+
+    Surface ref;
+    ref.setImage(w, h, 1);
+    float * r = const_cast<float *>(ref.channel(0));
+    srand(7);
+    for (int i = 0; i < w * h; i++) r[i] = float(rand()) / RAND_MAX;
+
+    // Small dense kernel, separable kernel and large dense kernel, each taking a different code path.
+    const char * names[3] = { "Convolve 5x5", "Convolve separable 15x15", "Convolve FFT 21x21" };
+    const int sizes[3] = { 5, 15, 21 };
+
+    for (int n = 0; n < 3; n++) {
+        const int ks = sizes[n];
+        float kernel[21 * 21];
+        for (int y = 0; y < ks; y++) {
+            for (int x = 0; x < ks; x++) {
+                const float dx = float(x - ks / 2), dy = float(y - ks / 2);
+                kernel[y * ks + x] = (n == 1) ? expf(-0.05f * (dx * dx + dy * dy)) : float(rand()) / RAND_MAX - 0.5f;
+            }
+        }
+
+        Surface img = ref;
+        img.setWrapMode(WrapMode_Clamp);
+        img.convolve(0, ks, kernel);
+
+        // Direct evaluation with clamped coordinates.
+        float error = 0.0f;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                double sum = 0.0, total = 0.0;
+                for (int i = 0; i < ks; i++) {
+                    const int sy = clampInt(y + i - ks / 2, 0, h - 1);
+                    for (int e = 0; e < ks; e++) {
+                        const int sx = clampInt(x + e - ks / 2, 0, w - 1);
+                        sum += kernel[i * ks + e] * r[sy * w + sx];
+                        total += fabs(kernel[i * ks + e]);
+                    }
+                }
+                error = fmaxf(error, float(fabs(img.channel(0)[y * w + x] - sum) / total));
+            }
+        }
+
+        check(names[n], error, 1e-5f);
+    }
+}
+
+static void testLoadDDS()
+{
+    const int w = 37, h = 21;
+    Surface ref = createRamp(w, h, 0.0f, 1.0f);
+    const char * fileName = "surfacetest.dds";
+
+    Context context;
+    CompressionOptions compressionOptions;
+    compressionOptions.setQuality(Quality_Fastest);
+
+    // Uncompressed files are decoded by imageFromDDS and block compressed ones by setImage2D, both in place from the
+    // mapped file.
+    const Format formats[2] = { Format_RGBA, Format_BC1 };
+    const char * names[2] = { "Load DDS RGBA", "Load DDS BC1" };
+
+    for (int i = 0; i < 2; i++) {
+        compressionOptions.setFormat(formats[i]);
+
+        MemoryOutputHandler blocks;
+        {
+            OutputOptions outputOptions;
+            outputOptions.setFileName(fileName);
+            context.outputHeader(ref, 1, compressionOptions, outputOptions);
+            context.compress(ref, 0, 0, compressionOptions, outputOptions);
+
+            outputOptions.setOutputHeader(false);
+            outputOptions.setOutputHandler(&blocks);
+            context.compress(ref, 0, 0, compressionOptions, outputOptions);
+        }
+
+        Surface expected = ref;
+        if (formats[i] == Format_BC1) {
+            expected.setImage2D(Format_BC1, Decoder_D3D10, w, h, blocks.data);
+        }
+
+        Surface img;
+        float error = 1.0f;
+        if (img.load(fileName) && img.width() == w && img.height() == h) {
+            error = maxError(expected, img, 0, 4, [](float x) { return x; }, false);
+        }
+
+        // RGBA is within one step of the 8 bit quantization, BC1 matches the decoded blocks exactly.
+        check(names[i], error, formats[i] == Format_RGBA ? 1.0f / 255.0f : 0.0f);
+    }
+
+    remove(fileName);
+}
+
+// Compare the contents of a file with the data of a handler, and remove the file.
+static bool matchesFile(const char * fileName, const MemoryOutputHandler & handler)
+{
+    bool match = false;
+    if (FILE * fp = fopen(fileName, "rb")) {
+        unsigned char * data = (unsigned char *)malloc(handler.size + 1);
+        const size_t size = fread(data, 1, handler.size + 1, fp);
+        match = size == size_t(handler.size) && memcmp(data, handler.data, size) == 0;
+        free(data);
+        fclose(fp);
+    }
+    remove(fileName);
+    return match;
+}
+
+static void testPositionedOutput()
+{
+    const int mipmapCount = 5;
+    CubeSurface mipmaps[mipmapCount];
+    mipmaps[0] = createDirectionCube(16);
+    for (int m = 1; m < mipmapCount; m++) {
+        mipmaps[m] = mipmaps[m - 1];
+        mipmaps[m].buildNextMipmap(MipmapFilter_Box);
+    }
+
+    Context context;
+    CompressionOptions compressionOptions;
+    compressionOptions.setFormat(Format_BC1);
+    compressionOptions.setQuality(Quality_Fastest);
+
+    // Reference in file order, through a handler without positioned writes.
+    MemoryOutputHandler sequential;
+    {
+        OutputOptions outputOptions;
+        outputOptions.setOutputHandler(&sequential);
+        context.outputHeader(mipmaps[0], mipmapCount, compressionOptions, outputOptions);
+        for (int f = 0; f < 6; f++) {
+            for (int m = 0; m < mipmapCount; m++) {
+                context.compress(mipmaps[m].face(f), f, m, compressionOptions, outputOptions);
+            }
+        }
+    }
+
+    // Reverse order, each image is written at its location in the file.
+    const char * fileName = "surfacetest.dds";
+    {
+        OutputOptions outputOptions;
+        outputOptions.setFileName(fileName);
+        context.outputHeader(mipmaps[0], mipmapCount, compressionOptions, outputOptions);
+        for (int m = mipmapCount - 1; m >= 0; m--) {
+            for (int f = 5; f >= 0; f--) {
+                context.compress(mipmaps[m].face(f), f, m, compressionOptions, outputOptions);
+            }
+        }
+    }
+
+    bool pass = matchesFile(fileName, sequential);
+
+    // Images that are not part of the texture in the header are appended after it, in the order they are compressed.
+    const int layoutMipmapCount = mipmapCount - 1;
+    MemoryOutputHandler appended;
+    {
+        OutputOptions outputOptions;
+        outputOptions.setOutputHandler(&appended);
+        context.outputHeader(mipmaps[0], layoutMipmapCount, compressionOptions, outputOptions);
+        for (int f = 0; f < 6; f++) {
+            for (int m = 0; m < layoutMipmapCount; m++) {
+                context.compress(mipmaps[m].face(f), f, m, compressionOptions, outputOptions);
+            }
+        }
+        for (int f = 5; f >= 0; f--) {
+            context.compress(mipmaps[mipmapCount - 1].face(f), f, mipmapCount - 1, compressionOptions, outputOptions);
+        }
+    }
+    {
+        OutputOptions outputOptions;
+        outputOptions.setFileName(fileName);
+        context.outputHeader(mipmaps[0], layoutMipmapCount, compressionOptions, outputOptions);
+        for (int m = mipmapCount - 1; m >= 0; m--) {
+            for (int f = 5; f >= 0; f--) {
+                context.compress(mipmaps[m].face(f), f, m, compressionOptions, outputOptions);
+            }
+        }
+    }
+
+    pass &= matchesFile(fileName, appended);
+
+    printf("%-24s %s\n", "Positioned output", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+// Compresses three faces of a cube texture, then the images of the given extra mipmap of those faces.
+struct CompressFacesTask
+{
+    const Context * context;
+    const CompressionOptions * compressionOptions;
+    const OutputOptions * outputOptions;
+    const CubeSurface * mipmaps;
+    int mipmapCount;
+    int firstFace;
+
+    static void run(void * arg)
+    {
+        const CompressFacesTask * task = (const CompressFacesTask *)arg;
+        for (int f = task->firstFace; f < task->firstFace + 3; f++) {
+            for (int m = 0; m <= task->mipmapCount; m++) {
+                task->context->compress(task->mipmaps[m].face(f), f, m, *task->compressionOptions, *task->outputOptions);
+            }
+        }
+    }
+};
+
+static void testConcurrentOutput()
+{
+    const int mipmapCount = 4;
+    CubeSurface mipmaps[mipmapCount + 1];
+    mipmaps[0] = createDirectionCube(16);
+    for (int m = 1; m <= mipmapCount; m++) {
+        mipmaps[m] = mipmaps[m - 1];
+        mipmaps[m].buildNextMipmap(MipmapFilter_Box);
+    }
+
+    Context context;
+    CompressionOptions compressionOptions;
+    compressionOptions.setFormat(Format_BC1);
+    compressionOptions.setQuality(Quality_Fastest);
+
+    // Reference with the images of the extra mipmap appended after the texture.
+    MemoryOutputHandler reference;
+    {
+        OutputOptions outputOptions;
+        outputOptions.setOutputHandler(&reference);
+        context.outputHeader(mipmaps[0], mipmapCount, compressionOptions, outputOptions);
+        for (int f = 0; f < 6; f++) {
+            for (int m = 0; m < mipmapCount; m++) {
+                context.compress(mipmaps[m].face(f), f, m, compressionOptions, outputOptions);
+            }
+        }
+        for (int f = 0; f < 6; f++) {
+            context.compress(mipmaps[mipmapCount].face(f), f, mipmapCount, compressionOptions, outputOptions);
+        }
+    }
+
+    // Two threads compress into the same output options.
+    const char * fileName = "surfacetest.dds";
+    {
+        OutputOptions outputOptions;
+        outputOptions.setFileName(fileName);
+        context.outputHeader(mipmaps[0], mipmapCount, compressionOptions, outputOptions);
+
+        CompressFacesTask tasks[2];
+        nv::Thread threads[2];
+        for (int i = 0; i < 2; i++) {
+            CompressFacesTask task = { &context, &compressionOptions, &outputOptions, mipmaps, mipmapCount, 3 * i };
+            tasks[i] = task;
+            threads[i].start(CompressFacesTask::run, &tasks[i]);
+        }
+        nv::Thread::wait(threads, 2);
+    }
+
+    // The texture must match, the appended images can be in any order but must not overlap.
+    bool pass = false;
+    const int blockSize = 8;
+    const int textureSize = reference.size - 6 * blockSize;
+    if (FILE * fp = fopen(fileName, "rb")) {
+        unsigned char * data = (unsigned char *)malloc(reference.size + 1);
+        const size_t size = fread(data, 1, reference.size + 1, fp);
+        pass = size == size_t(reference.size) && memcmp(data, reference.data, textureSize) == 0;
+
+        bool found[6] = {};
+        for (int i = 0; i < 6 && pass; i++) {
+            int f = 0;
+            while (f < 6 && (found[f] || memcmp(data + textureSize + i * blockSize, reference.data + textureSize + f * blockSize, blockSize) != 0)) f++;
+            pass = f < 6;
+            if (pass) found[f] = true;
+        }
+
+        free(data);
+        fclose(fp);
+    }
+    remove(fileName);
+
+    printf("%-24s %s\n", "Concurrent output", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testErrorMetrics()
+{
+    Surface ref = createRamp(211, 97, 0.0f, 2.0f);
+    Surface img = ref;
+    img.scaleBias(0, 0.9f, 0.05f);
+    img.scaleBias(2, 1.1f, -0.1f);
+    const int count = ref.width() * ref.height();
+
+    double mse = 0.0;
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < count; i++) {
+            double d = ref.channel(c)[i] - img.channel(c)[i];
+            mse += d * d;
+        }
+    }
+    float error = fabsf(rmsError(ref, img) - float(sqrt(mse / count)));
+
+    // Tone mapped error of copies processed with the Surface operations.
+    const float exposure = 1.5f;
+    Surface r = ref, i = img;
+    for (int c = 0; c < 3; c++) {
+        r.scaleBias(c, 1.0f / exposure, 0.0f);
+        i.scaleBias(c, 1.0f / exposure, 0.0f);
+    }
+    r.toneMap(ToneMapper_Reindhart, NULL);
+    i.toneMap(ToneMapper_Reindhart, NULL);
+    r.toSrgb();
+    i.toSrgb();
+    error = fmaxf(error, fabsf(rmsToneMappedError(ref, img, exposure) - rmsError(r, i)));
+
+    bool pass = error < 1e-6f;
+    pass &= ssim(ref, ref) == 1.0f && multiScaleSsim(ref, ref) == 1.0f;
+    pass &= ssim(ref, img) < 1.0f && ssim(ref, img) > 0.0f;
+    pass &= multiScaleSsim(ref, img) < 1.0f && multiScaleSsim(ref, img) > 0.0f;
+
+    printf("%-24s %s (%g)\n", "Error metrics", pass ? "OK" : "FAILED", error);
+    if (!pass) s_failures++;
+}
+
+static void testCubeFilter()
+{
+    CubeSurface cube;
+    for (int f = 0; f < 6; f++) {
+        cube.face(f) = createRamp(64, 64, 0.1f * f, 0.1f * f + 1.0f);
+    }
+
+    // A wide lobe is convolved against a mipmap of the input in hierarchical mode.
+    CubeSurface exact = cube.cosinePowerFilter(8, 4.0f, EdgeFixup_None, CubeFilterMode_Exact);
+    CubeSurface hierarchical = cube.cosinePowerFilter(8, 4.0f, EdgeFixup_None, CubeFilterMode_Hierarchical);
+
+    float error = 0.0f;
+    for (int f = 0; f < 6; f++) {
+        error = fmaxf(error, maxError(exact.face(f), hierarchical.face(f), 0, 3, [](float x) { return x; }, false));
+    }
+
+    printf("%-24s max error = %g (tolerance %g) %s\n", "Cube filter", error, 1e-3f, error < 1e-3f ? "OK" : "FAILED");
+    if (error >= 1e-3f) s_failures++;
+
+    // The levels of a specular chain match separate filter calls.
+    const float cosinePowers[2] = { 16.0f, 4.0f };
+    CubeSurface chain[2];
+    cube.buildSpecularChain(chain, 2, 8, cosinePowers, EdgeFixup_Warp, CubeFilterMode_Hierarchical);
+
+    bool pass = true;
+    for (int l = 0; l < 2; l++) {
+        CubeSurface level = cube.cosinePowerFilter(8 >> l, cosinePowers[l], EdgeFixup_Warp, CubeFilterMode_Hierarchical);
+        for (int f = 0; f < 6; f++) {
+            pass &= chain[l].edgeLength() == (8 >> l);
+            pass &= maxError(level.face(f), chain[l].face(f), 0, 3, [](float x) { return x; }, false) == 0.0f;
+        }
+    }
+
+    printf("%-24s %s\n", "Specular chain", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    // The SH irradiance approximates the convolution with the clamped cosine lobe.
+    CubeSurface irradiance = cube.irradianceFilter(8, EdgeFixup_None);
+    CubeSurface lambert = cube.cosinePowerFilter(8, 1.0f, EdgeFixup_None);
+
+    error = 0.0f;
+    for (int f = 0; f < 6; f++) {
+        error = fmaxf(error, maxError(lambert.face(f), irradiance.face(f), 0, 3, [](float x) { return x; }, false));
+    }
+
+    printf("%-24s max error = %g (tolerance %g) %s\n", "Irradiance filter", error, 2e-2f, error < 2e-2f ? "OK" : "FAILED");
+    if (error >= 2e-2f) s_failures++;
+
+    // Resizing filters across the seams, a smooth function of the direction stays smooth at the face edges.
+    CubeSurface directions = createDirectionCube(32);
+    CubeSurface expected = createDirectionCube(16);
+
+    CubeSurface mipmap = directions;
+    mipmap.buildNextMipmap(MipmapFilter_Kaiser);
+
+    error = 0.0f;
+    float faceError = 0.0f;
+    for (int f = 0; f < 6; f++) {
+        error = fmaxf(error, maxError(expected.face(f), mipmap.face(f), 0, 4, [](float x) { return x; }, false));
+
+        Surface face = directions.face(f);
+        face.buildNextMipmap(MipmapFilter_Kaiser);
+        faceError = fmaxf(faceError, maxError(expected.face(f), face, 0, 4, [](float x) { return x; }, false));
+    }
+
+    // Filtering the faces separately is less accurate at the seams.
+    pass = mipmap.edgeLength() == 16 && error < faceError;
+
+    printf("%-24s max error = %g (separate faces %g) %s\n", "Cube mipmap", error, faceError, pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    // With transparency the color of the transparent texels barely contributes, at every level of the chain.
+    CubeSurface checker;
+    for (int f = 0; f < 6; f++) {
+        Surface & face = checker.face(f);
+        face.setImage(8, 8, 1);
+        face.setAlphaMode(AlphaMode_Transparency);
+        float * r = const_cast<float *>(face.channel(0));
+        float * a = const_cast<float *>(face.channel(3));
+        for (int i = 0; i < 64; i++) {
+            const bool opaque = ((i % 8) + (i / 8)) % 2 == 0;
+            r[i] = opaque ? 0.0f : 1.0f;
+            a[i] = opaque ? 1.0f : 0.0f;
+        }
+    }
+
+    error = 0.0f;
+    pass = true;
+    for (int l = 0; l < 2; l++) {
+        checker.buildNextMipmap(MipmapFilter_Box);
+        for (int f = 0; f < 6; f++) {
+            pass &= checker.face(f).alphaMode() == AlphaMode_Transparency;
+            error = fmaxf(error, maxError(checker.face(f), checker.face(f), 0, 1, [](float) { return 0.0f; }, false));
+        }
+    }
+    pass &= error < 1e-2f;
+
+    printf("%-24s max error = %g (tolerance %g) %s\n", "Cube mipmap alpha", error, 1e-2f, pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+static void testCubeLayouts()
+{
+    // Edge length that is not a multiple of 4, so that the SIMD loops have remainders.
+    const int edgeLength = 18;
+    CubeSurface cube = createDirectionCube(edgeLength);
+
+    const CubeLayout layouts[4] = { CubeLayout_VerticalCross, CubeLayout_HorizontalCross, CubeLayout_Column, CubeLayout_Row };
+
+    bool pass = true;
+    for (int l = 0; l < 4; l++) {
+        CubeSurface folded;
+        folded.fold(cube.unfold(layouts[l]), layouts[l]);
+
+        pass &= folded.edgeLength() == edgeLength;
+        for (int f = 0; f < 6; f++) {
+            pass &= maxError(cube.face(f), folded.face(f), 0, 4, [](float x) { return x; }, false) == 0.0f;
+        }
+    }
+
+    // Packed faces are read through a copy, they stay packed.
+    CubeSurface packed = createDirectionCube(edgeLength);
+    packed.face(0).setStoragePrecision(StoragePrecision_Half);
+    packed.unfold(CubeLayout_Column);
+    pass &= packed.face(0).storagePrecision() == StoragePrecision_Half;
+
+    // Images too small for the layout are rejected.
+    CubeSurface narrow;
+    narrow.fold(createRamp(2, 8, 0.0f, 1.0f), CubeLayout_VerticalCross);
+    pass &= narrow.isNull();
+
+    printf("%-24s %s\n", "Cube layouts", pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+
+    // Latitude-longitude image of the directions, +Z at the center and +Y at the top. Unfolding interpolates within the
+    // faces, which is less accurate near the edges at this resolution.
+    const int w = 4 * edgeLength;
+    const int h = 2 * edgeLength;
+    float * data = new float[w * h * 4];
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const float longitude = ((x + 0.5f) / w - 0.5f) * 2.0f * 3.14159265f;
+            const float colatitude = (y + 0.5f) / h * 3.14159265f;
+
+            float * texel = data + (y * w + x) * 4;
+            texel[0] = sinf(colatitude) * sinf(longitude);
+            texel[1] = cosf(colatitude);
+            texel[2] = sinf(colatitude) * cosf(longitude);
+            texel[3] = 1.0f;
+        }
+    }
+
+    Surface latitudeLongitude;
+    latitudeLongitude.setImage(InputFormat_RGBA_32F, w, h, 1, data);
+    delete [] data;
+
+    CubeSurface folded;
+    folded.fold(latitudeLongitude, CubeLayout_LatitudeLongitude);
+
+    float error = 0.0f;
+    for (int f = 0; f < 6; f++) {
+        error = fmaxf(error, maxError(cube.face(f), folded.face(f), 0, 4, [](float x) { return x; }, false));
+    }
+
+    Surface unfolded = folded.unfold(CubeLayout_LatitudeLongitude);
+    error = fmaxf(error, maxError(latitudeLongitude, unfolded, 0, 4, [](float x) { return x; }, false));
+
+    pass = folded.edgeLength() == edgeLength && unfolded.width() == w && unfolded.height() == h && error < 3e-2f;
+
+    printf("%-24s max error = %g (tolerance %g) %s\n", "Latitude-longitude", error, 3e-2f, pass ? "OK" : "FAILED");
+    if (!pass) s_failures++;
+}
+
+int main(int argc, char *argv[])
+{
+    testTransferFunctions();
+    testStoragePrecision();
+    testLargeSurfaces();
+    testWrap();
+    testChannelCopyOnWrite();
+    testChannelCount();
+    testMemoryPool();
+    testPixelFormats();
+    testInputConversion();
+    testHalfConversion();
+    testAnalyze();
+    testAlphaToCoverage();
+    testAutoResize();
+    testErrorMetrics();
+    testDithering();
+    testNormalMap();
+    testConvolve();
+    testLoadDDS();
+    testPositionedOutput();
+    testConcurrentOutput();
+    testCubeFilter();
+    testCubeLayouts();
+
+    if (s_failures != 0) {
+        printf("%d checks FAILED\n", s_failures);
+        return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}
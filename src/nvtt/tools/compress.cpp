@@ -453,10 +453,8 @@ int main(int argc, char *argv[])
 
         if (rangescale) {
             // get color range
-            float min_color[3], max_color[3];
-            image.range(0, &min_color[0], &max_color[0]);
-            image.range(1, &min_color[1], &max_color[1]);
-            image.range(2, &min_color[2], &max_color[2]);
+            const nvtt::SurfaceStats stats = image.analyze(nvtt::StatsRequest());
+            const float * max_color = stats.maximum;
 
             //printf("Color range = %.2f %.2f %.2f\n", max_color[0], max_color[1], max_color[2]);
 
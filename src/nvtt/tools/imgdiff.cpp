@@ -261,10 +261,8 @@ int main(int argc, char *argv[])
 
     // Scale second image to range of the first one.
     if (rangescale) {
-        float min_color[3], max_color[3];
-        image0.range(0, &min_color[0], &max_color[0]);
-        image0.range(1, &min_color[1], &max_color[1]);
-        image0.range(2, &min_color[2], &max_color[2]);
+        const nvtt::SurfaceStats stats = image0.analyze(nvtt::StatsRequest());
+        const float * max_color = stats.maximum;
         float color_range = nv::max3(max_color[0], max_color[1], max_color[2]);
 
         const float max_color_range = 16.0f;